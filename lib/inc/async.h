@@ -0,0 +1,96 @@
+#ifndef _ASYNC_H_
+#define _ASYNC_H_
+
+#include "jmraid.h"
+
+// Drives commands on many enclosures from one thread. Every enclosure has at
+// most one command in flight; its write and the read of the response go to
+// the kernel as a linked pair of io_uring requests on registered buffers, so
+// the bridges work in parallel while the thread only handles completions.
+// Without io_uring (backends other than DISK_BACKEND_DIRECT, other systems,
+// kernels refusing it) the same calls run each command synchronously from
+// jmraid_async_run().
+
+#define JMRAID_ASYNC_MAX_SLOTS 64
+
+struct jmraid_async;
+
+// result is JMRAID_RESULT_OK, a JMRAID_RESULT_* error or the status byte,
+// data_out (the response payload) is only valid during the call; the
+// callback may submit the next command of the enclosure
+typedef void (*jmraid_async_callback_t)(struct jmraid_async *async, struct jmraid *jmraid, int result, const uint8_t *data_out, void *context);
+
+struct jmraid_async_slot
+{
+	// NULL while the slot is free
+	struct jmraid *jmraid;
+	struct jmraid_command command;
+	uint32_t size_out;
+	jmraid_async_callback_t callback;
+	void *context;
+	uint64_t start;
+	bool is_uring;
+	// requests without completion, results of the write and the read
+	uint32_t pending;
+	int write_result;
+	int read_result;
+};
+
+struct jmraid_async
+{
+	bool is_uring;
+	// the ring, see async.c
+	int ring_fd;
+	uint8_t *ring;
+	size_t ring_size;
+	void *sqes;
+	size_t sqes_size;
+	uint32_t *sq_tail;
+	uint32_t *sq_mask;
+	uint32_t *sq_array;
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t *cq_mask;
+	void *cqes;
+	uint32_t unsubmitted;
+	// registered, two aligned sectors per slot for the command and the
+	// response
+	uint8_t *buffers;
+	uint32_t slot_count;
+	uint32_t active_count;
+	struct jmraid_async_slot slot[JMRAID_ASYNC_MAX_SLOTS];
+};
+
+bool jmraid_async_init(struct jmraid_async *async, uint32_t slot_count);
+void jmraid_async_exit(struct jmraid_async *async);
+
+// queues a command, false if the enclosure already has one in flight, all
+// slots are taken or the kernel refused it
+bool jmraid_async_submit(struct jmraid_async *async, struct jmraid *jmraid, const uint8_t *data_in, uint32_t size_in, uint32_t size_out, jmraid_async_callback_t callback, void *context);
+
+// handles completions (and whatever the callbacks submit) until no command
+// is left, returns the number of completed commands or -1 on a ring error;
+// the commands on the ring then complete with JMRAID_RESULT_IO and the
+// engine runs everything synchronously from there on
+int jmraid_async_run(struct jmraid_async *async);
+
+// jmraid_get_snapshot() as a chain of commands on the engine, the state has
+// to live until done is called with the complete snapshot and a result like
+// jmraid_get_snapshot()'s; false if not even the first command could be
+// submitted, done has been called then already
+typedef void (*jmraid_async_snapshot_callback_t)(struct jmraid *jmraid, struct jmraid_snapshot *snapshot, bool result, void *context);
+
+struct jmraid_async_snapshot
+{
+	struct jmraid_snapshot *snapshot;
+	struct jmraid_plan plan;
+	uint32_t step;
+	bool result;
+	uint8_t smart_data[SECTOR_SIZE];
+	jmraid_async_snapshot_callback_t done;
+	void *context;
+};
+
+bool jmraid_async_get_snapshot(struct jmraid_async *async, struct jmraid *jmraid, struct jmraid_async_snapshot *state, struct jmraid_snapshot *snapshot, jmraid_async_snapshot_callback_t done, void *context);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include "jmraid.h"
+
+#include <time.h>
+
+// Identity data of an enclosure (chip info, per port model / serial /
+// firmware) barely ever changes, so it is kept in a file per chip serial
+// number and only fetched again once it is older than the TTL or the port
+// reports a different disk in jmraid_sata_info.
+
+#define CACHE_DEFAULT_DIR "/var/cache/jmraid"
+#define CACHE_DEFAULT_TTL (24 * 60 * 60)
+
+struct jmraid_cache_port
+{
+	// what jmraid_sata_info said about the port when the entries were
+	// stored, any difference drops them
+	struct jmraid_sata_info_item sata_info_item;
+	time_t sata_port_info_time;
+	struct jmraid_sata_port_info sata_port_info;
+};
+
+struct jmraid_cache_data
+{
+	uint32_t chip_serial;
+	time_t chip_info_time;
+	struct jmraid_chip_info chip_info;
+	struct jmraid_cache_port port[5];
+};
+
+struct jmraid_cache
+{
+	char dir[256];
+	uint32_t ttl;
+	bool is_dirty;
+	struct jmraid_cache_data data;
+};
+
+void jmraid_cache_init(struct jmraid_cache *cache, const char *dir, uint32_t ttl);
+
+// loads the entries of the enclosure with the given chip info, a missing or
+// unreadable file just leaves the cache empty
+bool jmraid_cache_load(struct jmraid_cache *cache, const struct jmraid_chip_info *chip_info);
+bool jmraid_cache_save(struct jmraid_cache *cache);
+
+// forgets the entries of ports whose disk is not the one they were fetched
+// from anymore
+void jmraid_cache_validate(struct jmraid_cache *cache, const struct jmraid_sata_info *sata_info);
+
+// vendor id found by jmraid_detect_vendor_id() on an earlier run, stored per
+// device key (see discover_get_device_key()) so 0x197B0322 bridges do not pay
+// for the failed 0x197B0562 round trip every time; is_cached tells whether
+// it came from the file and should be detected again if commands fail
+bool jmraid_cache_detect_vendor_id(const char *dir, const char *device_key, struct jmraid *jmraid, uint32_t *vendor_id, bool *is_cached);
+bool jmraid_cache_load_vendor_id(const char *dir, const char *device_key, uint32_t *vendor_id);
+bool jmraid_cache_save_vendor_id(const char *dir, const char *device_key, uint32_t vendor_id);
+
+bool jmraid_get_sata_port_info_cached(struct jmraid *jmraid, struct jmraid_cache *cache, uint8_t index, struct jmraid_sata_port_info *info);
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef _COMMANDS_H_
+#define _COMMANDS_H_
+
+#include "view.h"
+
+// The bridge commands, one line each:
+//
+//   X(name, opcode_0, opcode_1, args_size)
+//
+// data_in is the opcode pair followed by args_size argument bytes. The table
+// expands into jmraid_encode_<name>() here and the jmraid_invoke_command_<name>()
+// wrappers in jmraid.c; a new opcode is one more line (plus a view in view.h
+// when its answer is parsed).
+
+#define JMRAID_COMMANDS(X) \
+	X(get_chip_info, 0x01, 0x01, 0) \
+	X(get_sata_info, 0x02, 0x01, 0) \
+	X(get_sata_port_info, 0x02, 0x02, 1) \
+	X(get_raid_port_info, 0x03, 0x02, 1) \
+	X(ata_passthrough, 0x02, 0x03, 20)
+
+// room for the data_in of any command in the table
+#define JMRAID_COMMAND_MAX_SIZE_IN 22
+
+#define JMRAID_COMMAND_ENCODER(name, opcode_0, opcode_1, args_size) \
+	static inline uint32_t jmraid_encode_##name(uint8_t *data_in, const uint8_t *args) \
+	{ \
+		data_in[0] = opcode_0; \
+		data_in[1] = opcode_1; \
+		if ((args_size) > 0) \
+		{ \
+			memcpy(data_in + 2, args, args_size); \
+		} \
+		return 2 + (args_size); \
+	}
+#define JMRAID_COMMAND_CHECK(name, opcode_0, opcode_1, args_size) JMRAID_STATIC_ASSERT(command_##name, 2 + (args_size) <= JMRAID_COMMAND_MAX_SIZE_IN);
+
+JMRAID_COMMANDS(JMRAID_COMMAND_ENCODER)
+JMRAID_COMMANDS(JMRAID_COMMAND_CHECK)
+
+// args of ata_passthrough: the port, 0x02 (meaning unknown), the window of the
+// ATA data to return (offset and size, at most 0xE0 in one go) and the 16 byte
+// task file
+#define JMRAID_ATA_PASSTHROUGH_ARGS_SIZE 20
+
+static inline void jmraid_ata_passthrough_args(uint8_t *args, uint8_t sata_port, uint8_t ata_read_addr, uint8_t ata_read_size, const uint8_t *ata_data)
+{
+	args[0] = sata_port;
+	args[1] = 0x02;
+	args[2] = ata_read_addr;
+	args[3] = ata_read_size;
+	memcpy(args + 4, ata_data, 16);
+}
+
+// task file of a plain ATA command (IDENTIFY DEVICE 0xEC, CHECK POWER MODE
+// 0xE5, ...), word 7 is the command, word 6 the device
+static inline void jmraid_ata_task_file(uint8_t *ata_data, uint8_t command)
+{
+	memset(ata_data, 0, 16);
+	ata_data[14] = command;
+}
+
+// CHECK POWER MODE (0xE5) goes out with a sector count that is no power
+// mode, the answer is only taken from the returned task file when the disk
+// replaced it, see jmraid_parse_power_mode()
+#define JMRAID_ATA_POWER_MODE_SENTINEL 0xA5
+
+static inline void jmraid_ata_check_power_mode_task_file(uint8_t *ata_data)
+{
+	jmraid_ata_task_file(ata_data, 0xE5);
+	ata_data[4] = JMRAID_ATA_POWER_MODE_SENTINEL;
+}
+
+// task file of a SMART command, feature is the subcommand (0xD0 READ DATA,
+// 0xD1 READ THRESHOLDS, ...)
+static inline void jmraid_ata_smart_task_file(uint8_t *ata_data, uint8_t feature)
+{
+	memset(ata_data, 0, 16);
+	ata_data[2] = feature;
+	ata_data[8] = 0x4F;
+	ata_data[10] = 0xC2;
+	ata_data[12] = 0xA0;
+	ata_data[14] = 0xB0;
+}
+
+// task file of SMART READ LOG (0xB0 / 0xD5) or, with is_ext, READ LOG EXT
+// (0x2F) for one page of a log; SMART READ LOG has no page, it always starts
+// at the first one. Word 3 is the log address, word 4 the page, the high
+// byte of a register word taken as its 48 bit (previous) half.
+static inline void jmraid_ata_read_log_task_file(uint8_t *ata_data, bool is_ext, uint8_t log_address, uint16_t page)
+{
+	memset(ata_data, 0, 16);
+	ata_data[4] = 0x01;
+	ata_data[6] = log_address;
+	if (is_ext)
+	{
+		ata_data[8] = (uint8_t)page;
+		ata_data[9] = (uint8_t)(page >> 8);
+		ata_data[14] = 0x2F;
+	}
+	else
+	{
+		ata_data[2] = 0xD5;
+		ata_data[8] = 0x4F;
+		ata_data[10] = 0xC2;
+		ata_data[12] = 0xA0;
+		ata_data[14] = 0xB0;
+	}
+}
+
+#endif
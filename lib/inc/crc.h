@@ -0,0 +1,27 @@
+#ifndef _CRC_H_
+#define _CRC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// CRC-32 (poly 0x04C11DB7, not reflected, no final xor) over 32-bit little
+// endian words, most significant byte first. Sizes must be a multiple of 4.
+
+#define CRC_SEED 0x52325032
+
+// picks the kernel crc_calc() dispatches to, has to run before threads use
+// crc_calc(); jmraid_init() calls it
+void crc_init(void);
+uint32_t crc_calc(uint32_t crc, const uint8_t *data, uint32_t size);
+
+const char *crc_get_kernel_name(void);
+
+// kernels, crc_calc() dispatches to the fastest one available
+
+uint32_t crc_calc_table(uint32_t crc, const uint8_t *data, uint32_t size);
+uint32_t crc_calc_slice8(uint32_t crc, const uint8_t *data, uint32_t size);
+
+bool crc_has_clmul(void);
+uint32_t crc_calc_clmul(uint32_t crc, const uint8_t *data, uint32_t size);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _DISCOVER_H_
+#define _DISCOVER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DISCOVER_MAX_DEVICES 256
+
+struct discover_device
+{
+	char disk_name[64];
+	char usb_serial[64];
+	uint16_t usb_vendor_id;
+	uint16_t usb_product_id;
+};
+
+bool discover_is_jmraid_usb_id(uint16_t vendor_id, uint16_t product_id);
+
+// fills devices with the block devices behind JMicron RAID bridges, sorted
+// by name, and returns their number or -1 if sysfs is not available
+int discover_jmraid_devices(struct discover_device *devices, int max_devices);
+
+// name that stays with the enclosure across reboots and re-plugging (USB
+// serial, else the /dev/disk/by-id link), false if there is none
+bool discover_get_device_key(const char *disk_name, char *key, size_t size);
+
+#endif
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <types.h>
+#include <stats.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -13,17 +14,70 @@
 
 #define SECTOR_SIZE 512
 
+// O_DIRECT transfers need a buffer aligned to the logical block size,
+// a page is enough for every device we care about
+#define DISK_BUFFER_ALIGNMENT 4096
+
+enum disk_backend
+{
+	DISK_BACKEND_STDIO,
+	DISK_BACKEND_DIRECT,
+	DISK_BACKEND_SG,
+	DISK_BACKEND_EMU,
+};
+
+#ifdef _WIN32
+#define DISK_BACKEND_DEFAULT DISK_BACKEND_STDIO
+#else
+#define DISK_BACKEND_DEFAULT DISK_BACKEND_DIRECT
+#endif
+
+// per command timeout of the SG_IO backend in milliseconds
+#define DISK_DEFAULT_TIMEOUT 5000
+
+// time spent in and data moved by disk_read_sector() / disk_write_sector()
+struct disk_stats
+{
+	struct stats_histogram read;
+	struct stats_histogram write;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint32_t read_error_count;
+	uint32_t write_error_count;
+};
+
+struct emu;
+
 struct disk
 {
 	HANDLE handle;
+	enum disk_backend backend;
+	uint32_t timeout;
+	struct emu *emu;
+	bool is_emu_owned;
+	bool is_emu_open;
+	struct disk_stats stats;
+#ifndef _WIN32
+	int fd;
+	uint8_t *buffer;
+#endif
 };
 
 void disk_init(struct disk *disk);
 
+void disk_set_backend(struct disk *disk, enum disk_backend backend);
+bool disk_parse_backend(const char *name, enum disk_backend *backend);
+const char *disk_get_backend_name(enum disk_backend backend);
+void disk_set_timeout(struct disk *disk, uint32_t timeout);
+void disk_set_emulator(struct disk *disk, struct emu *emu);
+
 bool disk_open(struct disk *disk, const char *name, const char *access);
 bool disk_close(struct disk *disk);
 
 bool disk_read_sector(struct disk *disk, uint64_t sector, uint8_t *data);
 bool disk_write_sector(struct disk *disk, uint64_t sector, const uint8_t *data);
 
+void disk_get_stats(struct disk *disk, struct disk_stats *stats);
+void disk_reset_stats(struct disk *disk);
+
 #endif
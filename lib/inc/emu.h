@@ -0,0 +1,84 @@
+#ifndef _EMU_H_
+#define _EMU_H_
+
+#include "disk.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// In-process emulation of a JMicron RAID bridge sitting in front of a disk,
+// reachable through the DISK_BACKEND_EMU backend. It follows the handshake,
+// descrambles and CRC checks command sectors and answers them from canned
+// payloads, so the whole protocol path runs without hardware.
+
+#define EMU_PORT_COUNT 5
+#define EMU_SECTOR_COUNT 64
+
+// what a command returns in front of the status byte is the response
+// sector from 0x0C up to the CRC
+#define EMU_PAYLOAD_SIZE (SECTOR_SIZE - 0x10)
+
+// status the emulator answers to commands it does not know, the real
+// bridge's value is unknown, callers only care about it being non-zero
+#define EMU_STATUS_INVALID 0x01
+
+struct emu_config
+{
+	uint32_t vendor_id;
+
+	// payloads of 0x01/0x01, 0x02/0x01, 0x02/0x02 and 0x03/0x02
+	uint8_t chip_info[EMU_PAYLOAD_SIZE];
+	uint8_t sata_info[EMU_PAYLOAD_SIZE];
+	uint8_t sata_port_info[EMU_PORT_COUNT][EMU_PAYLOAD_SIZE];
+	uint8_t raid_port_info[EMU_PORT_COUNT][EMU_PAYLOAD_SIZE];
+
+	// 0x02/0x03 ATA passthrough, ports without a disk fail every command
+	bool is_disk_present[EMU_PORT_COUNT];
+	uint8_t ata_identify[EMU_PORT_COUNT][SECTOR_SIZE];
+	uint8_t ata_smart_data[EMU_PORT_COUNT][SECTOR_SIZE];
+	uint8_t ata_smart_thresholds[EMU_PORT_COUNT][SECTOR_SIZE];
+	// what CHECK POWER MODE answers, any other command wakes a disk in
+	// standby (0x00) up to active (0xFF)
+	uint8_t power_mode[EMU_PORT_COUNT];
+	// pages of the ATA logs (SMART READ LOG and READ LOG EXT alike, the log
+	// directory comes from this), the pages themselves are generated
+	uint16_t log_page_count[256];
+
+	// added to every sector transfer, in microseconds
+	uint32_t read_latency;
+	uint32_t write_latency;
+
+	// every fail_every-th command fails with fail_result (0 = never), which
+	// is a status byte or one of the JMRAID_RESULT_* error codes to fake
+	// the matching transport problem
+	uint32_t fail_every;
+	int fail_result;
+};
+
+struct emu
+{
+	struct emu_config config;
+
+	uint8_t sectors[EMU_SECTOR_COUNT][SECTOR_SIZE];
+
+	uint32_t handshake_state;
+	uint64_t handshake_sector;
+	bool is_command_mode;
+	uint64_t command_sector;
+	bool is_read_failing;
+
+	uint32_t handshake_count;
+	uint32_t command_count;
+	uint32_t spin_up_count;
+};
+
+// sets up the FANTEC QB-X2US3R (HOTWAY, 2 disk RAID1) enclosure of the README
+void emu_init(struct emu *emu);
+
+// drops the command mode like a bridge reset or USB reconnect does
+void emu_reset(struct emu *emu);
+
+bool emu_read_sector(struct emu *emu, uint64_t sector, uint8_t *data);
+bool emu_write_sector(struct emu *emu, uint64_t sector, const uint8_t *data);
+
+#endif
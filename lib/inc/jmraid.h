@@ -2,16 +2,78 @@
 #define _JMRAID_H_
 
 #include "disk.h"
+#include "view.h"
 
-struct jmraid
+#include <time.h>
+
+// result of the last command, positive values are the status byte returned
+// by the bridge
+#define JMRAID_RESULT_OK 0
+#define JMRAID_RESULT_CRC -1
+#define JMRAID_RESULT_SEQ -2
+#define JMRAID_RESULT_COMMAND -3
+#define JMRAID_RESULT_IO -4
+#define JMRAID_RESULT_NO_RESPONSE -5
+// jmraid_invoke_batch() never sent the command, not counted in the stats
+#define JMRAID_RESULT_SKIPPED -6
+
+// ATA CHECK POWER MODE answers (sector count), 0x01 is a standby state too
+// and 0x81 to 0x83 are idle states
+#define JMRAID_POWER_MODE_STANDBY 0x00
+#define JMRAID_POWER_MODE_IDLE 0x80
+#define JMRAID_POWER_MODE_ACTIVE 0xFF
+
+#define JMRAID_STATS_MAX_COMMANDS 16
+#define JMRAID_STATS_ERROR_CODES 6
+
+// per opcode (data_in[0] / data_in[1]) accounting of jmraid_invoke_command(),
+// the bridge does its work while we wait in the write or the read, so its
+// think time shows up in write_time / read_time, codec_time is the rest of
+// the submission (descramble, CRC, checks and a re-handshake if one was
+// needed), building the command sector happens before and is not counted
+struct jmraid_command_stats
 {
-	struct disk disk;
-	uint64_t unused_sector;
-	uint32_t vendor_id;
+	uint8_t group;
+	uint8_t command;
+	struct stats_histogram latency;
+	uint64_t write_time;
+	uint64_t read_time;
+	uint64_t codec_time;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	// indexed by -JMRAID_RESULT_*, retries after a re-handshake count too
+	uint32_t error_count[JMRAID_STATS_ERROR_CODES];
+	uint32_t status_error_count;
+};
+
+// a command sector ready to be written, see jmraid_prepare_command()
+struct jmraid_command
+{
+	uint8_t sector_data[SECTOR_SIZE];
 	uint32_t seq_id;
-	uint8_t unused_sector_data[SECTOR_SIZE];
-	bool is_unused_sector_data_valid;
-	bool is_disk_open;
+	uint32_t size_in;
+	uint8_t group;
+	uint8_t command;
+};
+
+// what a command returns, the response sector from 0x0C up to the CRC
+#define JMRAID_PAYLOAD_OFFSET 0x0C
+#define JMRAID_PAYLOAD_SIZE (SECTOR_SIZE - 0x10)
+
+// a response sector owned by the caller, descrambled in place, the views of
+// view.h read its payload without copying it anywhere
+struct jmraid_response
+{
+	uint8_t sector_data[SECTOR_SIZE];
+};
+
+struct jmraid_stats
+{
+	uint32_t command_count;
+	struct jmraid_command_stats command[JMRAID_STATS_MAX_COMMANDS];
+	uint32_t status_count[256];
+	uint32_t handshake_count;
+	struct disk_stats disk;
 };
 
 struct jmraid_chip_info
@@ -95,6 +157,71 @@ struct jmraid_disk_smart_info
 	struct jmraid_disk_smart_info_attribute attribute[30];
 };
 
+// SMART values of a SATA port kept by the session, served by snapshots while
+// the disk is in standby, see jmraid_smart_memory_load()
+struct jmraid_smart_memory
+{
+	bool is_valid;
+	time_t time;
+	// the disk they came from, as jmraid_sata_info_item names it
+	char serial_number[0x14 + 1];
+	struct jmraid_disk_smart_info info;
+};
+
+struct jmraid
+{
+	struct disk disk;
+	uint64_t unused_sector;
+	uint32_t vendor_id;
+	uint32_t seq_id;
+	uint8_t unused_sector_data[SECTOR_SIZE];
+	bool is_unused_sector_data_valid;
+	bool is_disk_open;
+	bool is_session;
+	bool is_command_mode;
+	uint32_t handshake_count;
+	int last_result;
+	bool is_strict;
+	bool is_power_mode_checked;
+	bool is_smart_fresh_required;
+	struct jmraid_smart_memory smart_memory[5];
+	// RAID ports that reported a set, see jmraid_raid_port_memory_store()
+	bool is_raid_port_active[5];
+	struct jmraid_stats stats;
+};
+
+// which per port commands can tell something new, see jmraid_plan_queries()
+struct jmraid_plan
+{
+	bool is_sata_port_info_needed[5];
+	bool is_raid_port_info_needed[5];
+	bool is_disk_smart_info_needed[5];
+};
+
+// everything the bridge reports about one enclosure, the valid flags tell
+// which parts could be fetched
+struct jmraid_snapshot
+{
+	time_t time;
+	bool is_chip_info_valid;
+	bool is_sata_info_valid;
+	bool is_sata_port_info_valid[5];
+	bool is_raid_port_info_valid[5];
+	bool is_disk_smart_info_valid[5];
+	// CHECK POWER MODE of the ports SMART is read from, not valid if it
+	// was not asked (see jmraid_set_smart_fresh()) or not answered
+	bool is_power_mode_valid[5];
+	uint8_t power_mode[5];
+	// when disk_smart_info was read, before time if the disk was in
+	// standby and the values of an earlier snapshot are served
+	time_t disk_smart_info_time[5];
+	struct jmraid_chip_info chip_info;
+	struct jmraid_sata_info sata_info;
+	struct jmraid_sata_port_info sata_port_info[5];
+	struct jmraid_raid_port_info raid_port_info[5];
+	struct jmraid_disk_smart_info disk_smart_info[5];
+};
+
 void jmraid_init(struct jmraid *jmraid);
 
 bool jmraid_open(struct jmraid *jmraid, const char *disk_name, uint32_t vendor_id);
@@ -102,13 +229,57 @@ bool jmraid_close(struct jmraid *jmraid);
 
 bool jmraid_detect_vendor_id(struct jmraid *jmraid, uint32_t *vendor_id);
 
+// long-lived sessions keep the disk open and the bridge in command mode
+// across polls, the handshake is only repeated when the bridge drops out
+bool jmraid_session_open(struct jmraid *jmraid, const char *disk_name, uint32_t vendor_id);
+bool jmraid_session_check(struct jmraid *jmraid);
+bool jmraid_session_close(struct jmraid *jmraid);
+
+int jmraid_get_last_result(struct jmraid *jmraid);
+
+void jmraid_get_stats(struct jmraid *jmraid, struct jmraid_stats *stats);
+void jmraid_reset_stats(struct jmraid *jmraid);
+
 bool jmraid_get_chip_info(struct jmraid *jmraid, struct jmraid_chip_info *info);
 bool jmraid_get_sata_info(struct jmraid *jmraid, struct jmraid_sata_info *info);
 bool jmraid_get_sata_port_info(struct jmraid *jmraid, uint8_t index, struct jmraid_sata_port_info *info);
 bool jmraid_get_raid_port_info(struct jmraid *jmraid, uint8_t index, struct jmraid_raid_port_info *info);
 bool jmraid_get_disk_smart_info(struct jmraid *jmraid, uint8_t index, struct jmraid_disk_smart_info *info);
+bool jmraid_get_snapshot(struct jmraid *jmraid, struct jmraid_snapshot *snapshot);
+
+// Works out from jmraid_sata_info (NULL if it could not be fetched) which
+// SATA / RAID ports are worth a command: empty, switched off and host ports
+// answer with fixed data, which the fill function produces without asking.
+// RAID ports are asked when a disk belongs to them or the session saw a set
+// on them before (a set whose members are all gone is still reported, as
+// broken); the others are not asked and stay not valid. In strict mode
+// everything is fetched.
+void jmraid_plan_queries(struct jmraid *jmraid, const struct jmraid_sata_info *sata_info, struct jmraid_plan *plan);
+void jmraid_plan_fill_sata_port_info(struct jmraid_sata_port_info *info);
+// remembers whether the RAID port holds a set, to be called with every
+// answer of the port
+void jmraid_raid_port_memory_store(struct jmraid *jmraid, uint8_t index, const struct jmraid_raid_port_info *info);
+
+// With the power mode check on, snapshots ask for the power mode before
+// reading SMART and never wake a disk in standby: it gets the values the
+// session read last time, if they are from the same disk, and no SMART at all
+// otherwise (which does not fail the snapshot). Off by default, where the
+// bridge returns the output registers is only known from the emulator; a
+// bridge handing back the task file as sent gets its disks read as before.
+// With fresh SMART required every disk is read, spinning it up.
+void jmraid_set_power_mode_check(struct jmraid *jmraid, bool is_checked);
+void jmraid_set_smart_fresh(struct jmraid *jmraid, bool is_fresh_required);
+bool jmraid_power_mode_is_standby(uint8_t power_mode);
+// the power mode from the answer of CHECK POWER MODE, false if the disk did
+// not put one in
+bool jmraid_parse_power_mode(const uint8_t *payload, uint8_t *power_mode);
+// fill in / remember the SMART of a port of the snapshot, load is false if
+// there is nothing for the disk on the port
+bool jmraid_smart_memory_load(struct jmraid *jmraid, struct jmraid_snapshot *snapshot, uint8_t sata_port);
+void jmraid_smart_memory_store(struct jmraid *jmraid, const struct jmraid_snapshot *snapshot, uint8_t sata_port);
 
 bool jmraid_ata_identify_device(struct jmraid *jmraid, uint8_t sata_port, uint8_t *data_out);
+bool jmraid_ata_check_power_mode(struct jmraid *jmraid, uint8_t sata_port, uint8_t *power_mode);
 bool jmraid_ata_smart_read_data(struct jmraid *jmraid, uint8_t sata_port, uint8_t *data_out);
 
 // low level functions
@@ -120,6 +291,9 @@ bool jmraid_disk_write_sector(struct jmraid *jmraid, uint64_t sector, const uint
 
 void jmraid_set_unused_sector(struct jmraid *jmraid, uint64_t unused_sector);
 void jmraid_set_vendor_id(struct jmraid *jmraid, uint32_t vendor_id);
+void jmraid_set_disk_backend(struct jmraid *jmraid, enum disk_backend backend);
+void jmraid_set_disk_timeout(struct jmraid *jmraid, uint32_t timeout);
+void jmraid_set_strict(struct jmraid *jmraid, bool is_strict);
 
 bool jmraid_find_unused_sector(struct jmraid *jmraid, uint32_t num, uint64_t *sector);
 bool jmraid_backup_unused_sector_data(struct jmraid *jmraid);
@@ -128,12 +302,52 @@ bool jmraid_prepare_unused_sector(struct jmraid *jmraid);
 
 bool jmraid_send_handshake(struct jmraid *jmraid, uint32_t magic);
 
+void jmraid_scramble(const uint8_t *data_in, uint8_t *data_out, uint32_t size);
+uint32_t jmraid_calc_crc(const uint8_t *data, uint32_t size);
+uint32_t jmraid_calc_handshake_checksum(const void *data, uint32_t size);
+
+// jmraid_invoke_command() is jmraid_prepare_command() + jmraid_submit_command().
+// Preparing assigns the next sequence id and does all the CRC / scramble work
+// without touching the disk, so the next command can be built while the
+// previous one is still in flight.
+void jmraid_prepare_command(struct jmraid *jmraid, struct jmraid_command *command, const uint8_t *data_in, uint32_t size_in);
+bool jmraid_submit_command(struct jmraid *jmraid, const struct jmraid_command *command, uint8_t *data_out, uint32_t size_out);
+// for callers doing the sector transfers themselves (see async.h): checks
+// the response read back after the command sector was written (NULL if a
+// transfer failed, descrambled in place) and accounts for it like
+// jmraid_submit_command() does, returns a JMRAID_RESULT_* or status byte
+int jmraid_complete_command(struct jmraid *jmraid, const struct jmraid_command *command, uint8_t *sector_data, uint8_t *data_out, uint32_t size_out, uint64_t time);
 bool jmraid_invoke_command(struct jmraid *jmraid, const uint8_t *data_in, uint32_t size_in, uint8_t *data_out, uint32_t size_out);
-bool jmraid_invoke_command_get_chip_info(struct jmraid *jmraid, uint8_t *data_out, uint32_t size_out);
-bool jmraid_invoke_command_get_sata_info(struct jmraid *jmraid, uint8_t *data_out, uint32_t size_out);
-bool jmraid_invoke_command_get_sata_port_info(struct jmraid *jmraid, uint8_t sata_port, uint8_t *data_out, uint32_t size_out);
-bool jmraid_invoke_command_get_raid_port_info(struct jmraid *jmraid, uint8_t raid_port, uint8_t *data_out, uint32_t size_out);
-bool jmraid_invoke_command_ata_passthrough(struct jmraid *jmraid, uint8_t sata_port, uint8_t ata_read_addr, uint8_t ata_read_size, const uint8_t *ata_data, uint8_t *data_out, uint32_t size_out);
+// the same without copying the payload out, see struct jmraid_response
+bool jmraid_submit_command_response(struct jmraid *jmraid, const struct jmraid_command *command, struct jmraid_response *response);
+bool jmraid_invoke_command_response(struct jmraid *jmraid, const uint8_t *data_in, uint32_t size_in, struct jmraid_response *response);
+const uint8_t *jmraid_response_get_payload(const struct jmraid_response *response);
+// jmraid_invoke_command_<name>() for every command of commands.h
+bool jmraid_invoke_command_get_chip_info(struct jmraid *jmraid, const uint8_t *args, uint8_t *data_out, uint32_t size_out);
+bool jmraid_invoke_command_get_sata_info(struct jmraid *jmraid, const uint8_t *args, uint8_t *data_out, uint32_t size_out);
+bool jmraid_invoke_command_get_sata_port_info(struct jmraid *jmraid, const uint8_t *args, uint8_t *data_out, uint32_t size_out);
+bool jmraid_invoke_command_get_raid_port_info(struct jmraid *jmraid, const uint8_t *args, uint8_t *data_out, uint32_t size_out);
+bool jmraid_invoke_command_ata_passthrough(struct jmraid *jmraid, const uint8_t *args, uint8_t *data_out, uint32_t size_out);
+
+// one command of jmraid_invoke_batch(), data_in as built by the
+// jmraid_encode_<name>() functions of commands.h, data_out may be NULL when
+// only the result matters
+struct jmraid_batch_item
+{
+	const uint8_t *data_in;
+	uint32_t size_in;
+	uint8_t *data_out;
+	uint32_t size_out;
+	// JMRAID_RESULT_OK, a JMRAID_RESULT_* error, the status byte or
+	// JMRAID_RESULT_SKIPPED
+	int result;
+};
+
+// runs the items back to back through one command and one response buffer
+// and returns how many succeeded; with is_stop_on_transport_error the first
+// JMRAID_RESULT_* error (anything but a status byte, which only concerns its
+// own command) skips the rest
+uint32_t jmraid_invoke_batch(struct jmraid *jmraid, struct jmraid_batch_item *item, uint32_t count, bool is_stop_on_transport_error);
 
 void parse_jmraid_chip_info(const uint8_t *src, struct jmraid_chip_info *dst);
 void parse_jmraid_sata_info(const uint8_t *src, struct jmraid_sata_info *dst);
@@ -0,0 +1,33 @@
+#ifndef _JSON_H_
+#define _JSON_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Streaming JSON writer, every value goes straight to the file as it is
+// added, nothing is allocated. Keys are NULL for array elements and the top
+// level value, nesting deeper than JSON_MAX_DEPTH is not supported.
+
+#define JSON_MAX_DEPTH 16
+
+struct json_writer
+{
+	FILE *file;
+	int depth;
+	// whether the container at that depth has no value yet, so the next
+	// one goes without a comma
+	bool is_empty[JSON_MAX_DEPTH];
+};
+
+void json_init(struct json_writer *writer, FILE *file);
+
+void json_begin_object(struct json_writer *writer, const char *key);
+void json_end_object(struct json_writer *writer);
+void json_begin_array(struct json_writer *writer, const char *key);
+void json_end_array(struct json_writer *writer);
+
+void json_add_string(struct json_writer *writer, const char *key, const char *value);
+void json_add_int(struct json_writer *writer, const char *key, int64_t value);
+
+#endif
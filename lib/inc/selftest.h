@@ -0,0 +1,69 @@
+#ifndef _SELFTEST_H_
+#define _SELFTEST_H_
+
+#include "jmraid.h"
+
+#include <time.h>
+
+// SMART self-tests through the passthrough, started with SMART EXECUTE
+// OFF-LINE IMMEDIATE and followed through the self-test execution status
+// byte of the SMART data (offset 363). A test keeps the disk busy, so the
+// scheduler starts them a few at a time: at most max_per_raid members of a
+// RAID set test at once, with the default of 1 a mirror always has one member
+// at full speed. Disks outside a RAID set count as a set of their own.
+
+// subcommands of SMART EXECUTE OFF-LINE IMMEDIATE
+#define JMRAID_SELF_TEST_SHORT 0x01
+#define JMRAID_SELF_TEST_EXTENDED 0x02
+#define JMRAID_SELF_TEST_ABORT 0x7F
+
+// upper nibble of the status byte, the lower one is the remaining part of
+// a running test in tenths; 0x0 is passed (or never run), 0x1 and 0x2 are
+// aborted / interrupted, 0x3 to 0x8 failed
+#define JMRAID_SELF_TEST_STATUS_IN_PROGRESS 0x0F
+
+#define JMRAID_SELF_TEST_DEFAULT_MAX_PER_RAID 1
+
+enum jmraid_self_test_state
+{
+	JMRAID_SELF_TEST_STATE_IDLE,
+	JMRAID_SELF_TEST_STATE_PENDING,
+	JMRAID_SELF_TEST_STATE_RUNNING,
+	JMRAID_SELF_TEST_STATE_DONE,
+	// the test could not be started
+	JMRAID_SELF_TEST_STATE_FAILED
+};
+
+struct jmraid_self_test_port
+{
+	enum jmraid_self_test_state state;
+	// RAID index, 5 + port for a disk on its own
+	uint8_t group;
+	// last status byte read, valid from RUNNING on
+	uint8_t status;
+	time_t start_time;
+	time_t end_time;
+};
+
+struct jmraid_self_test_scheduler
+{
+	uint8_t subcommand;
+	uint32_t max_per_raid;
+	struct jmraid_self_test_port port[5];
+};
+
+bool jmraid_ata_smart_execute_off_line(struct jmraid *jmraid, uint8_t sata_port, uint8_t subcommand);
+// reads just the word of the SMART data holding the status byte
+bool jmraid_ata_self_test_status(struct jmraid *jmraid, uint8_t sata_port, uint8_t *status);
+
+void jmraid_self_test_init(struct jmraid_self_test_scheduler *scheduler, uint8_t subcommand, uint32_t max_per_raid);
+// queues a test for every RAID member and spare disk of sata_info, ports
+// with a test still running keep it
+void jmraid_self_test_plan(struct jmraid_self_test_scheduler *scheduler, const struct jmraid_sata_info *sata_info);
+// follows the running tests and starts queued ones as far as their RAID set
+// allows, to be called periodically; false once nothing is queued or
+// running anymore
+bool jmraid_self_test_poll(struct jmraid *jmraid, struct jmraid_self_test_scheduler *scheduler);
+bool jmraid_self_test_is_busy(const struct jmraid_self_test_scheduler *scheduler);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef _SMART_LOG_H_
+#define _SMART_LOG_H_
+
+#include "jmraid.h"
+
+// ATA logs through the passthrough: SMART READ LOG for the SMART logs and
+// READ LOG EXT for the general purpose (GP) ones. A page is a sector; the
+// bridge returns at most 0xE0 words of the data per command, so every page
+// takes two commands (0xE0 words, then the last 0x20), and the pages of one
+// jmraid_ata_read_log() call go out back to back through
+// jmraid_invoke_batch().
+//
+// SMART READ LOG has no page number and the returned window can not reach
+// past the first sector of the transfer, so only the first page of a SMART
+// log can be read. The multi page logs have GP copies that take the page in
+// the task file (0x03, 0x04, 0x07), read those with is_ext.
+
+#define JMRAID_LOG_DIRECTORY 0x00
+#define JMRAID_LOG_SUMMARY_ERROR 0x01
+#define JMRAID_LOG_COMPREHENSIVE_ERROR 0x02
+#define JMRAID_LOG_EXT_COMPREHENSIVE_ERROR 0x03
+#define JMRAID_LOG_DEVICE_STATISTICS 0x04
+#define JMRAID_LOG_SELF_TEST 0x06
+#define JMRAID_LOG_EXT_SELF_TEST 0x07
+
+// pages per jmraid_invoke_batch(), two commands each
+#define JMRAID_LOG_BATCH_PAGES 8
+
+// where a read of a log stands, jmraid_ata_read_log() continues from page
+// and moves it past what it read, a failed page stays the next one
+struct jmraid_log_cursor
+{
+	uint8_t sata_port;
+	uint8_t log_address;
+	bool is_ext;
+	uint16_t page;
+	uint16_t page_count;
+};
+
+// the log directory (log 0x00), page_count[i] is the number of pages of log
+// i, 0 if the disk does not have it
+bool jmraid_ata_read_log_directory(struct jmraid *jmraid, uint8_t sata_port, bool is_ext, uint16_t *page_count);
+
+void jmraid_log_cursor_init(struct jmraid_log_cursor *cursor, uint8_t sata_port, uint8_t log_address, bool is_ext, uint16_t page_count);
+// jmraid_log_cursor_init() with the page count from the log directory, false
+// if the directory can not be read or the disk does not have the log
+bool jmraid_log_cursor_open(struct jmraid *jmraid, struct jmraid_log_cursor *cursor, uint8_t sata_port, uint8_t log_address, bool is_ext);
+bool jmraid_log_cursor_is_done(const struct jmraid_log_cursor *cursor);
+
+// reads up to page_max pages from the cursor on into data_out (SECTOR_SIZE
+// per page), returns the number of pages read; less than asked for before the
+// end of the log means a command failed, calling again retries from there
+uint32_t jmraid_ata_read_log(struct jmraid *jmraid, struct jmraid_log_cursor *cursor, uint8_t *data_out, uint32_t page_max);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// bucket i counts latencies below 2^i microseconds, the last one everything
+// above, so 24 buckets reach from 1 us to ~8 s
+#define STATS_HISTOGRAM_BUCKETS 24
+
+struct stats_histogram
+{
+	uint64_t count;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	uint32_t bucket[STATS_HISTOGRAM_BUCKETS];
+};
+
+// monotonic clock in nanoseconds
+uint64_t stats_get_time(void);
+
+void stats_histogram_add(struct stats_histogram *histogram, uint64_t time);
+
+// upper bound (ns) of the bucket holding the given percentile, capped at the
+// maximum, 0 if empty
+uint64_t stats_histogram_percentile(const struct stats_histogram *histogram, uint32_t percent);
+
+#endif
@@ -5,7 +5,7 @@
 #define HANDLE FILE*
 #define DWORD size_t
 #define INVALID_HANDLE_VALUE NULL
-#define CloseHandle fclose
+#define CloseHandle(h) (fclose(h) == 0)
 #endif
 
 #endif
@@ -0,0 +1,320 @@
+#ifndef _VIEW_H_
+#define _VIEW_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Read-only views into a response payload (the bridge's answer from sector
+// offset 0x0C on, 0x1F0 bytes, see jmraid_response_get_payload()). Nothing is
+// copied or converted until a field is asked for, a view stays valid as long
+// as the buffer it points into. Disk strings are stored ATA style with the
+// bytes of every 16 bit word swapped, the string getters put them in order and
+// need room for size + 1 chars.
+//
+// The layouts are the JMRAID_*_FIELDS tables below, one line per field:
+//
+//   X(view, arg, field, kind, offset, size)
+//
+// with offset relative to the start of the view and size only used by the
+// string and byte kinds. Expanded with JMRAID_VIEW_ACCESSOR they declare the
+// getters (<view>_<field>), with JMRAID_VIEW_CHECK (arg is the size of the
+// record) they refuse to compile if a field reaches past its record.
+// jmraid.c fills its structs with JMRAID_VIEW_PARSE (arg points to the struct)
+// and checks they have room with JMRAID_VIEW_CHECK_DST (arg is the type).
+
+// C99 has no _Static_assert
+#define JMRAID_STATIC_ASSERT(name, condition) typedef char jmraid_static_assert_##name[(condition) ? 1 : -1]
+
+static inline uint16_t jmraid_view_u16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t jmraid_view_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t jmraid_view_u48(const uint8_t *p)
+{
+	return jmraid_view_u32(p) | ((uint64_t)jmraid_view_u16(p + 4) << 32);
+}
+
+// sizes are counted in 32 MiB units
+static inline uint64_t jmraid_view_capacity(const uint8_t *p)
+{
+	return ((uint64_t)jmraid_view_u32(p)) * (32 * 1024 * 1024);
+}
+
+static inline void jmraid_view_get_string(const uint8_t *p, uint32_t size, bool is_swapped, char *dst)
+{
+	uint32_t i;
+
+	if (is_swapped)
+	{
+		for (i = 0; i + 1 < size; i += 2)
+		{
+			dst[i] = (char)p[i + 1];
+			dst[i + 1] = (char)p[i];
+		}
+		if (size & 1)
+		{
+			dst[size - 1] = (char)p[size - 1];
+		}
+	}
+	else
+	{
+		memcpy(dst, p, size);
+	}
+	dst[size] = 0;
+}
+
+// field kinds: bytes read from the payload, bytes needed in a parsed struct,
+// the getter and how the parser stores it
+
+#define JMRAID_VIEW_WIDTH_U8(size) 1
+#define JMRAID_VIEW_WIDTH_U16(size) 2
+#define JMRAID_VIEW_WIDTH_U32(size) 4
+#define JMRAID_VIEW_WIDTH_U48(size) 6
+#define JMRAID_VIEW_WIDTH_CAPACITY(size) 4
+#define JMRAID_VIEW_WIDTH_TENS_U16(size) 2
+#define JMRAID_VIEW_WIDTH_STRING(size) (size)
+#define JMRAID_VIEW_WIDTH_STRING_SWAPPED(size) (size)
+#define JMRAID_VIEW_WIDTH_BYTES(size) (size)
+
+#define JMRAID_VIEW_DST_SIZE_U8(size) 1
+#define JMRAID_VIEW_DST_SIZE_U16(size) 2
+#define JMRAID_VIEW_DST_SIZE_U32(size) 4
+#define JMRAID_VIEW_DST_SIZE_U48(size) 8
+#define JMRAID_VIEW_DST_SIZE_CAPACITY(size) 8
+#define JMRAID_VIEW_DST_SIZE_TENS_U16(size) 2
+#define JMRAID_VIEW_DST_SIZE_STRING(size) ((size) + 1)
+#define JMRAID_VIEW_DST_SIZE_STRING_SWAPPED(size) ((size) + 1)
+#define JMRAID_VIEW_DST_SIZE_BYTES(size) (size)
+
+#define JMRAID_VIEW_ACCESSOR_U8(V, field, offset, size) static inline uint8_t V##_##field(struct V view) { return view.p[offset]; }
+#define JMRAID_VIEW_ACCESSOR_U16(V, field, offset, size) static inline uint16_t V##_##field(struct V view) { return jmraid_view_u16(view.p + (offset)); }
+#define JMRAID_VIEW_ACCESSOR_U32(V, field, offset, size) static inline uint32_t V##_##field(struct V view) { return jmraid_view_u32(view.p + (offset)); }
+#define JMRAID_VIEW_ACCESSOR_U48(V, field, offset, size) static inline uint64_t V##_##field(struct V view) { return jmraid_view_u48(view.p + (offset)); }
+#define JMRAID_VIEW_ACCESSOR_CAPACITY(V, field, offset, size) static inline uint64_t V##_##field(struct V view) { return jmraid_view_capacity(view.p + (offset)); }
+// the bridge counts in tens of seconds
+#define JMRAID_VIEW_ACCESSOR_TENS_U16(V, field, offset, size) static inline uint16_t V##_##field(struct V view) { return (uint16_t)(jmraid_view_u16(view.p + (offset)) * 10); }
+#define JMRAID_VIEW_ACCESSOR_STRING(V, field, offset, size) static inline void V##_##field(struct V view, char *dst) { jmraid_view_get_string(view.p + (offset), size, false, dst); }
+#define JMRAID_VIEW_ACCESSOR_STRING_SWAPPED(V, field, offset, size) static inline void V##_##field(struct V view, char *dst) { jmraid_view_get_string(view.p + (offset), size, true, dst); }
+#define JMRAID_VIEW_ACCESSOR_BYTES(V, field, offset, size) static inline void V##_##field(struct V view, uint8_t *dst) { memcpy(dst, view.p + (offset), size); }
+
+// expect a struct V named view, dst points to the parsed struct
+#define JMRAID_VIEW_PARSE_U8(V, field, dst) (dst)->field = V##_##field(view);
+#define JMRAID_VIEW_PARSE_U16(V, field, dst) (dst)->field = V##_##field(view);
+#define JMRAID_VIEW_PARSE_U32(V, field, dst) (dst)->field = V##_##field(view);
+#define JMRAID_VIEW_PARSE_U48(V, field, dst) (dst)->field = V##_##field(view);
+#define JMRAID_VIEW_PARSE_CAPACITY(V, field, dst) (dst)->field = V##_##field(view);
+#define JMRAID_VIEW_PARSE_TENS_U16(V, field, dst) (dst)->field = V##_##field(view);
+#define JMRAID_VIEW_PARSE_STRING(V, field, dst) V##_##field(view, (dst)->field);
+#define JMRAID_VIEW_PARSE_STRING_SWAPPED(V, field, dst) V##_##field(view, (dst)->field);
+#define JMRAID_VIEW_PARSE_BYTES(V, field, dst) V##_##field(view, (dst)->field);
+
+#define JMRAID_VIEW_ACCESSOR(V, arg, field, kind, offset, size) JMRAID_VIEW_ACCESSOR_##kind(V, field, offset, size)
+#define JMRAID_VIEW_CHECK(V, record_size, field, kind, offset, size) JMRAID_STATIC_ASSERT(V##_##field, (offset) + JMRAID_VIEW_WIDTH_##kind(size) <= (record_size));
+#define JMRAID_VIEW_CHECK_DST(V, type, field, kind, offset, size) JMRAID_STATIC_ASSERT(dst_##V##_##field, sizeof(((type *)0)->field) >= JMRAID_VIEW_DST_SIZE_##kind(size));
+#define JMRAID_VIEW_PARSE(V, dst, field, kind, offset, size) JMRAID_VIEW_PARSE_##kind(V, field, dst)
+
+// 0x01/0x01 chip info, firmware_version[0] is the least significant part
+
+#define JMRAID_CHIP_INFO_SIZE 0x1F0
+#define JMRAID_CHIP_INFO_FIELDS(X, V, arg) \
+	X(V, arg, firmware_version, BYTES, 0x00, 0x04) \
+	X(V, arg, product_name, STRING, 0x14, 0x20) \
+	X(V, arg, manufacturer, STRING, 0x34, 0x20) \
+	X(V, arg, serial_number, U32, 0xA0, 0)
+
+struct jmraid_chip_info_view
+{
+	const uint8_t *p;
+};
+
+static inline struct jmraid_chip_info_view jmraid_chip_info_view(const uint8_t *payload)
+{
+	struct jmraid_chip_info_view view;
+	view.p = payload;
+	return view;
+}
+
+JMRAID_CHIP_INFO_FIELDS(JMRAID_VIEW_ACCESSOR, jmraid_chip_info_view, 0)
+JMRAID_CHIP_INFO_FIELDS(JMRAID_VIEW_CHECK, jmraid_chip_info_view, JMRAID_CHIP_INFO_SIZE)
+
+// 0x02/0x01 SATA info, one item per port
+
+#define JMRAID_SATA_INFO_ITEM_SIZE 0x50
+#define JMRAID_SATA_INFO_ITEM_FIELDS(X, V, arg) \
+	X(V, arg, model_name, STRING_SWAPPED, 0x00, 0x28) \
+	X(V, arg, serial_number, STRING_SWAPPED, 0x28, 0x14) \
+	X(V, arg, capacity, CAPACITY, 0x3C, 0) \
+	X(V, arg, page_0_state, U8, 0x41, 0) \
+	X(V, arg, page_0_raid_index, U8, 0x42, 0) \
+	X(V, arg, page_0_raid_member_index, U8, 0x43, 0) \
+	X(V, arg, port_type, U8, 0x48, 0) \
+	X(V, arg, port, U8, 0x49, 0) \
+	X(V, arg, port_speed, U8, 0x4A, 0)
+
+struct jmraid_sata_info_item_view
+{
+	const uint8_t *p;
+};
+
+static inline struct jmraid_sata_info_item_view jmraid_sata_info_view_item(const uint8_t *payload, int index)
+{
+	struct jmraid_sata_info_item_view view;
+	view.p = payload + 0x04 + index * JMRAID_SATA_INFO_ITEM_SIZE;
+	return view;
+}
+
+JMRAID_SATA_INFO_ITEM_FIELDS(JMRAID_VIEW_ACCESSOR, jmraid_sata_info_item_view, 0)
+JMRAID_SATA_INFO_ITEM_FIELDS(JMRAID_VIEW_CHECK, jmraid_sata_info_item_view, JMRAID_SATA_INFO_ITEM_SIZE)
+JMRAID_STATIC_ASSERT(jmraid_sata_info_items, 0x04 + 5 * JMRAID_SATA_INFO_ITEM_SIZE <= 0x1F0);
+
+// 0x02/0x02 SATA port info, from 0x04 on
+
+#define JMRAID_SATA_PORT_INFO_SIZE (0x1F0 - 0x04)
+#define JMRAID_SATA_PORT_INFO_FIELDS(X, V, arg) \
+	X(V, arg, model_name, STRING_SWAPPED, 0x00, 0x28) \
+	X(V, arg, serial_number, STRING_SWAPPED, 0x28, 0x14) \
+	X(V, arg, capacity, CAPACITY, 0x3C, 0) \
+	X(V, arg, firmware_version, STRING_SWAPPED, 0x40, 0x08) \
+	X(V, arg, port, U8, 0x5A, 0) \
+	X(V, arg, port_type, U8, 0x60, 0) \
+	X(V, arg, page_0_state, U8, 0xBD, 0) \
+	X(V, arg, page_0_raid_index, U8, 0xBE, 0) \
+	X(V, arg, page_0_raid_member_index, U8, 0xBF, 0) \
+	X(V, arg, capacity_used, CAPACITY, 0xCC, 0)
+
+struct jmraid_sata_port_info_view
+{
+	const uint8_t *p;
+};
+
+static inline struct jmraid_sata_port_info_view jmraid_sata_port_info_view(const uint8_t *payload)
+{
+	struct jmraid_sata_port_info_view view;
+	view.p = payload + 0x04;
+	return view;
+}
+
+JMRAID_SATA_PORT_INFO_FIELDS(JMRAID_VIEW_ACCESSOR, jmraid_sata_port_info_view, 0)
+JMRAID_SATA_PORT_INFO_FIELDS(JMRAID_VIEW_CHECK, jmraid_sata_port_info_view, JMRAID_SATA_PORT_INFO_SIZE)
+
+// 0x03/0x02 RAID port info, from 0x04 on, the members follow at 0xA0
+
+#define JMRAID_RAID_PORT_INFO_SIZE (0x1F0 - 0x04)
+#define JMRAID_RAID_PORT_INFO_FIELDS(X, V, arg) \
+	X(V, arg, model_name, STRING_SWAPPED, 0x00, 0x28) \
+	X(V, arg, serial_number, STRING_SWAPPED, 0x28, 0x14) \
+	X(V, arg, capacity, CAPACITY, 0x3C, 0) \
+	X(V, arg, port_state, U8, 0x40, 0) \
+	X(V, arg, state, U8, 0x42, 0) \
+	X(V, arg, level, U8, 0x50, 0) \
+	X(V, arg, member_count, U8, 0x51, 0) \
+	X(V, arg, rebuild_progress, CAPACITY, 0x5C, 0) \
+	X(V, arg, rebuild_priority, U16, 0x60, 0) \
+	X(V, arg, standby_timer, TENS_U16, 0x62, 0) \
+	X(V, arg, password, STRING, 0x78, 0x08)
+
+#define JMRAID_RAID_PORT_INFO_MEMBER_OFFSET 0xA0
+#define JMRAID_RAID_PORT_INFO_MEMBER_SIZE 0x20
+#define JMRAID_RAID_PORT_INFO_MEMBER_FIELDS(X, V, arg) \
+	X(V, arg, ready, U8, 0x00, 0) \
+	X(V, arg, lba48_support, U8, 0x04, 0) \
+	X(V, arg, sata_page, U8, 0x06, 0) \
+	X(V, arg, sata_port, U8, 0x07, 0) \
+	X(V, arg, sata_base, U32, 0x08, 0) \
+	X(V, arg, sata_size, CAPACITY, 0x0C, 0)
+
+struct jmraid_raid_port_info_view
+{
+	const uint8_t *p;
+};
+
+struct jmraid_raid_port_info_member_view
+{
+	const uint8_t *p;
+};
+
+static inline struct jmraid_raid_port_info_view jmraid_raid_port_info_view(const uint8_t *payload)
+{
+	struct jmraid_raid_port_info_view view;
+	view.p = payload + 0x04;
+	return view;
+}
+
+static inline struct jmraid_raid_port_info_member_view jmraid_raid_port_info_view_member(struct jmraid_raid_port_info_view view, int index)
+{
+	struct jmraid_raid_port_info_member_view member;
+	member.p = view.p + JMRAID_RAID_PORT_INFO_MEMBER_OFFSET + index * JMRAID_RAID_PORT_INFO_MEMBER_SIZE;
+	return member;
+}
+
+JMRAID_RAID_PORT_INFO_FIELDS(JMRAID_VIEW_ACCESSOR, jmraid_raid_port_info_view, 0)
+JMRAID_RAID_PORT_INFO_FIELDS(JMRAID_VIEW_CHECK, jmraid_raid_port_info_view, JMRAID_RAID_PORT_INFO_MEMBER_OFFSET)
+JMRAID_RAID_PORT_INFO_MEMBER_FIELDS(JMRAID_VIEW_ACCESSOR, jmraid_raid_port_info_member_view, 0)
+JMRAID_RAID_PORT_INFO_MEMBER_FIELDS(JMRAID_VIEW_CHECK, jmraid_raid_port_info_member_view, JMRAID_RAID_PORT_INFO_MEMBER_SIZE)
+JMRAID_STATIC_ASSERT(jmraid_raid_port_info_members, JMRAID_RAID_PORT_INFO_MEMBER_OFFSET + 5 * JMRAID_RAID_PORT_INFO_MEMBER_SIZE <= JMRAID_RAID_PORT_INFO_SIZE);
+
+// 0x02/0x03 ATA passthrough, the task file comes back at 0x04 (same layout
+// as the one sent, see jmraid_ata_passthrough_args()) and the ATA data
+// follows at 0x14; that the output registers of the command replace the sent
+// ones there is only known from the emulator
+
+#define JMRAID_ATA_REGISTERS_SIZE 0x10
+#define JMRAID_ATA_REGISTERS_FIELDS(X, V, arg) \
+	X(V, arg, sector_count, U8, 0x04, 0)
+
+struct jmraid_ata_registers_view
+{
+	const uint8_t *p;
+};
+
+static inline struct jmraid_ata_registers_view jmraid_ata_registers_view(const uint8_t *payload)
+{
+	struct jmraid_ata_registers_view view;
+	view.p = payload + 0x04;
+	return view;
+}
+
+JMRAID_ATA_REGISTERS_FIELDS(JMRAID_VIEW_ACCESSOR, jmraid_ata_registers_view, 0)
+JMRAID_ATA_REGISTERS_FIELDS(JMRAID_VIEW_CHECK, jmraid_ata_registers_view, JMRAID_ATA_REGISTERS_SIZE)
+
+// ATA SMART READ DATA / READ THRESHOLDS through 0x02/0x03, the ATA data
+// starts at 0x14 and has 30 entries of 12 bytes after the 2 byte revision;
+// an id of 0 marks an unused entry, threshold is only found in a view into
+// the thresholds
+
+#define JMRAID_SMART_ATTRIBUTE_SIZE 0x0C
+#define JMRAID_SMART_ATTRIBUTE_FIELDS(X, V, arg) \
+	X(V, arg, id, U8, 0x00, 0) \
+	X(V, arg, flags, U16, 0x01, 0) \
+	X(V, arg, current_value, U8, 0x03, 0) \
+	X(V, arg, worst_value, U8, 0x04, 0) \
+	X(V, arg, raw_value, U48, 0x05, 0)
+#define JMRAID_SMART_THRESHOLD_FIELDS(X, V, arg) \
+	X(V, arg, threshold, U8, 0x01, 0)
+
+struct jmraid_smart_attribute_view
+{
+	const uint8_t *p;
+};
+
+static inline struct jmraid_smart_attribute_view jmraid_smart_view_attribute(const uint8_t *payload, int index)
+{
+	struct jmraid_smart_attribute_view view;
+	view.p = payload + 0x14 + 0x02 + index * JMRAID_SMART_ATTRIBUTE_SIZE;
+	return view;
+}
+
+JMRAID_SMART_ATTRIBUTE_FIELDS(JMRAID_VIEW_ACCESSOR, jmraid_smart_attribute_view, 0)
+JMRAID_SMART_ATTRIBUTE_FIELDS(JMRAID_VIEW_CHECK, jmraid_smart_attribute_view, JMRAID_SMART_ATTRIBUTE_SIZE)
+JMRAID_SMART_THRESHOLD_FIELDS(JMRAID_VIEW_ACCESSOR, jmraid_smart_attribute_view, 0)
+JMRAID_SMART_THRESHOLD_FIELDS(JMRAID_VIEW_CHECK, jmraid_smart_attribute_view, JMRAID_SMART_ATTRIBUTE_SIZE)
+JMRAID_STATIC_ASSERT(jmraid_smart_attributes, 0x14 + 0x02 + 30 * JMRAID_SMART_ATTRIBUTE_SIZE <= 0x1F0);
+
+#endif
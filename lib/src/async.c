@@ -0,0 +1,650 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
+#include "async.h"
+#include "commands.h"
+
+#include <stdlib.h>
+
+#if defined(__linux__) && defined(HAVE_LINUX_IO_URING_H)
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+// no liburing, the three system calls are all it takes
+#ifdef __NR_io_uring_setup
+#define ASYNC_IO_URING
+#endif
+#endif
+
+#ifdef DEBUG_PRINT
+#include <stdio.h>
+extern void debug_print(const char* format, ...);
+#else
+#define debug_print(...)
+#endif
+
+// steps of jmraid_async_get_snapshot(), the per port ones are 5 in a row,
+// SMART takes three per port: power mode, data and thresholds
+#define SNAPSHOT_STEP_CHIP_INFO 0
+#define SNAPSHOT_STEP_SATA_INFO 1
+#define SNAPSHOT_STEP_SATA_PORT_INFO 2
+#define SNAPSHOT_STEP_RAID_PORT_INFO 7
+#define SNAPSHOT_STEP_DISK_SMART_INFO 12
+#define SNAPSHOT_STEP_DONE 27
+
+#define SNAPSHOT_SMART_POWER_MODE 0
+#define SNAPSHOT_SMART_DATA 1
+#define SNAPSHOT_SMART_THRESHOLDS 2
+
+#ifdef ASYNC_IO_URING
+
+static int io_uring_setup(uint32_t entries, struct io_uring_params *params)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, uint32_t opcode, const void *arg, uint32_t nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void jmraid_async_uring_exit(struct jmraid_async *async)
+{
+	if (async->sqes)
+	{
+		munmap(async->sqes, async->sqes_size);
+		async->sqes = NULL;
+	}
+	if (async->ring)
+	{
+		munmap(async->ring, async->ring_size);
+		async->ring = NULL;
+	}
+	if (async->ring_fd != -1)
+	{
+		close(async->ring_fd);
+		async->ring_fd = -1;
+	}
+	free(async->buffers);
+	async->buffers = NULL;
+	async->is_uring = false;
+}
+
+static bool jmraid_async_uring_init(struct jmraid_async *async)
+{
+	struct io_uring_params params;
+	struct iovec iov;
+	size_t sq_size;
+	size_t cq_size;
+	void *ring;
+	void *sqes;
+	void *buffers;
+
+	memset(&params, 0, sizeof(params));
+	// a write and a read per slot
+	async->ring_fd = io_uring_setup(async->slot_count * 2, &params);
+	if (async->ring_fd < 0)
+	{
+		debug_print("io_uring_setup error %d\n", errno);
+		async->ring_fd = -1;
+		return false;
+	}
+
+	// 5.4 and later, older kernels do not link requests reliably anyway
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+	{
+		debug_print("io_uring too old\n");
+		jmraid_async_uring_exit(async);
+		return false;
+	}
+
+	sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	async->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+	ring = mmap(NULL, async->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, async->ring_fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED)
+	{
+		debug_print("mmap ring error %d\n", errno);
+		jmraid_async_uring_exit(async);
+		return false;
+	}
+	async->ring = (uint8_t *)ring;
+
+	async->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	sqes = mmap(NULL, async->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, async->ring_fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+	{
+		debug_print("mmap sqes error %d\n", errno);
+		jmraid_async_uring_exit(async);
+		return false;
+	}
+	async->sqes = sqes;
+
+	async->sq_tail = (uint32_t *)(async->ring + params.sq_off.tail);
+	async->sq_mask = (uint32_t *)(async->ring + params.sq_off.ring_mask);
+	async->sq_array = (uint32_t *)(async->ring + params.sq_off.array);
+	async->cq_head = (uint32_t *)(async->ring + params.cq_off.head);
+	async->cq_tail = (uint32_t *)(async->ring + params.cq_off.tail);
+	async->cq_mask = (uint32_t *)(async->ring + params.cq_off.ring_mask);
+	async->cqes = async->ring + params.cq_off.cqes;
+
+	if (posix_memalign(&buffers, DISK_BUFFER_ALIGNMENT, async->slot_count * 2 * DISK_BUFFER_ALIGNMENT) != 0)
+	{
+		debug_print("posix_memalign failed\n");
+		jmraid_async_uring_exit(async);
+		return false;
+	}
+	async->buffers = (uint8_t *)buffers;
+
+	// pinned once, the kernel does not have to map the pages per request
+	iov.iov_base = buffers;
+	iov.iov_len = async->slot_count * 2 * DISK_BUFFER_ALIGNMENT;
+	if (io_uring_register(async->ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+	{
+		debug_print("IORING_REGISTER_BUFFERS error %d\n", errno);
+		jmraid_async_uring_exit(async);
+		return false;
+	}
+
+	async->is_uring = true;
+
+	return true;
+}
+
+static uint8_t *jmraid_async_get_buffer(struct jmraid_async *async, uint32_t index, bool is_response)
+{
+	return async->buffers + ((index * 2) + (is_response ? 1 : 0)) * DISK_BUFFER_ALIGNMENT;
+}
+
+static void jmraid_async_uring_queue(struct jmraid_async *async, uint8_t opcode, uint8_t flags, int fd, uint8_t *buffer, uint64_t offset, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t tail = *async->sq_tail;
+	uint32_t index = tail & *async->sq_mask;
+
+	sqe = &((struct io_uring_sqe *)async->sqes)[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = opcode;
+	sqe->flags = flags;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)buffer;
+	sqe->len = SECTOR_SIZE;
+	sqe->off = offset;
+	sqe->buf_index = 0;
+	sqe->user_data = user_data;
+	async->sq_array[index] = index;
+
+	// the kernel must see the entry before the new tail
+	__atomic_store_n(async->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	async->unsubmitted++;
+}
+
+#endif
+
+static bool jmraid_async_can_use_uring(struct jmraid_async *async, struct jmraid *jmraid)
+{
+#ifdef ASYNC_IO_URING
+	// SG_IO does not go through read / write, emulated and stdio disks are
+	// no file descriptor to begin with
+	return async->is_uring && (jmraid->disk.backend == DISK_BACKEND_DIRECT) && (jmraid->disk.fd != -1);
+#else
+	(void)async;
+	(void)jmraid;
+	return false;
+#endif
+}
+
+bool jmraid_async_init(struct jmraid_async *async, uint32_t slot_count)
+{
+	debug_print("jmraid_async_init | %u\n", slot_count);
+
+	memset(async, 0, sizeof(struct jmraid_async));
+	async->ring_fd = -1;
+	async->slot_count = (slot_count == 0) ? 1 : (slot_count > JMRAID_ASYNC_MAX_SLOTS) ? JMRAID_ASYNC_MAX_SLOTS : slot_count;
+
+#ifdef ASYNC_IO_URING
+	if (!jmraid_async_uring_init(async))
+	{
+		debug_print("no io_uring, commands run synchronously\n");
+	}
+#endif
+
+	return true;
+}
+
+void jmraid_async_exit(struct jmraid_async *async)
+{
+	debug_print("jmraid_async_exit\n");
+
+#ifdef ASYNC_IO_URING
+	jmraid_async_uring_exit(async);
+#endif
+	async->active_count = 0;
+}
+
+bool jmraid_async_submit(struct jmraid_async *async, struct jmraid *jmraid, const uint8_t *data_in, uint32_t size_in, uint32_t size_out, jmraid_async_callback_t callback, void *context)
+{
+	struct jmraid_async_slot *slot = NULL;
+	uint32_t i;
+
+	debug_print("jmraid_async_submit | %02X %02X\n", data_in[0], data_in[1]);
+
+	for (i = 0; i < async->slot_count; i++)
+	{
+		if (async->slot[i].jmraid == jmraid)
+		{
+			// the bridge has one command sector, a second command would
+			// overwrite the first one
+			debug_print("command already in flight\n");
+			return false;
+		}
+		if (!slot && !async->slot[i].jmraid)
+		{
+			slot = &async->slot[i];
+		}
+	}
+	if (!slot)
+	{
+		debug_print("no free slot\n");
+		return false;
+	}
+
+	jmraid_prepare_command(jmraid, &slot->command, data_in, size_in);
+	slot->jmraid = jmraid;
+	slot->size_out = size_out;
+	slot->callback = callback;
+	slot->context = context;
+	slot->start = stats_get_time();
+	slot->is_uring = jmraid_async_can_use_uring(async, jmraid);
+	slot->pending = 0;
+	async->active_count++;
+
+#ifdef ASYNC_IO_URING
+	if (slot->is_uring)
+	{
+		uint32_t index = (uint32_t)(slot - async->slot);
+		uint8_t *buffer = jmraid_async_get_buffer(async, index, false);
+		uint64_t offset = jmraid->unused_sector * SECTOR_SIZE;
+
+		memcpy(buffer, slot->command.sector_data, SECTOR_SIZE);
+		// the read only starts once the write completed, a failed write
+		// cancels it
+		jmraid_async_uring_queue(async, IORING_OP_WRITE_FIXED, IOSQE_IO_LINK, jmraid->disk.fd, buffer, offset, index * 2);
+		jmraid_async_uring_queue(async, IORING_OP_READ_FIXED, 0, jmraid->disk.fd, jmraid_async_get_buffer(async, index, true), offset, (index * 2) + 1);
+		slot->pending = 2;
+	}
+#endif
+
+	return true;
+}
+
+static void jmraid_async_finish(struct jmraid_async *async, struct jmraid_async_slot *slot, int result, const uint8_t *data_out)
+{
+	struct jmraid *jmraid = slot->jmraid;
+	jmraid_async_callback_t callback = slot->callback;
+	void *context = slot->context;
+
+	// free before the callback, so it can submit the next command
+	slot->jmraid = NULL;
+	async->active_count--;
+
+	if (callback)
+	{
+		callback(async, jmraid, result, (result == JMRAID_RESULT_OK) ? data_out : NULL, context);
+	}
+}
+
+static void jmraid_async_run_sync(struct jmraid_async *async, struct jmraid_async_slot *slot)
+{
+	uint8_t data_out[SECTOR_SIZE];
+	int result;
+
+	result = jmraid_submit_command(slot->jmraid, &slot->command, data_out, slot->size_out) ? JMRAID_RESULT_OK : jmraid_get_last_result(slot->jmraid);
+	jmraid_async_finish(async, slot, result, data_out);
+}
+
+#ifdef ASYNC_IO_URING
+
+static void jmraid_async_complete_uring(struct jmraid_async *async, struct jmraid_async_slot *slot)
+{
+	uint8_t data_out[SECTOR_SIZE];
+	uint32_t index = (uint32_t)(slot - async->slot);
+	struct jmraid *jmraid = slot->jmraid;
+	bool is_transferred = (slot->write_result == SECTOR_SIZE) && (slot->read_result == SECTOR_SIZE);
+	int result;
+
+	if (!is_transferred)
+	{
+		debug_print("async transfer failed %d %d\n", slot->write_result, slot->read_result);
+	}
+
+	result = jmraid_complete_command(jmraid, &slot->command, is_transferred ? jmraid_async_get_buffer(async, index, true) : NULL, data_out, slot->size_out, stats_get_time() - slot->start);
+
+	// the bridge dropped out of command mode, the synchronous path knows
+	// how to get it back, this is rare enough to block for
+	if (jmraid->is_session && jmraid->is_command_mode && ((result == JMRAID_RESULT_CRC) || (result == JMRAID_RESULT_NO_RESPONSE)))
+	{
+		result = jmraid_submit_command(jmraid, &slot->command, data_out, slot->size_out) ? JMRAID_RESULT_OK : jmraid_get_last_result(jmraid);
+	}
+
+	jmraid_async_finish(async, slot, result, data_out);
+}
+
+// the ring is broken, every command on it ends with JMRAID_RESULT_IO and
+// the engine goes on synchronously, so no enclosure stays stuck in flight
+static void jmraid_async_uring_fail(struct jmraid_async *async)
+{
+	uint8_t data_out[SECTOR_SIZE];
+	uint32_t i;
+
+	jmraid_async_uring_exit(async);
+	async->unsubmitted = 0;
+
+	for (i = 0; i < async->slot_count; i++)
+	{
+		struct jmraid_async_slot *slot = &async->slot[i];
+		int result;
+		if (!slot->jmraid || !slot->is_uring)
+		{
+			continue;
+		}
+		result = jmraid_complete_command(slot->jmraid, &slot->command, NULL, data_out, slot->size_out, stats_get_time() - slot->start);
+		jmraid_async_finish(async, slot, result, data_out);
+	}
+}
+
+static int jmraid_async_reap(struct jmraid_async *async)
+{
+	const struct io_uring_cqe *cqes = (const struct io_uring_cqe *)async->cqes;
+	uint32_t head = *async->cq_head;
+	uint32_t tail = __atomic_load_n(async->cq_tail, __ATOMIC_ACQUIRE);
+	int completed = 0;
+
+	while (head != tail)
+	{
+		const struct io_uring_cqe *cqe = &cqes[head & *async->cq_mask];
+		struct jmraid_async_slot *slot = &async->slot[cqe->user_data / 2];
+
+		if (cqe->user_data & 1)
+		{
+			slot->read_result = cqe->res;
+		}
+		else
+		{
+			slot->write_result = cqe->res;
+		}
+		head++;
+		// hand the entry back before the callback may queue more
+		__atomic_store_n(async->cq_head, head, __ATOMIC_RELEASE);
+
+		if (--slot->pending == 0)
+		{
+			jmraid_async_complete_uring(async, slot);
+			completed++;
+		}
+	}
+
+	return completed;
+}
+
+#endif
+
+int jmraid_async_run(struct jmraid_async *async)
+{
+	int completed = 0;
+	bool is_ring_failed = false;
+	uint32_t i;
+
+	debug_print("jmraid_async_run | %u\n", async->active_count);
+
+	while (async->active_count > 0)
+	{
+		bool is_waiting = false;
+
+		for (i = 0; i < async->slot_count; i++)
+		{
+			struct jmraid_async_slot *slot = &async->slot[i];
+			if (!slot->jmraid)
+			{
+				continue;
+			}
+			if (!slot->is_uring)
+			{
+				jmraid_async_run_sync(async, slot);
+				completed++;
+			}
+			else
+			{
+				is_waiting = true;
+			}
+		}
+
+#ifdef ASYNC_IO_URING
+		if (is_waiting)
+		{
+			// submits everything queued since the last call and sleeps
+			// until at least one request is done
+			int result = io_uring_enter(async->ring_fd, async->unsubmitted, 1, IORING_ENTER_GETEVENTS);
+			if (result < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				debug_print("io_uring_enter error %d\n", errno);
+				jmraid_async_uring_fail(async);
+				is_ring_failed = true;
+				continue;
+			}
+			async->unsubmitted -= (uint32_t)result;
+			completed += jmraid_async_reap(async);
+		}
+#else
+		(void)is_waiting;
+#endif
+	}
+
+	return is_ring_failed ? -1 : completed;
+}
+
+static bool jmraid_async_snapshot_next(struct jmraid_async *async, struct jmraid *jmraid, struct jmraid_async_snapshot *state);
+
+static void jmraid_async_snapshot_complete(struct jmraid_async *async, struct jmraid *jmraid, int result, const uint8_t *data_out, void *context)
+{
+	struct jmraid_async_snapshot *state = (struct jmraid_async_snapshot *)context;
+	struct jmraid_snapshot *snapshot = state->snapshot;
+	uint32_t step = state->step;
+	bool is_ok = (result == JMRAID_RESULT_OK);
+
+	state->step++;
+
+	if (step == SNAPSHOT_STEP_CHIP_INFO)
+	{
+		if (is_ok) parse_jmraid_chip_info(data_out, &snapshot->chip_info);
+		snapshot->is_chip_info_valid = is_ok;
+	}
+	else if (step == SNAPSHOT_STEP_SATA_INFO)
+	{
+		if (is_ok) parse_jmraid_sata_info(data_out, &snapshot->sata_info);
+		snapshot->is_sata_info_valid = is_ok;
+		jmraid_plan_queries(jmraid, is_ok ? &snapshot->sata_info : NULL, &state->plan);
+	}
+	else if (step < SNAPSHOT_STEP_RAID_PORT_INFO)
+	{
+		uint32_t port = step - SNAPSHOT_STEP_SATA_PORT_INFO;
+		if (is_ok) parse_jmraid_sata_port_info(data_out, &snapshot->sata_port_info[port]);
+		snapshot->is_sata_port_info_valid[port] = is_ok;
+	}
+	else if (step < SNAPSHOT_STEP_DISK_SMART_INFO)
+	{
+		uint32_t port = step - SNAPSHOT_STEP_RAID_PORT_INFO;
+		if (is_ok)
+		{
+			parse_jmraid_raid_port_info(data_out, &snapshot->raid_port_info[port]);
+			jmraid_raid_port_memory_store(jmraid, (uint8_t)port, &snapshot->raid_port_info[port]);
+		}
+		snapshot->is_raid_port_info_valid[port] = is_ok;
+	}
+	else
+	{
+		uint8_t port = (uint8_t)((step - SNAPSHOT_STEP_DISK_SMART_INFO) / 3);
+		uint32_t phase = (step - SNAPSHOT_STEP_DISK_SMART_INFO) % 3;
+		if (phase == SNAPSHOT_SMART_POWER_MODE)
+		{
+			// a bridge without CHECK POWER MODE just gets SMART read, no
+			// reason to fail the snapshot
+			snapshot->is_power_mode_valid[port] = is_ok && jmraid_parse_power_mode(data_out, &snapshot->power_mode[port]);
+			is_ok = true;
+		}
+		else if (phase == SNAPSHOT_SMART_DATA)
+		{
+			// attribute values, the thresholds come next
+			if (is_ok)
+			{
+				memcpy(state->smart_data, data_out, SECTOR_SIZE - 0x10);
+			}
+			else
+			{
+				state->step++;
+			}
+		}
+		else
+		{
+			if (is_ok)
+			{
+				parse_jmraid_disk_smart_info(state->smart_data, data_out, &snapshot->disk_smart_info[port]);
+				snapshot->disk_smart_info_time[port] = snapshot->time;
+			}
+			snapshot->is_disk_smart_info_valid[port] = is_ok;
+			if (is_ok) jmraid_smart_memory_store(jmraid, snapshot, port);
+		}
+	}
+	state->result &= is_ok;
+
+	jmraid_async_snapshot_next(async, jmraid, state);
+}
+
+// data_in of the command behind a step, 0 if the step needs none
+static uint32_t jmraid_async_snapshot_build(struct jmraid *jmraid, struct jmraid_async_snapshot *state, uint8_t *data_in)
+{
+	uint32_t step = state->step;
+	uint32_t phase;
+	uint8_t port;
+	uint8_t ata_data[16];
+	uint8_t args[JMRAID_ATA_PASSTHROUGH_ARGS_SIZE];
+
+	if (step == SNAPSHOT_STEP_CHIP_INFO)
+	{
+		return jmraid_encode_get_chip_info(data_in, NULL);
+	}
+	if (step == SNAPSHOT_STEP_SATA_INFO)
+	{
+		return jmraid_encode_get_sata_info(data_in, NULL);
+	}
+	if (step < SNAPSHOT_STEP_RAID_PORT_INFO)
+	{
+		port = (uint8_t)(step - SNAPSHOT_STEP_SATA_PORT_INFO);
+		if (!state->plan.is_sata_port_info_needed[port])
+		{
+			jmraid_plan_fill_sata_port_info(&state->snapshot->sata_port_info[port]);
+			state->snapshot->is_sata_port_info_valid[port] = true;
+			return 0;
+		}
+		return jmraid_encode_get_sata_port_info(data_in, &port);
+	}
+	if (step < SNAPSHOT_STEP_DISK_SMART_INFO)
+	{
+		port = (uint8_t)(step - SNAPSHOT_STEP_RAID_PORT_INFO);
+		if (!state->plan.is_raid_port_info_needed[port])
+		{
+			return 0;
+		}
+		return jmraid_encode_get_raid_port_info(data_in, &port);
+	}
+
+	port = (uint8_t)((step - SNAPSHOT_STEP_DISK_SMART_INFO) / 3);
+	phase = (step - SNAPSHOT_STEP_DISK_SMART_INFO) % 3;
+	if (!state->snapshot->is_sata_info_valid || !state->plan.is_disk_smart_info_needed[port])
+	{
+		return 0;
+	}
+	if (phase == SNAPSHOT_SMART_POWER_MODE)
+	{
+		if (!jmraid->is_power_mode_checked || jmraid->is_smart_fresh_required)
+		{
+			return 0;
+		}
+		jmraid_ata_check_power_mode_task_file(ata_data);
+		jmraid_ata_passthrough_args(args, port, 0x00, 0x00, ata_data);
+		return jmraid_encode_ata_passthrough(data_in, args);
+	}
+	// a disk in standby stays there, like jmraid_get_snapshot()
+	if (state->snapshot->is_power_mode_valid[port] && jmraid_power_mode_is_standby(state->snapshot->power_mode[port]))
+	{
+		if (phase == SNAPSHOT_SMART_DATA)
+		{
+			debug_print("disk %d in standby\n", port);
+			jmraid_smart_memory_load(jmraid, state->snapshot, port);
+		}
+		return 0;
+	}
+	// ATA SMART READ DATA / READ THRESHOLDS through the passthrough, like
+	// jmraid_get_disk_smart_info()
+	jmraid_ata_smart_task_file(ata_data, (phase == SNAPSHOT_SMART_DATA) ? 0xD0 : 0xD1);
+	jmraid_ata_passthrough_args(args, port, 0x00, 0xE0, ata_data);
+	return jmraid_encode_ata_passthrough(data_in, args);
+}
+
+static bool jmraid_async_snapshot_next(struct jmraid_async *async, struct jmraid *jmraid, struct jmraid_async_snapshot *state)
+{
+	uint8_t data_in[JMRAID_COMMAND_MAX_SIZE_IN];
+
+	while (state->step < SNAPSHOT_STEP_DONE)
+	{
+		uint32_t size_in = jmraid_async_snapshot_build(jmraid, state, data_in);
+		if (size_in == 0)
+		{
+			state->step++;
+			continue;
+		}
+		if (jmraid_async_submit(async, jmraid, data_in, size_in, SECTOR_SIZE, jmraid_async_snapshot_complete, state))
+		{
+			return true;
+		}
+		debug_print("jmraid_async_submit failed\n");
+		state->result = false;
+		state->step++;
+	}
+
+	if (state->done)
+	{
+		state->done(jmraid, state->snapshot, state->result, state->context);
+	}
+
+	return false;
+}
+
+bool jmraid_async_get_snapshot(struct jmraid_async *async, struct jmraid *jmraid, struct jmraid_async_snapshot *state, struct jmraid_snapshot *snapshot, jmraid_async_snapshot_callback_t done, void *context)
+{
+	debug_print("jmraid_async_get_snapshot\n");
+
+	memset(state, 0, sizeof(struct jmraid_async_snapshot));
+	state->snapshot = snapshot;
+	state->result = true;
+	state->done = done;
+	state->context = context;
+
+	memset(snapshot, 0, sizeof(struct jmraid_snapshot));
+	snapshot->time = time(NULL);
+
+	return jmraid_async_snapshot_next(async, jmraid, state);
+}
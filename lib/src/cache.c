@@ -0,0 +1,295 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#endif
+
+#ifdef DEBUG_PRINT
+extern void debug_print(const char* format, ...);
+#else
+#define debug_print(...)
+#endif
+
+#define CACHE_MAGIC 0x43524D4A // "JMRC"
+#define CACHE_VERSION 2
+
+struct jmraid_cache_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+};
+
+static void jmraid_cache_get_path(const struct jmraid_cache *cache, uint32_t chip_serial, char *path, size_t size)
+{
+	snprintf(path, size, "%s/%08X.cache", cache->dir, chip_serial);
+}
+
+static bool jmraid_cache_is_fresh(const struct jmraid_cache *cache, time_t time_stored)
+{
+	time_t now = time(NULL);
+
+	return (time_stored != 0) && (now >= time_stored) && ((uint64_t)(now - time_stored) < cache->ttl);
+}
+
+void jmraid_cache_init(struct jmraid_cache *cache, const char *dir, uint32_t ttl)
+{
+	debug_print("jmraid_cache_init | %s | %u\n", dir, ttl);
+
+	memset(cache, 0, sizeof(struct jmraid_cache));
+	strncpy(cache->dir, dir, sizeof(cache->dir) - 1);
+	cache->ttl = ttl;
+}
+
+bool jmraid_cache_load(struct jmraid_cache *cache, const struct jmraid_chip_info *chip_info)
+{
+	struct jmraid_cache_header header;
+	char path[320];
+	FILE *file;
+	bool result;
+
+	debug_print("jmraid_cache_load | %08X\n", chip_info->serial_number);
+
+	memset(&cache->data, 0, sizeof(struct jmraid_cache_data));
+	cache->data.chip_serial = chip_info->serial_number;
+	cache->data.chip_info_time = time(NULL);
+	memcpy(&cache->data.chip_info, chip_info, sizeof(struct jmraid_chip_info));
+	cache->is_dirty = true;
+
+	jmraid_cache_get_path(cache, chip_info->serial_number, path, sizeof(path));
+	file = fopen(path, "rb");
+	if (!file)
+	{
+		debug_print("no cache file %s\n", path);
+		return false;
+	}
+
+	result = (fread(&header, sizeof(header), 1, file) == 1) &&
+		(header.magic == CACHE_MAGIC) && (header.version == CACHE_VERSION) && (header.size == sizeof(struct jmraid_cache_data)) &&
+		(fread(&cache->data, sizeof(struct jmraid_cache_data), 1, file) == 1);
+	fclose(file);
+
+	// a firmware update or a different chip behind the same serial, start over
+	if (!result || (cache->data.chip_serial != chip_info->serial_number) || (memcmp(&cache->data.chip_info, chip_info, sizeof(struct jmraid_chip_info)) != 0))
+	{
+		debug_print("cache file %s stale or invalid\n", path);
+		memset(&cache->data, 0, sizeof(struct jmraid_cache_data));
+		cache->data.chip_serial = chip_info->serial_number;
+		cache->data.chip_info_time = time(NULL);
+		memcpy(&cache->data.chip_info, chip_info, sizeof(struct jmraid_chip_info));
+		return false;
+	}
+
+	cache->is_dirty = false;
+
+	return true;
+}
+
+bool jmraid_cache_save(struct jmraid_cache *cache)
+{
+	struct jmraid_cache_header header;
+	char path[320];
+	char temp_path[328];
+	FILE *file;
+	bool result;
+
+	debug_print("jmraid_cache_save | %08X\n", cache->data.chip_serial);
+
+	if (!cache->is_dirty)
+	{
+		return true;
+	}
+
+	mkdir(cache->dir, 0755);
+
+	jmraid_cache_get_path(cache, cache->data.chip_serial, path, sizeof(path));
+	snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+	file = fopen(temp_path, "wb");
+	if (!file)
+	{
+		debug_print("fopen %s failed\n", temp_path);
+		return false;
+	}
+
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.size = sizeof(struct jmraid_cache_data);
+	result = (fwrite(&header, sizeof(header), 1, file) == 1) && (fwrite(&cache->data, sizeof(struct jmraid_cache_data), 1, file) == 1);
+	result = (fclose(file) == 0) && result;
+
+	// readers never see a half written file
+	if (!result || (rename(temp_path, path) != 0))
+	{
+		debug_print("writing %s failed\n", path);
+		remove(temp_path);
+		return false;
+	}
+
+	cache->is_dirty = false;
+
+	return true;
+}
+
+static void jmraid_cache_get_vendor_id_path(const char *dir, const char *device_key, char *path, size_t size)
+{
+	size_t len;
+	size_t i;
+
+	snprintf(path, size, "%s/", dir);
+	len = strlen(path);
+	for (i = 0; device_key[i] && (len + 1 < size); i++)
+	{
+		char c = device_key[i];
+		// keys come from USB descriptors, keep them to one file name
+		path[len++] = ((c == '/') || (c == '\\') || (c <= ' ')) ? '_' : c;
+	}
+	path[len] = 0;
+	snprintf(path + len, size - len, ".vendor_id");
+}
+
+bool jmraid_cache_load_vendor_id(const char *dir, const char *device_key, uint32_t *vendor_id)
+{
+	char path[320];
+	char line[32];
+	FILE *file;
+	bool result;
+
+	jmraid_cache_get_vendor_id_path(dir, device_key, path, sizeof(path));
+	file = fopen(path, "r");
+	if (!file)
+	{
+		return false;
+	}
+	result = (fgets(line, sizeof(line), file) != NULL);
+	fclose(file);
+
+	if (result)
+	{
+		*vendor_id = (uint32_t)strtoul(line, NULL, 16);
+		result = (*vendor_id != 0);
+	}
+
+	debug_print("jmraid_cache_load_vendor_id | %s | %d | %08X\n", device_key, result, result ? *vendor_id : 0);
+
+	return result;
+}
+
+bool jmraid_cache_save_vendor_id(const char *dir, const char *device_key, uint32_t vendor_id)
+{
+	char path[320];
+	char temp_path[328];
+	FILE *file;
+	bool result;
+
+	debug_print("jmraid_cache_save_vendor_id | %s | %08X\n", device_key, vendor_id);
+
+	mkdir(dir, 0755);
+
+	jmraid_cache_get_vendor_id_path(dir, device_key, path, sizeof(path));
+	snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+	file = fopen(temp_path, "w");
+	if (!file)
+	{
+		debug_print("fopen %s failed\n", temp_path);
+		return false;
+	}
+	result = (fprintf(file, "%08X\n", vendor_id) > 0);
+	result = (fclose(file) == 0) && result;
+
+	if (!result || (rename(temp_path, path) != 0))
+	{
+		debug_print("writing %s failed\n", path);
+		remove(temp_path);
+		return false;
+	}
+
+	return true;
+}
+
+bool jmraid_cache_detect_vendor_id(const char *dir, const char *device_key, struct jmraid *jmraid, uint32_t *vendor_id, bool *is_cached)
+{
+	debug_print("jmraid_cache_detect_vendor_id | %s\n", device_key ? device_key : "-");
+
+	*is_cached = false;
+
+	if (device_key && jmraid_cache_load_vendor_id(dir, device_key, vendor_id))
+	{
+		*is_cached = true;
+		return true;
+	}
+
+	if (!jmraid_detect_vendor_id(jmraid, vendor_id))
+	{
+		debug_print("jmraid_detect_vendor_id failed\n");
+		return false;
+	}
+
+	if (device_key)
+	{
+		jmraid_cache_save_vendor_id(dir, device_key, *vendor_id);
+	}
+
+	return true;
+}
+
+void jmraid_cache_validate(struct jmraid_cache *cache, const struct jmraid_sata_info *sata_info)
+{
+	int i;
+
+	debug_print("jmraid_cache_validate\n");
+
+	for (i = 0; i < 5; i++)
+	{
+		struct jmraid_cache_port *port = &cache->data.port[i];
+		if (memcmp(&port->sata_info_item, &sata_info->item[i], sizeof(struct jmraid_sata_info_item)) != 0)
+		{
+			debug_print("port %d changed\n", i);
+			memset(port, 0, sizeof(struct jmraid_cache_port));
+			memcpy(&port->sata_info_item, &sata_info->item[i], sizeof(struct jmraid_sata_info_item));
+			cache->is_dirty = true;
+		}
+	}
+}
+
+bool jmraid_get_sata_port_info_cached(struct jmraid *jmraid, struct jmraid_cache *cache, uint8_t index, struct jmraid_sata_port_info *info)
+{
+	struct jmraid_cache_port *port;
+
+	debug_print("jmraid_get_sata_port_info_cached | %d\n", index);
+
+	if (!cache || (index >= 5))
+	{
+		return jmraid_get_sata_port_info(jmraid, index, info);
+	}
+
+	port = &cache->data.port[index];
+	if (jmraid_cache_is_fresh(cache, port->sata_port_info_time))
+	{
+		memcpy(info, &port->sata_port_info, sizeof(struct jmraid_sata_port_info));
+		return true;
+	}
+
+	if (!jmraid_get_sata_port_info(jmraid, index, info))
+	{
+		debug_print("jmraid_get_sata_port_info failed\n");
+		return false;
+	}
+
+	memcpy(&port->sata_port_info, info, sizeof(struct jmraid_sata_port_info));
+	port->sata_port_info_time = time(NULL);
+	cache->is_dirty = true;
+
+	return true;
+}
@@ -0,0 +1,268 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
+#include "discover.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <limits.h>
+#endif
+
+#ifdef DEBUG_PRINT
+extern void debug_print(const char* format, ...);
+#else
+#define debug_print(...)
+#endif
+
+struct discover_usb_id
+{
+	uint16_t vendor_id;
+	uint16_t product_id;
+};
+
+// the bridges answer to 0x197B0562 / 0x197B0322 in the command sector,
+// on the bus they show up with either the PCI or the USB JMicron vendor id
+static const struct discover_usb_id TABLE_JMRAID_USB_ID[] =
+{
+	{ 0x197B, 0x0562 },
+	{ 0x197B, 0x0322 },
+	{ 0x152D, 0x0562 },
+	{ 0x152D, 0x0322 },
+};
+
+bool discover_is_jmraid_usb_id(uint16_t vendor_id, uint16_t product_id)
+{
+	size_t i;
+	for (i = 0; i < sizeof(TABLE_JMRAID_USB_ID) / sizeof(TABLE_JMRAID_USB_ID[0]); i++)
+	{
+		if ((TABLE_JMRAID_USB_ID[i].vendor_id == vendor_id) && (TABLE_JMRAID_USB_ID[i].product_id == product_id))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+#ifdef __linux__
+
+static bool read_sysfs_string(const char *dir, const char *name, char *value, size_t size)
+{
+	char path[PATH_MAX];
+	FILE *file;
+	size_t len;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	file = fopen(path, "r");
+	if (!file)
+	{
+		return false;
+	}
+	if (!fgets(value, (int)size, file))
+	{
+		fclose(file);
+		return false;
+	}
+	fclose(file);
+
+	len = strlen(value);
+	while ((len > 0) && ((value[len - 1] == '\n') || (value[len - 1] == ' ')))
+	{
+		value[--len] = 0;
+	}
+
+	return true;
+}
+
+static bool read_sysfs_hex(const char *dir, const char *name, uint16_t *value)
+{
+	char str[16];
+	if (!read_sysfs_string(dir, name, str, sizeof(str)))
+	{
+		return false;
+	}
+	*value = (uint16_t)strtoul(str, NULL, 16);
+	return true;
+}
+
+// walks from the SCSI device up to the USB device, which is the first
+// parent that has idVendor / idProduct attributes
+static bool discover_usb_parent(const char *block_name, struct discover_device *device)
+{
+	char link[PATH_MAX];
+	char path[PATH_MAX];
+	char *p;
+
+	snprintf(link, sizeof(link), "/sys/block/%s/device", block_name);
+	if (!realpath(link, path))
+	{
+		return false;
+	}
+
+	for (;;)
+	{
+		if (read_sysfs_hex(path, "idVendor", &device->usb_vendor_id) && read_sysfs_hex(path, "idProduct", &device->usb_product_id))
+		{
+			if (!read_sysfs_string(path, "serial", device->usb_serial, sizeof(device->usb_serial)))
+			{
+				device->usb_serial[0] = 0;
+			}
+			return true;
+		}
+		p = strrchr(path, '/');
+		if (!p || (p == path))
+		{
+			return false;
+		}
+		*p = 0;
+		if (strcmp(path, "/sys/devices") == 0)
+		{
+			return false;
+		}
+	}
+}
+
+static int compare_devices(const void *a, const void *b)
+{
+	const struct discover_device *da = (const struct discover_device *)a;
+	const struct discover_device *db = (const struct discover_device *)b;
+	size_t la = strlen(da->disk_name);
+	size_t lb = strlen(db->disk_name);
+
+	// sdz comes before sdaa
+	if (la != lb)
+	{
+		return (la < lb) ? -1 : 1;
+	}
+	return strcmp(da->disk_name, db->disk_name);
+}
+
+int discover_jmraid_devices(struct discover_device *devices, int max_devices)
+{
+	DIR *dir;
+	struct dirent *entry;
+	int count = 0;
+
+	debug_print("discover_jmraid_devices\n");
+
+	dir = opendir("/sys/block");
+	if (!dir)
+	{
+		debug_print("opendir /sys/block failed\n");
+		return -1;
+	}
+
+	while (((entry = readdir(dir)) != NULL) && (count < max_devices))
+	{
+		struct discover_device *device = &devices[count];
+
+		if (entry->d_name[0] == '.')
+		{
+			continue;
+		}
+
+		memset(device, 0, sizeof(struct discover_device));
+		if (!discover_usb_parent(entry->d_name, device))
+		{
+			continue;
+		}
+		if (!discover_is_jmraid_usb_id(device->usb_vendor_id, device->usb_product_id))
+		{
+			continue;
+		}
+
+		// a name that does not fit could not be opened anyway
+		if (snprintf(device->disk_name, sizeof(device->disk_name), "/dev/%s", entry->d_name) >= (int)sizeof(device->disk_name))
+		{
+			debug_print("name too long | %s\n", entry->d_name);
+			continue;
+		}
+		debug_print("found %s | %04X:%04X\n", device->disk_name, device->usb_vendor_id, device->usb_product_id);
+		count++;
+	}
+	closedir(dir);
+
+	qsort(devices, count, sizeof(struct discover_device), compare_devices);
+
+	return count;
+}
+
+bool discover_get_device_key(const char *disk_name, char *key, size_t size)
+{
+	struct discover_device device;
+	char disk_path[PATH_MAX];
+	char link_path[PATH_MAX];
+	char path[PATH_MAX];
+	const char *block_name;
+	DIR *dir;
+	struct dirent *entry;
+	bool result = false;
+
+	debug_print("discover_get_device_key | %s\n", disk_name);
+
+	if (!realpath(disk_name, disk_path))
+	{
+		return false;
+	}
+
+	block_name = strrchr(disk_path, '/');
+	block_name = block_name ? block_name + 1 : disk_path;
+
+	memset(&device, 0, sizeof(device));
+	if (discover_usb_parent(block_name, &device) && device.usb_serial[0])
+	{
+		snprintf(key, size, "usb-%04x_%04x-%s", device.usb_vendor_id, device.usb_product_id, device.usb_serial);
+		return true;
+	}
+
+	// no USB serial, fall back to the udev name, taking the smallest one so
+	// every run picks the same
+	dir = opendir("/dev/disk/by-id");
+	if (!dir)
+	{
+		return false;
+	}
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (entry->d_name[0] == '.')
+		{
+			continue;
+		}
+		snprintf(link_path, sizeof(link_path), "/dev/disk/by-id/%s", entry->d_name);
+		if (!realpath(link_path, path) || (strcmp(path, disk_path) != 0))
+		{
+			continue;
+		}
+		if (!result || (strcmp(entry->d_name, key) < 0))
+		{
+			snprintf(key, size, "%s", entry->d_name);
+			result = true;
+		}
+	}
+	closedir(dir);
+
+	return result;
+}
+
+#else
+
+int discover_jmraid_devices(struct discover_device *devices, int max_devices)
+{
+	(void)devices;
+	(void)max_devices;
+	return -1;
+}
+
+bool discover_get_device_key(const char *disk_name, char *key, size_t size)
+{
+	(void)disk_name;
+	(void)key;
+	(void)size;
+	return false;
+}
+
+#endif
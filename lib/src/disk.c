@@ -1,4 +1,22 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
 #include "disk.h"
+#include "emu.h"
+
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <scsi/sg.h>
+#endif
 
 #ifdef DEBUG_PRINT
 #include <stdio.h>
@@ -12,27 +30,314 @@ void disk_init(struct disk *disk)
 	debug_print("disk_init\n");
 	memset(disk, 0, sizeof(struct disk));
 	disk->handle = INVALID_HANDLE_VALUE;
+	disk->backend = DISK_BACKEND_DEFAULT;
+	disk->timeout = DISK_DEFAULT_TIMEOUT;
+#ifndef _WIN32
+	disk->fd = -1;
+#endif
+}
+
+void disk_set_backend(struct disk *disk, enum disk_backend backend)
+{
+	debug_print("disk_set_backend | %s\n", disk_get_backend_name(backend));
+	disk->backend = backend;
+}
+
+// attaches an emulated bridge, the disk name passed to disk_open() is then
+// only used for messages
+void disk_set_emulator(struct disk *disk, struct emu *emu)
+{
+	debug_print("disk_set_emulator\n");
+	disk->backend = DISK_BACKEND_EMU;
+	disk->emu = emu;
+	disk->is_emu_owned = false;
+}
+
+void disk_set_timeout(struct disk *disk, uint32_t timeout)
+{
+	debug_print("disk_set_timeout | %u\n", timeout);
+	disk->timeout = timeout;
+}
+
+bool disk_parse_backend(const char *name, enum disk_backend *backend)
+{
+	if (strcmp(name, "stdio") == 0)
+	{
+		*backend = DISK_BACKEND_STDIO;
+	}
+	else if (strcmp(name, "direct") == 0)
+	{
+		*backend = DISK_BACKEND_DIRECT;
+	}
+	else if (strcmp(name, "sg") == 0)
+	{
+		*backend = DISK_BACKEND_SG;
+	}
+	else if (strcmp(name, "emu") == 0)
+	{
+		*backend = DISK_BACKEND_EMU;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+const char *disk_get_backend_name(enum disk_backend backend)
+{
+	switch (backend)
+	{
+		case DISK_BACKEND_STDIO: return "stdio";
+		case DISK_BACKEND_DIRECT: return "direct";
+		case DISK_BACKEND_SG: return "sg";
+		case DISK_BACKEND_EMU: return "emu";
+		default: return "?";
+	}
+}
+
+static bool disk_is_open(struct disk *disk)
+{
+	if (disk->is_emu_open)
+	{
+		return true;
+	}
+#ifndef _WIN32
+	if (disk->fd != -1)
+	{
+		return true;
+	}
+#endif
+	return disk->handle != INVALID_HANDLE_VALUE;
+}
+
+#ifndef _WIN32
+
+static bool disk_fd_open(struct disk *disk, const char *name, const char *flags)
+{
+	int mode;
+	int fd;
+	void *buffer;
+
+	mode = strchr(flags, 'w') ? O_RDWR | O_SYNC : O_RDONLY;
+
+	if (disk->backend == DISK_BACKEND_SG)
+	{
+		// SCSI generic pass-through, the block layer is not involved at all
+		fd = open(name, strchr(flags, 'w') ? O_RDWR : O_RDONLY);
+	}
+	else
+	{
+		fd = open(name, mode | O_DIRECT);
+	}
+	if ((fd == -1) && (errno == EINVAL) && (disk->backend == DISK_BACKEND_DIRECT))
+	{
+		// the file system does not support O_DIRECT (tmpfs, image files ...)
+		debug_print("O_DIRECT not supported, falling back to O_SYNC\n");
+		fd = open(name, mode);
+	}
+	if (fd == -1)
+	{
+		debug_print("open error %d\n", errno);
+		return false;
+	}
+
+	if (posix_memalign(&buffer, DISK_BUFFER_ALIGNMENT, SECTOR_SIZE) != 0)
+	{
+		debug_print("posix_memalign failed\n");
+		close(fd);
+		return false;
+	}
+
+	disk->fd = fd;
+	disk->buffer = (uint8_t *)buffer;
+
+	return true;
+}
+
+static bool disk_fd_close(struct disk *disk)
+{
+	bool result;
+
+	result = close(disk->fd) == 0;
+	if (!result)
+	{
+		debug_print("close error %d\n", errno);
+	}
+
+	free(disk->buffer);
+	disk->buffer = NULL;
+	disk->fd = -1;
+
+	return result;
+}
+
+static bool disk_direct_read_sector(struct disk *disk, uint64_t sector, uint8_t *data)
+{
+	uint8_t *buffer;
+
+	// callers handing in an aligned buffer get the data without a copy
+	buffer = (((uintptr_t)data % DISK_BUFFER_ALIGNMENT) == 0) ? data : disk->buffer;
+
+	if (pread(disk->fd, buffer, SECTOR_SIZE, (off_t)(sector * SECTOR_SIZE)) != SECTOR_SIZE)
+	{
+		debug_print("pread error %d\n", errno);
+		return false;
+	}
+
+	if (buffer != data)
+	{
+		memcpy(data, buffer, SECTOR_SIZE);
+	}
+
+	return true;
+}
+
+static bool disk_direct_write_sector(struct disk *disk, uint64_t sector, const uint8_t *data)
+{
+	const uint8_t *buffer;
+
+	if (((uintptr_t)data % DISK_BUFFER_ALIGNMENT) == 0)
+	{
+		buffer = data;
+	}
+	else
+	{
+		memcpy(disk->buffer, data, SECTOR_SIZE);
+		buffer = disk->buffer;
+	}
+
+	if (pwrite(disk->fd, buffer, SECTOR_SIZE, (off_t)(sector * SECTOR_SIZE)) != SECTOR_SIZE)
+	{
+		debug_print("pwrite error %d\n", errno);
+		return false;
+	}
+
+	return true;
+}
+
+#ifdef __linux__
+
+static bool disk_sg_transfer(struct disk *disk, uint64_t sector, uint8_t *buffer, bool write)
+{
+	sg_io_hdr_t io_hdr;
+	uint8_t cdb[10];
+	uint8_t sense[32];
+
+	if (sector > 0xFFFFFFFF)
+	{
+		debug_print("sector out of READ(10)/WRITE(10) range\n");
+		return false;
+	}
+
+	memset(cdb, 0, sizeof(cdb));
+	cdb[0] = write ? 0x2A : 0x28;
+	cdb[2] = (uint8_t)(sector >> 24);
+	cdb[3] = (uint8_t)(sector >> 16);
+	cdb[4] = (uint8_t)(sector >> 8);
+	cdb[5] = (uint8_t)(sector >> 0);
+	cdb[8] = 1;
+
+	memset(&io_hdr, 0, sizeof(io_hdr));
+	io_hdr.interface_id = 'S';
+	io_hdr.dxfer_direction = write ? SG_DXFER_TO_DEV : SG_DXFER_FROM_DEV;
+	io_hdr.cmd_len = sizeof(cdb);
+	io_hdr.cmdp = cdb;
+	io_hdr.mx_sb_len = sizeof(sense);
+	io_hdr.sbp = sense;
+	io_hdr.dxfer_len = SECTOR_SIZE;
+	io_hdr.dxferp = buffer;
+	io_hdr.timeout = disk->timeout;
+
+	if (ioctl(disk->fd, SG_IO, &io_hdr) != 0)
+	{
+		debug_print("SG_IO error %d\n", errno);
+		return false;
+	}
+
+	if ((io_hdr.info & SG_INFO_OK_MASK) != SG_INFO_OK)
+	{
+		debug_print("SG_IO status %02X host %04X driver %04X\n", io_hdr.status, io_hdr.host_status, io_hdr.driver_status);
+		return false;
+	}
+
+	return true;
 }
 
+static bool disk_sg_read_sector(struct disk *disk, uint64_t sector, uint8_t *data)
+{
+	if (!disk_sg_transfer(disk, sector, disk->buffer, false))
+	{
+		return false;
+	}
+
+	memcpy(data, disk->buffer, SECTOR_SIZE);
+
+	return true;
+}
+
+static bool disk_sg_write_sector(struct disk *disk, uint64_t sector, const uint8_t *data)
+{
+	memcpy(disk->buffer, data, SECTOR_SIZE);
+
+	return disk_sg_transfer(disk, sector, disk->buffer, true);
+}
+
+#endif
+
+#endif
+
 bool disk_open(struct disk *disk, const char *name, const char *flags)
 {
 	HANDLE handle;
 	DWORD access = 0;
 
-	debug_print("disk_open | %s | %s\n", name, flags);
+	debug_print("disk_open | %s | %s | %s\n", name, flags, disk_get_backend_name(disk->backend));
 
-	if (disk->handle != INVALID_HANDLE_VALUE)
+	if (disk_is_open(disk))
 	{
 		debug_print("disk already open\n");
 		return false;
 	}
 
+	if (disk->backend == DISK_BACKEND_EMU)
+	{
+		if (!disk->emu)
+		{
+			// nothing attached, bring up a default enclosure
+			disk->emu = (struct emu *)malloc(sizeof(struct emu));
+			if (!disk->emu)
+			{
+				debug_print("malloc failed\n");
+				return false;
+			}
+			emu_init(disk->emu);
+			disk->is_emu_owned = true;
+		}
+		disk->is_emu_open = true;
+		return true;
+	}
+
 #ifdef _WIN32
 	access |= strchr(flags, 'r') ? GENERIC_READ : 0;
 	access |= strchr(flags, 'w') ? GENERIC_WRITE : 0;
 	handle = CreateFileA(name, access, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
 #else
-	handle = fopen(name, flags);
+	if (disk->backend == DISK_BACKEND_DIRECT)
+	{
+		return disk_fd_open(disk, name, flags);
+	}
+	if (disk->backend == DISK_BACKEND_SG)
+	{
+#ifdef __linux__
+		return disk_fd_open(disk, name, flags);
+#else
+		debug_print("SG_IO backend not supported\n");
+		return false;
+#endif
+	}
+	(void)access;
+	handle = fopen(name, strchr(flags, 'w') ? "r+b" : "rb");
 #endif
 	if (handle == INVALID_HANDLE_VALUE)
 	{
@@ -49,12 +354,31 @@ bool disk_close(struct disk *disk)
 {
 	debug_print("disk_close\n");
 
-	if (disk->handle == INVALID_HANDLE_VALUE)
+	if (!disk_is_open(disk))
 	{
 		debug_print("disk not open\n");
 		return false;
 	}
 
+	if (disk->is_emu_open)
+	{
+		if (disk->is_emu_owned)
+		{
+			free(disk->emu);
+			disk->emu = NULL;
+			disk->is_emu_owned = false;
+		}
+		disk->is_emu_open = false;
+		return true;
+	}
+
+#ifndef _WIN32
+	if (disk->fd != -1)
+	{
+		return disk_fd_close(disk);
+	}
+#endif
+
 	if (!CloseHandle(disk->handle))
 	{
 		debug_print("CloseHandle error %x\n", GetLastError());
@@ -66,7 +390,7 @@ bool disk_close(struct disk *disk)
 	return true;
 }
 
-bool disk_read_sector(struct disk *disk, uint64_t sector, uint8_t *data)
+static bool disk_do_read_sector(struct disk *disk, uint64_t sector, uint8_t *data)
 {
 #ifdef _WIN32
 	LARGE_INTEGER distanceToMove;
@@ -76,11 +400,27 @@ bool disk_read_sector(struct disk *disk, uint64_t sector, uint8_t *data)
 
 	debug_print("disk_read_sector | %llu\n", sector);
 
-	if (disk->handle == INVALID_HANDLE_VALUE)
+	if (!disk_is_open(disk))
 	{
 		debug_print("disk not open\n");
 		return false;
 	}
+	if (disk->is_emu_open)
+	{
+		return emu_read_sector(disk->emu, sector, data);
+	}
+#ifndef _WIN32
+	if (disk->fd != -1)
+	{
+#ifdef __linux__
+		if (disk->backend == DISK_BACKEND_SG)
+		{
+			return disk_sg_read_sector(disk, sector, data);
+		}
+#endif
+		return disk_direct_read_sector(disk, sector, data);
+	}
+#endif
 #ifdef _WIN32
 	distanceToMove.QuadPart = sector * SECTOR_SIZE;
 	result = (SetFilePointer(disk->handle, distanceToMove.LowPart, &distanceToMove.HighPart, FILE_BEGIN) == INVALID_SET_FILE_POINTER) && (GetLastError() != NO_ERROR);
@@ -96,7 +436,7 @@ bool disk_read_sector(struct disk *disk, uint64_t sector, uint8_t *data)
 #ifdef _WIN32
 	result = ReadFile(disk->handle, data, SECTOR_SIZE, &numberOfBytesRead, NULL);
 #else
-	numberOfBytesRead = fread(data, SECTOR_SIZE, 1, disk->handle);
+	numberOfBytesRead = fread(data, 1, SECTOR_SIZE, disk->handle);
 	result = (numberOfBytesRead == SECTOR_SIZE);
 #endif
 	if (!result)
@@ -108,7 +448,7 @@ bool disk_read_sector(struct disk *disk, uint64_t sector, uint8_t *data)
 	return true;
 }
 
-bool disk_write_sector(struct disk *disk, uint64_t sector, const uint8_t *data)
+static bool disk_do_write_sector(struct disk *disk, uint64_t sector, const uint8_t *data)
 {
 #ifdef _WIN32
 	LARGE_INTEGER distanceToMove;
@@ -118,11 +458,27 @@ bool disk_write_sector(struct disk *disk, uint64_t sector, const uint8_t *data)
 
 	debug_print("disk_write_sector | %llu\n", sector);
 
-	if (disk->handle == INVALID_HANDLE_VALUE)
+	if (!disk_is_open(disk))
 	{
 		debug_print("disk not open\n");
 		return false;
 	}
+	if (disk->is_emu_open)
+	{
+		return emu_write_sector(disk->emu, sector, data);
+	}
+#ifndef _WIN32
+	if (disk->fd != -1)
+	{
+#ifdef __linux__
+		if (disk->backend == DISK_BACKEND_SG)
+		{
+			return disk_sg_write_sector(disk, sector, data);
+		}
+#endif
+		return disk_direct_write_sector(disk, sector, data);
+	}
+#endif
 
 #ifdef _WIN32
 	distanceToMove.QuadPart = sector * SECTOR_SIZE;
@@ -139,8 +495,8 @@ bool disk_write_sector(struct disk *disk, uint64_t sector, const uint8_t *data)
 #ifdef _WIN32
 	result = WriteFile(disk->handle, data, SECTOR_SIZE, &numberOfBytesWritten, NULL);
 #else
-	numberOfBytesWritten = fwrite(data, SECTOR_SIZE, 1, disk->handle);
-	result = (numberOfBytesWritten == SECTOR_SIZE);
+	numberOfBytesWritten = fwrite(data, 1, SECTOR_SIZE, disk->handle);
+	result = (numberOfBytesWritten == SECTOR_SIZE) && (fflush(disk->handle) == 0);
 #endif
 	if (!result)
 	{
@@ -150,3 +506,55 @@ bool disk_write_sector(struct disk *disk, uint64_t sector, const uint8_t *data)
 
 	return true;
 }
+
+bool disk_read_sector(struct disk *disk, uint64_t sector, uint8_t *data)
+{
+	uint64_t start;
+	bool result;
+
+	start = stats_get_time();
+	result = disk_do_read_sector(disk, sector, data);
+	stats_histogram_add(&disk->stats.read, stats_get_time() - start);
+
+	if (result)
+	{
+		disk->stats.bytes_read += SECTOR_SIZE;
+	}
+	else
+	{
+		disk->stats.read_error_count++;
+	}
+
+	return result;
+}
+
+bool disk_write_sector(struct disk *disk, uint64_t sector, const uint8_t *data)
+{
+	uint64_t start;
+	bool result;
+
+	start = stats_get_time();
+	result = disk_do_write_sector(disk, sector, data);
+	stats_histogram_add(&disk->stats.write, stats_get_time() - start);
+
+	if (result)
+	{
+		disk->stats.bytes_written += SECTOR_SIZE;
+	}
+	else
+	{
+		disk->stats.write_error_count++;
+	}
+
+	return result;
+}
+
+void disk_get_stats(struct disk *disk, struct disk_stats *stats)
+{
+	memcpy(stats, &disk->stats, sizeof(struct disk_stats));
+}
+
+void disk_reset_stats(struct disk *disk)
+{
+	memset(&disk->stats, 0, sizeof(struct disk_stats));
+}
@@ -0,0 +1,605 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
+#include "emu.h"
+#include "jmraid.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef DEBUG_PRINT
+#include <stdio.h>
+extern void debug_print(const char* format, ...);
+#else
+#define debug_print(...)
+#endif
+
+#define min(X,Y) (((X) < (Y)) ? (X) : (Y))
+
+struct emu_smart_attribute
+{
+	uint8_t id;
+	uint16_t flags;
+	uint8_t threshold;
+	uint8_t current_value;
+	uint8_t worst_value;
+	uint64_t raw_value;
+};
+
+// the two WD20EFRX of the README output
+static const struct emu_smart_attribute TABLE_SMART_ATTRIBUTE[2][17] =
+{
+	{
+		{   1, 0x002F,  51, 200, 200, 0x000000000000 },
+		{   3, 0x0027,  21, 178, 172, 0x000000000FFB },
+		{   4, 0x0032,   0, 100, 100, 0x000000000035 },
+		{   5, 0x0033, 140, 200, 200, 0x000000000000 },
+		{   7, 0x002E,   0, 200, 200, 0x000000000000 },
+		{   9, 0x0032,   0, 100, 100, 0x000000000033 },
+		{  10, 0x0032,   0, 100, 253, 0x000000000000 },
+		{  11, 0x0032,   0, 100, 253, 0x000000000000 },
+		{  12, 0x0032,   0, 100, 100, 0x00000000002E },
+		{ 192, 0x0032,   0, 200, 200, 0x000000000008 },
+		{ 193, 0x0032,   0, 200, 200, 0x00000000005E },
+		{ 194, 0x0022,   0, 115, 109, 0x000000000020 },
+		{ 196, 0x0032,   0, 200, 200, 0x000000000000 },
+		{ 197, 0x0032,   0, 200, 200, 0x000000000000 },
+		{ 198, 0x0030,   0, 100, 253, 0x000000000000 },
+		{ 199, 0x0032,   0, 200, 200, 0x000000000000 },
+		{ 200, 0x0008,   0, 100, 253, 0x000000000000 },
+	},
+	{
+		{   1, 0x002F,  51, 200, 200, 0x000000000000 },
+		{   3, 0x0027,  21, 175, 173, 0x000000001081 },
+		{   4, 0x0032,   0, 100, 100, 0x000000000032 },
+		{   5, 0x0033, 140, 200, 200, 0x000000000000 },
+		{   7, 0x002E,   0, 200, 200, 0x000000000000 },
+		{   9, 0x0032,   0, 100, 100, 0x000000000034 },
+		{  10, 0x0032,   0, 100, 253, 0x000000000000 },
+		{  11, 0x0032,   0, 100, 253, 0x000000000000 },
+		{  12, 0x0032,   0, 100, 100, 0x00000000002B },
+		{ 192, 0x0032,   0, 200, 200, 0x000000000005 },
+		{ 193, 0x0032,   0, 200, 200, 0x000000000065 },
+		{ 194, 0x0022,   0, 116, 109, 0x00000000001F },
+		{ 196, 0x0032,   0, 200, 200, 0x000000000000 },
+		{ 197, 0x0032,   0, 200, 200, 0x000000000000 },
+		{ 198, 0x0030,   0, 100, 253, 0x000000000000 },
+		{ 199, 0x0032,   0, 200, 200, 0x000000000000 },
+		{ 200, 0x0008,   0, 100, 253, 0x000000000000 },
+	},
+};
+
+static const char *TABLE_DISK_SERIAL_NUMBER[2] =
+{
+	"     WD-WCC4M3NFRNP6",
+	"     WD-WCC4M0JTYKN6",
+};
+
+static const uint32_t HANDSHAKE_MAGIC[4] = { 0x3C75A80B, 0x0388E337, 0x689705F3, 0xE00C523A };
+
+static void write_u16_le(uint8_t *p, uint16_t d)
+{
+	p[0] = (uint8_t)(d >> 0);
+	p[1] = (uint8_t)(d >> 8);
+}
+
+static void write_u32_le(uint8_t *p, uint32_t d)
+{
+	p[0] = (uint8_t)(d >> 0);
+	p[1] = (uint8_t)(d >> 8);
+	p[2] = (uint8_t)(d >> 16);
+	p[3] = (uint8_t)(d >> 24);
+}
+
+static uint32_t read_u32_le(const uint8_t *p)
+{
+	return (p[0] << 0) | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+// space padded and byte swapped like the strings of ATA IDENTIFY
+static void write_ata_string(uint8_t *p, const char *str, uint32_t size)
+{
+	uint32_t len = (uint32_t)strlen(str);
+	uint32_t i;
+
+	for (i = 0; i < size; i++)
+	{
+		p[i ^ 1] = (i < len) ? (uint8_t)str[i] : ' ';
+	}
+}
+
+static void emu_delay(uint32_t latency)
+{
+	if (latency == 0)
+	{
+		return;
+	}
+#ifdef _WIN32
+	Sleep((latency + 999) / 1000);
+#else
+	{
+		struct timespec ts;
+		ts.tv_sec = latency / 1000000;
+		ts.tv_nsec = (latency % 1000000) * 1000;
+		nanosleep(&ts, NULL);
+	}
+#endif
+}
+
+static void emu_init_disk(struct emu_config *config, int port)
+{
+	uint8_t *p;
+	uint8_t sum;
+	int i;
+
+	config->is_disk_present[port] = true;
+	config->power_mode[port] = 0xFF;
+
+	p = config->ata_identify[port];
+	write_ata_string(p + 20, TABLE_DISK_SERIAL_NUMBER[port], 20);
+	write_ata_string(p + 46, "82.00A82", 8);
+	write_ata_string(p + 54, "WDC WD20EFRX-68EUZN0", 40);
+	write_u16_le(p + 83 * 2, 0x7400); // 48-bit address feature set
+	write_u16_le(p + 100 * 2, 0x88B0);
+	write_u16_le(p + 101 * 2, 0xE8E0);
+	p[510] = 0xA5;
+	for (sum = 0, i = 0; i < 511; i++)
+	{
+		sum += p[i];
+	}
+	p[511] = (uint8_t)(0 - sum);
+
+	for (i = 0; i < 17; i++)
+	{
+		const struct emu_smart_attribute *attribute = &TABLE_SMART_ATTRIBUTE[port][i];
+
+		p = config->ata_smart_data[port] + 2 + i * 12;
+		p[0] = attribute->id;
+		write_u16_le(p + 1, attribute->flags);
+		p[3] = attribute->current_value;
+		p[4] = attribute->worst_value;
+		write_u32_le(p + 5, (uint32_t)attribute->raw_value);
+		write_u16_le(p + 9, (uint16_t)(attribute->raw_value >> 32));
+
+		p = config->ata_smart_thresholds[port] + 2 + i * 12;
+		p[0] = attribute->id;
+		p[1] = attribute->threshold;
+	}
+	config->ata_smart_data[port][0] = 0x10;
+	config->ata_smart_thresholds[port][0] = 0x10;
+	for (sum = 0, i = 0; i < 511; i++)
+	{
+		sum += config->ata_smart_data[port][i];
+	}
+	config->ata_smart_data[port][511] = (uint8_t)(0 - sum);
+	for (sum = 0, i = 0; i < 511; i++)
+	{
+		sum += config->ata_smart_thresholds[port][i];
+	}
+	config->ata_smart_thresholds[port][511] = (uint8_t)(0 - sum);
+
+	// 1863.00 GB disk, 1862.97 GB of it in the RAID1
+	p = config->sata_info + 0x04 + port * 0x50;
+	write_ata_string(p + 0x00, "WDC WD20EFRX-68EUZN0", 0x28);
+	write_ata_string(p + 0x28, TABLE_DISK_SERIAL_NUMBER[port], 0x14);
+	write_u32_le(p + 0x3C, 59616);
+	p[0x41] = 0x02;
+	p[0x42] = 0;
+	p[0x43] = (uint8_t)port;
+	p[0x48] = 0x02;
+	p[0x49] = 15;
+	p[0x4A] = 3;
+
+	p = config->sata_port_info[port] + 0x04;
+	write_ata_string(p + 0x00, "WDC WD20EFRX-68EUZN0", 0x28);
+	write_ata_string(p + 0x28, TABLE_DISK_SERIAL_NUMBER[port], 0x14);
+	write_u32_le(p + 0x3C, 59616);
+	write_ata_string(p + 0x40, "82.00A82", 0x08);
+	p[0x5A] = 0;
+	p[0x60] = 0x02;
+	p[0xBD] = 0x02;
+	p[0xBE] = 0;
+	p[0xBF] = (uint8_t)port;
+	write_u32_le(p + 0xCC, 59615);
+
+	p = config->raid_port_info[0] + 0x04 + 0xA0 + port * 0x20;
+	p[0x00] = 1;
+	p[0x04] = 1;
+	p[0x06] = 0;
+	p[0x07] = (uint8_t)port;
+	write_u32_le(p + 0x08, 0);
+	write_u32_le(p + 0x0C, 59615);
+}
+
+void emu_init(struct emu *emu)
+{
+	struct emu_config *config = &emu->config;
+	uint8_t *p;
+	int i;
+
+	debug_print("emu_init\n");
+
+	memset(emu, 0, sizeof(struct emu));
+
+	config->vendor_id = 0x197B0562;
+
+	p = config->chip_info;
+	p[0] = 6;
+	p[1] = 1;
+	p[2] = 1;
+	p[3] = 20;
+	memcpy(p + 0x14, "HOTWAY H/W RAID", 15);
+	memcpy(p + 0x34, "HOTWAY", 6);
+	write_u32_le(p + 0xA0, 427491329);
+
+	emu_init_disk(config, 0);
+	emu_init_disk(config, 1);
+
+	config->log_page_count[0x00] = 1;
+	config->log_page_count[0x01] = 1;
+	config->log_page_count[0x03] = 4;
+	config->log_page_count[0x04] = 8;
+	config->log_page_count[0x06] = 1;
+	config->log_page_count[0x07] = 2;
+
+	config->sata_info[0x04 + 2 * 0x50 + 0x48] = 0x06;
+	config->sata_info[0x04 + 3 * 0x50 + 0x48] = 0x07;
+	for (i = 2; i < EMU_PORT_COUNT; i++)
+	{
+		config->sata_port_info[i][0x04 + 0x60] = 0x06;
+	}
+
+	p = config->raid_port_info[0] + 0x04;
+	write_ata_string(p + 0x00, "H/W RAID1", 0x28);
+	write_ata_string(p + 0x28, "EDB1BFFDF37MG3M1G15C", 0x14);
+	write_u32_le(p + 0x3C, 59615);
+	p[0x40] = 1;
+	p[0x42] = 3;
+	p[0x50] = 1;
+	p[0x51] = 2;
+	write_u16_le(p + 0x60, 0x1000);
+	write_u16_le(p + 0x62, 90);
+}
+
+void emu_reset(struct emu *emu)
+{
+	debug_print("emu_reset\n");
+
+	emu->handshake_state = 0;
+	emu->is_command_mode = false;
+	emu->is_read_failing = false;
+}
+
+static bool emu_is_handshake(const uint8_t *data, uint32_t *magic)
+{
+	if (read_u32_le(data + 0x000) != 0x197B0325)
+	{
+		return false;
+	}
+	if (read_u32_le(data + 0x1F8) != jmraid_calc_handshake_checksum(data, 0x1F8))
+	{
+		return false;
+	}
+	if (read_u32_le(data + 0x1FC) != jmraid_calc_crc(data, 0x1FC))
+	{
+		return false;
+	}
+	*magic = read_u32_le(data + 0x004);
+	return true;
+}
+
+static void emu_handshake(struct emu *emu, uint64_t sector, uint32_t magic)
+{
+	debug_print("emu_handshake | %llu | %08X\n", sector, magic);
+
+	// the sequence has to arrive in order and on the same sector, anything
+	// else starts it over
+	if ((emu->handshake_state != 0) && (emu->handshake_sector != sector))
+	{
+		emu->handshake_state = 0;
+	}
+	if (magic != HANDSHAKE_MAGIC[emu->handshake_state])
+	{
+		emu->handshake_state = 0;
+		if (magic != HANDSHAKE_MAGIC[0])
+		{
+			return;
+		}
+	}
+
+	emu->handshake_sector = sector;
+	emu->handshake_state++;
+	if (emu->handshake_state == 4)
+	{
+		emu->handshake_state = 0;
+		emu->is_command_mode = true;
+		emu->command_sector = sector;
+		emu->handshake_count++;
+	}
+}
+
+// a page of an ATA log: the directory or a pattern made of the port, the log
+// address and the page behind a revision word
+static bool emu_get_log_page(const struct emu_config *config, uint8_t port, uint8_t log_address, uint16_t page, uint8_t *data)
+{
+	int i;
+
+	if (page >= config->log_page_count[log_address])
+	{
+		return false;
+	}
+
+	memset(data, 0, SECTOR_SIZE);
+	if (log_address == 0x00)
+	{
+		write_u16_le(data, 0x0001);
+		for (i = 1; i < 256; i++)
+		{
+			write_u16_le(data + i * 2, config->log_page_count[i]);
+		}
+		return true;
+	}
+
+	for (i = 0; i < SECTOR_SIZE; i++)
+	{
+		data[i] = (uint8_t)(port * 0x40 + log_address * 0x11 + page * 0x07 + i);
+	}
+	write_u16_le(data, 0x0001);
+	data[2] = (uint8_t)page;
+
+	return true;
+}
+
+// any command but CHECK POWER MODE spins a disk in standby up
+static void emu_wake_disk(struct emu *emu, uint8_t port)
+{
+	struct emu_config *config = &emu->config;
+
+	if ((config->power_mode[port] == 0x00) || (config->power_mode[port] == 0x01))
+	{
+		config->power_mode[port] = 0xFF;
+		emu->spin_up_count++;
+	}
+}
+
+static uint8_t emu_ata_passthrough(struct emu *emu, const uint8_t *args, uint8_t *payload)
+{
+	struct emu_config *config = &emu->config;
+	const uint8_t *task_file = args + 4;
+	const uint8_t *source = NULL;
+	uint8_t log_data[SECTOR_SIZE];
+	uint8_t port = args[0];
+	uint32_t addr = args[2] * 2;
+	uint32_t size = args[3] * 2;
+
+	if ((port >= EMU_PORT_COUNT) || !config->is_disk_present[port])
+	{
+		return EMU_STATUS_INVALID;
+	}
+
+	if (task_file[14] == 0xE5)
+	{
+		// no data, the mode comes back in the sector count register
+		memcpy(payload + 0x04, task_file, 16);
+		payload[0x04 + 4] = config->power_mode[port];
+		return 0;
+	}
+
+	if ((task_file[14] == 0xB0) && (task_file[2] == 0xD4) && (task_file[8] == 0x4F) && (task_file[10] == 0xC2))
+	{
+		// SMART EXECUTE OFF-LINE IMMEDIATE, a self-test completes after nine
+		// SMART READ DATA commands; its progress is kept in the self-test
+		// status byte of the SMART data (byte 363)
+		uint8_t *status = &config->ata_smart_data[port][363];
+		if ((task_file[6] == 0x01) || (task_file[6] == 0x02))
+		{
+			*status = 0xF9;
+		}
+		else if ((task_file[6] == 0x7F) && ((*status >> 4) == 0x0F))
+		{
+			*status = 0x10;
+		}
+		else if (task_file[6] != 0x7F)
+		{
+			return EMU_STATUS_INVALID;
+		}
+		emu_wake_disk(emu, port);
+		memcpy(payload + 0x04, task_file, 16);
+		return 0;
+	}
+
+	if (task_file[14] == 0xEC)
+	{
+		source = config->ata_identify[port];
+	}
+	else if ((task_file[14] == 0xB0) && (task_file[8] == 0x4F) && (task_file[10] == 0xC2))
+	{
+		if (task_file[2] == 0xD0)
+		{
+			uint8_t *status = &config->ata_smart_data[port][363];
+			if (*status == 0xF1)
+			{
+				*status = 0x00;
+			}
+			else if ((*status >> 4) == 0x0F)
+			{
+				(*status)--;
+			}
+			source = config->ata_smart_data[port];
+		}
+		else if (task_file[2] == 0xD1)
+		{
+			source = config->ata_smart_thresholds[port];
+		}
+		else if ((task_file[2] == 0xD5) && emu_get_log_page(config, port, task_file[6], 0, log_data))
+		{
+			source = log_data;
+		}
+	}
+	else if ((task_file[14] == 0x2F) && emu_get_log_page(config, port, task_file[6], (uint16_t)(task_file[8] | (task_file[9] << 8)), log_data))
+	{
+		source = log_data;
+	}
+
+	if (!source)
+	{
+		return EMU_STATUS_INVALID;
+	}
+
+	emu_wake_disk(emu, port);
+
+	memcpy(payload + 0x04, task_file, 16);
+	if (addr < SECTOR_SIZE)
+	{
+		size = min(size, SECTOR_SIZE - addr);
+		size = min(size, EMU_PAYLOAD_SIZE - 0x14);
+		memcpy(payload + 0x14, source + addr, size);
+	}
+
+	return 0;
+}
+
+static uint8_t emu_execute(struct emu *emu, uint8_t group, uint8_t command, const uint8_t *args, uint8_t *payload)
+{
+	const struct emu_config *config = &emu->config;
+
+	if ((group == 0x01) && (command == 0x01))
+	{
+		memcpy(payload, config->chip_info, EMU_PAYLOAD_SIZE);
+		return 0;
+	}
+	if ((group == 0x02) && (command == 0x01))
+	{
+		memcpy(payload, config->sata_info, EMU_PAYLOAD_SIZE);
+		return 0;
+	}
+	if ((group == 0x02) && (command == 0x02) && (args[0] < EMU_PORT_COUNT))
+	{
+		memcpy(payload, config->sata_port_info[args[0]], EMU_PAYLOAD_SIZE);
+		return 0;
+	}
+	if ((group == 0x03) && (command == 0x02) && (args[0] < EMU_PORT_COUNT))
+	{
+		memcpy(payload, config->raid_port_info[args[0]], EMU_PAYLOAD_SIZE);
+		return 0;
+	}
+	if ((group == 0x02) && (command == 0x03))
+	{
+		return emu_ata_passthrough(emu, args, payload);
+	}
+
+	return EMU_STATUS_INVALID;
+}
+
+// returns false if the sector is not a valid command, the bridge then lets
+// the write through and the host reads back its own command
+static bool emu_command(struct emu *emu, const uint8_t *data, uint8_t *response)
+{
+	const struct emu_config *config = &emu->config;
+	uint8_t request[SECTOR_SIZE];
+	int fail_result = JMRAID_RESULT_OK;
+
+	jmraid_scramble(data, request, SECTOR_SIZE);
+
+	if (read_u32_le(request + SECTOR_SIZE - 4) != jmraid_calc_crc(request, SECTOR_SIZE - 4))
+	{
+		debug_print("emu_command crc error\n");
+		return false;
+	}
+	if (read_u32_le(request + 0x00) != config->vendor_id)
+	{
+		debug_print("emu_command vendor id mismatch %08X\n", read_u32_le(request + 0x00));
+		return false;
+	}
+
+	emu->command_count++;
+	if ((config->fail_every != 0) && ((emu->command_count % config->fail_every) == 0))
+	{
+		fail_result = config->fail_result;
+	}
+
+	debug_print("emu_command | %02X %02X | %d\n", request[0x09], request[0x0A], fail_result);
+
+	if (fail_result == JMRAID_RESULT_NO_RESPONSE)
+	{
+		return false;
+	}
+
+	memset(response, 0, SECTOR_SIZE);
+	write_u32_le(response + 0x00, config->vendor_id);
+	write_u32_le(response + 0x04, read_u32_le(request + 0x04) + (fail_result == JMRAID_RESULT_SEQ ? 1 : 0));
+	response[0x09] = request[0x09];
+	response[0x0A] = request[0x0A] ^ (fail_result == JMRAID_RESULT_COMMAND ? 0xFF : 0x00);
+	if (fail_result > 0)
+	{
+		response[0x0B] = (uint8_t)fail_result;
+	}
+	else
+	{
+		response[0x0B] = emu_execute(emu, request[0x09], request[0x0A], request + 0x0C, response + 0x0C);
+	}
+	write_u32_le(response + SECTOR_SIZE - 4, jmraid_calc_crc(response, SECTOR_SIZE - 4) ^ (fail_result == JMRAID_RESULT_CRC ? 1 : 0));
+
+	jmraid_scramble(response, response, SECTOR_SIZE);
+
+	emu->is_read_failing = (fail_result == JMRAID_RESULT_IO);
+
+	return true;
+}
+
+bool emu_read_sector(struct emu *emu, uint64_t sector, uint8_t *data)
+{
+	emu_delay(emu->config.read_latency);
+
+	if (emu->is_read_failing)
+	{
+		debug_print("emu_read_sector injected error\n");
+		emu->is_read_failing = false;
+		return false;
+	}
+
+	if (sector < EMU_SECTOR_COUNT)
+	{
+		memcpy(data, emu->sectors[sector], SECTOR_SIZE);
+	}
+	else
+	{
+		memset(data, 0, SECTOR_SIZE);
+	}
+
+	return true;
+}
+
+bool emu_write_sector(struct emu *emu, uint64_t sector, const uint8_t *data)
+{
+	uint8_t response[SECTOR_SIZE];
+	uint32_t magic;
+
+	emu_delay(emu->config.write_latency);
+
+	if (sector >= EMU_SECTOR_COUNT)
+	{
+		// beyond the backing store, accepted and dropped
+		return true;
+	}
+
+	if (emu_is_handshake(data, &magic))
+	{
+		emu_handshake(emu, sector, magic);
+	}
+	else if (emu->is_command_mode && (sector == emu->command_sector) && emu_command(emu, data, response))
+	{
+		memcpy(emu->sectors[sector], response, SECTOR_SIZE);
+		return true;
+	}
+
+	memcpy(emu->sectors[sector], data, SECTOR_SIZE);
+
+	return true;
+}
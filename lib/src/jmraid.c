@@ -1,4 +1,6 @@
 #include "jmraid.h"
+#include "commands.h"
+#include "crc.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -10,74 +12,6 @@ extern void debug_print(const char* format, ...);
 #define debug_print(...)
 #endif
 
-static const uint32_t TABLE_CRC_FAST[256] =
-{
-	0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9,
-	0x130476DC, 0x17C56B6B, 0x1A864DB2, 0x1E475005,
-	0x2608EDB8, 0x22C9F00F, 0x2F8AD6D6, 0x2B4BCB61,
-	0x350C9B64, 0x31CD86D3, 0x3C8EA00A, 0x384FBDBD,
-	0x4C11DB70, 0x48D0C6C7, 0x4593E01E, 0x4152FDA9,
-	0x5F15ADAC, 0x5BD4B01B, 0x569796C2, 0x52568B75,
-	0x6A1936C8, 0x6ED82B7F, 0x639B0DA6, 0x675A1011,
-	0x791D4014, 0x7DDC5DA3, 0x709F7B7A, 0x745E66CD,
-	0x9823B6E0, 0x9CE2AB57, 0x91A18D8E, 0x95609039,
-	0x8B27C03C, 0x8FE6DD8B, 0x82A5FB52, 0x8664E6E5,
-	0xBE2B5B58, 0xBAEA46EF, 0xB7A96036, 0xB3687D81,
-	0xAD2F2D84, 0xA9EE3033, 0xA4AD16EA, 0xA06C0B5D,
-	0xD4326D90, 0xD0F37027, 0xDDB056FE, 0xD9714B49,
-	0xC7361B4C, 0xC3F706FB, 0xCEB42022, 0xCA753D95,
-	0xF23A8028, 0xF6FB9D9F, 0xFBB8BB46, 0xFF79A6F1,
-	0xE13EF6F4, 0xE5FFEB43, 0xE8BCCD9A, 0xEC7DD02D,
-	0x34867077, 0x30476DC0, 0x3D044B19, 0x39C556AE,
-	0x278206AB, 0x23431B1C, 0x2E003DC5, 0x2AC12072,
-	0x128E9DCF, 0x164F8078, 0x1B0CA6A1, 0x1FCDBB16,
-	0x018AEB13, 0x054BF6A4, 0x0808D07D, 0x0CC9CDCA,
-	0x7897AB07, 0x7C56B6B0, 0x71159069, 0x75D48DDE,
-	0x6B93DDDB, 0x6F52C06C, 0x6211E6B5, 0x66D0FB02,
-	0x5E9F46BF, 0x5A5E5B08, 0x571D7DD1, 0x53DC6066,
-	0x4D9B3063, 0x495A2DD4, 0x44190B0D, 0x40D816BA,
-	0xACA5C697, 0xA864DB20, 0xA527FDF9, 0xA1E6E04E,
-	0xBFA1B04B, 0xBB60ADFC, 0xB6238B25, 0xB2E29692,
-	0x8AAD2B2F, 0x8E6C3698, 0x832F1041, 0x87EE0DF6,
-	0x99A95DF3, 0x9D684044, 0x902B669D, 0x94EA7B2A,
-	0xE0B41DE7, 0xE4750050, 0xE9362689, 0xEDF73B3E,
-	0xF3B06B3B, 0xF771768C, 0xFA325055, 0xFEF34DE2,
-	0xC6BCF05F, 0xC27DEDE8, 0xCF3ECB31, 0xCBFFD686,
-	0xD5B88683, 0xD1799B34, 0xDC3ABDED, 0xD8FBA05A,
-	0x690CE0EE, 0x6DCDFD59, 0x608EDB80, 0x644FC637,
-	0x7A089632, 0x7EC98B85, 0x738AAD5C, 0x774BB0EB,
-	0x4F040D56, 0x4BC510E1, 0x46863638, 0x42472B8F,
-	0x5C007B8A, 0x58C1663D, 0x558240E4, 0x51435D53,
-	0x251D3B9E, 0x21DC2629, 0x2C9F00F0, 0x285E1D47,
-	0x36194D42, 0x32D850F5, 0x3F9B762C, 0x3B5A6B9B,
-	0x0315D626, 0x07D4CB91, 0x0A97ED48, 0x0E56F0FF,
-	0x1011A0FA, 0x14D0BD4D, 0x19939B94, 0x1D528623,
-	0xF12F560E, 0xF5EE4BB9, 0xF8AD6D60, 0xFC6C70D7,
-	0xE22B20D2, 0xE6EA3D65, 0xEBA91BBC, 0xEF68060B,
-	0xD727BBB6, 0xD3E6A601, 0xDEA580D8, 0xDA649D6F,
-	0xC423CD6A, 0xC0E2D0DD, 0xCDA1F604, 0xC960EBB3,
-	0xBD3E8D7E, 0xB9FF90C9, 0xB4BCB610, 0xB07DABA7,
-	0xAE3AFBA2, 0xAAFBE615, 0xA7B8C0CC, 0xA379DD7B,
-	0x9B3660C6, 0x9FF77D71, 0x92B45BA8, 0x9675461F,
-	0x8832161A, 0x8CF30BAD, 0x81B02D74, 0x857130C3,
-	0x5D8A9099, 0x594B8D2E, 0x5408ABF7, 0x50C9B640,
-	0x4E8EE645, 0x4A4FFBF2, 0x470CDD2B, 0x43CDC09C,
-	0x7B827D21, 0x7F436096, 0x7200464F, 0x76C15BF8,
-	0x68860BFD, 0x6C47164A, 0x61043093, 0x65C52D24,
-	0x119B4BE9, 0x155A565E, 0x18197087, 0x1CD86D30,
-	0x029F3D35, 0x065E2082, 0x0B1D065B, 0x0FDC1BEC,
-	0x3793A651, 0x3352BBE6, 0x3E119D3F, 0x3AD08088,
-	0x2497D08D, 0x2056CD3A, 0x2D15EBE3, 0x29D4F654,
-	0xC5A92679, 0xC1683BCE, 0xCC2B1D17, 0xC8EA00A0,
-	0xD6AD50A5, 0xD26C4D12, 0xDF2F6BCB, 0xDBEE767C,
-	0xE3A1CBC1, 0xE760D676, 0xEA23F0AF, 0xEEE2ED18,
-	0xF0A5BD1D, 0xF464A0AA, 0xF9278673, 0xFDE69BC4,
-	0x89B8FD09, 0x8D79E0BE, 0x803AC667, 0x84FBDBD0,
-	0x9ABC8BD5, 0x9E7D9662, 0x933EB0BB, 0x97FFAD0C,
-	0xAFB010B1, 0xAB710D06, 0xA6322BDF, 0xA2F33668,
-	0xBCB4666D, 0xB8757BDA, 0xB5365D03, 0xB1F740B4
-};
-
 static void write_u32_le(uint8_t *p, uint32_t d)
 {
 	p[0] = (uint8_t)(d >> 0);
@@ -86,11 +20,6 @@ static void write_u32_le(uint8_t *p, uint32_t d)
 	p[3] = (uint8_t)(d >> 24);
 }
 
-static uint16_t read_u16_le(const uint8_t *p)
-{
-	return (p[0] << 0) | (p[1] << 8);
-}
-
 static uint32_t read_u32_le(const uint8_t *p)
 {
 	return (p[0] << 0) | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
@@ -98,123 +27,55 @@ static uint32_t read_u32_le(const uint8_t *p)
 
 static uint32_t calc_crc_fast(const uint8_t *data, uint32_t size)
 {
-	uint32_t crc;
-	uint32_t i;
-
-	crc = 0x52325032;
-	for (i = 0; i < size; i += 4)
-	{
-		crc = TABLE_CRC_FAST[(data[i + 3] ^ (crc >> 24)) & 0xFF] ^ (crc << 8);
-		crc = TABLE_CRC_FAST[(data[i + 2] ^ (crc >> 24)) & 0xFF] ^ (crc << 8);
-		crc = TABLE_CRC_FAST[(data[i + 1] ^ (crc >> 24)) & 0xFF] ^ (crc << 8);
-		crc = TABLE_CRC_FAST[(data[i + 0] ^ (crc >> 24)) & 0xFF] ^ (crc << 8);
-	}
-
-	return crc;
+	return crc_calc(CRC_SEED, data, size);
 }
 
+// Keystream of scramble(): the scrambler state is seeded with 0x52325032
+// and advanced independently of the data, so every word is simply XORed
+// with a fixed value (one sector worth, generated from the bitwise form).
+static const uint32_t TABLE_SCRAMBLE[SECTOR_SIZE / 4] =
+{
+	0x4467C108, 0x3D0D9104, 0x61DB449C, 0x5C0063BA,
+	0x19C47848, 0x1F8AC89F, 0x837FA38F, 0x717ACF08,
+	0xCD1DA489, 0xE132D2E7, 0xFAD4AD27, 0xEB99030E,
+	0x505083F7, 0xBE792D11, 0xE3F1B43C, 0x9F3BD98F,
+	0x67F3B0D9, 0x5DE09087, 0x60F0F9FF, 0x2E1A5561,
+	0x73AF5281, 0xC7AD25EE, 0x6BCE6E01, 0x74498D01,
+	0x7EED9E9C, 0xA2F33BE9, 0x39A0458E, 0x6B96CD0F,
+	0xB4A73C90, 0xBA726F5A, 0x1F586B08, 0xC62A4235,
+	0xA251F44F, 0x896E48A1, 0xC86D36E9, 0x3AEC123B,
+	0x372F89AD, 0x63DE1AAB, 0xEE74EF2F, 0xD151A9C7,
+	0x92AD63AE, 0xF198781B, 0xFABB40B6, 0x22F30722,
+	0xA346B795, 0x85162BCA, 0xC50A4140, 0xADC761F3,
+	0x651BFB53, 0xEE55C9AC, 0xA002C173, 0x1553FE29,
+	0x8DAD1F8F, 0xEF15DE77, 0xD81BF36B, 0xAAE39644,
+	0x10DC2A5A, 0x3CDA967B, 0x383DF28B, 0x2CF381A4,
+	0x54F54158, 0x739D4573, 0x2AE8FDC5, 0x5030C6BE,
+	0xA08F4F9E, 0xE94AED29, 0xCA03322F, 0x7A5BD813,
+	0xE6589DAE, 0x90227388, 0x416C430A, 0x1AC4175B,
+	0xEFF95E27, 0x23579F63, 0x7097276C, 0x7B5BA8F5,
+	0x370FA95D, 0xB28BFFAE, 0x28D9CAC8, 0x46B25B8E,
+	0x384080BE, 0x2CBBEEE4, 0x72C182D2, 0x4B4F115A,
+	0xF1B9E254, 0x3D539624, 0x50F18133, 0x71041A2E,
+	0x66BFF980, 0x226F9C69, 0xBB69D044, 0x988493AD,
+	0x3267AF74, 0xF3658FB9, 0x85F40F4B, 0xFFBAB5EF,
+	0x9E9EDAE1, 0x19A99632, 0xF7434FB8, 0x0F1C4CF6,
+	0xB667D2CE, 0x278DE3E3, 0x4C98271E, 0xFF5C3773,
+	0x64CA16AB, 0x6DC0917D, 0x1AF060AE, 0xF4E61243,
+	0xC2BAE8D6, 0xCEE62F9B, 0x8D6A0807, 0x31A76228,
+	0x9B4B3DE9, 0x1318195B, 0x08C1A9D2, 0x8C1262CE,
+	0x43E36412, 0x1C59E3BB, 0xB9CD7F57, 0xAB476572,
+	0xC161FEB8, 0x25ECC208, 0x891CB98E, 0xA7D26DDF,
+	0x5210A736, 0xAA2D212A, 0x77D13198, 0x403BA835
+};
+
 static void scramble(const uint8_t *data_in, uint8_t *data_out, uint32_t size)
 {
-	uint32_t v3;
-	uint32_t crc;
-	uint32_t data;
-	int i;
-	uint8_t data_bit[32];
-	uint8_t new_crc_bit[32];
-	uint8_t crc_bit[32];
+	uint32_t i;
 
-	crc = 0x52325032;
-	for (v3 = 0; v3 < size >> 2; v3++)
+	for (i = 0; i < size >> 2; i++)
 	{
-		for (i = 0; i < 32; i++)
-		{
-			crc_bit[i] = (uint8_t)((crc >> i) & 1);
-		}
-
-		data = ((uint32_t *)data_in)[v3];
-		for (i = 0; i < 32; i++)
-		{
-			data_bit[i] = (uint8_t)((data >> i) & 1);
-		}
-
-		data_bit[31] = data_bit[31] ^ crc_bit[27];
-		data_bit[30] = data_bit[30] ^ crc_bit[30];
-		data_bit[29] = data_bit[29] ^ crc_bit[23];
-		data_bit[28] = data_bit[28] ^ crc_bit[18];
-		data_bit[27] = data_bit[27] ^ crc_bit[8];
-		data_bit[26] = data_bit[26] ^ crc_bit[25];
-		data_bit[25] = data_bit[25] ^ crc_bit[3];
-		data_bit[24] = data_bit[24] ^ crc_bit[29];
-		data_bit[23] = data_bit[23] ^ crc_bit[9];
-		data_bit[22] = data_bit[22] ^ crc_bit[17];
-		data_bit[21] = data_bit[21] ^ crc_bit[1];
-		data_bit[20] = data_bit[20] ^ crc_bit[22];
-		data_bit[19] = data_bit[19] ^ crc_bit[10];
-		data_bit[18] = data_bit[18] ^ crc_bit[20];
-		data_bit[17] = data_bit[17] ^ crc_bit[5];
-		data_bit[16] = data_bit[16] ^ crc_bit[12];
-		data_bit[15] = data_bit[15] ^ crc_bit[28];
-		data_bit[14] = data_bit[14] ^ crc_bit[14];
-		data_bit[13] = data_bit[13] ^ crc_bit[2];
-		data_bit[12] = data_bit[12] ^ crc_bit[24];
-		data_bit[11] = data_bit[11] ^ crc_bit[15];
-		data_bit[10] = data_bit[10] ^ crc_bit[6];
-		data_bit[9] = data_bit[9] ^ crc_bit[26];
-		data_bit[8] = data_bit[8] ^ crc_bit[4];
-		data_bit[7] = data_bit[7] ^ crc_bit[19];
-		data_bit[6] = data_bit[6] ^ crc_bit[0];
-		data_bit[5] = data_bit[5] ^ crc_bit[16];
-		data_bit[4] = data_bit[4] ^ crc_bit[7];
-		data_bit[3] = data_bit[3] ^ crc_bit[21];
-		data_bit[2] = data_bit[2] ^ crc_bit[13];
-		data_bit[1] = data_bit[1] ^ crc_bit[31];
-		data_bit[0] = data_bit[0] ^ crc_bit[11];
-
-		data = 0;
-		for (i = 31; i >= 0; i--)
-		{
-			data = (data << 1) | data_bit[i];
-		}
-		((uint32_t *)data_out)[v3] = data;
-
-		new_crc_bit[31] = crc_bit[5] ^ crc_bit[8] ^ crc_bit[9] ^ crc_bit[11] ^ crc_bit[15] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[27] ^ crc_bit[28] ^ crc_bit[29] ^ crc_bit[30] ^ crc_bit[31];
-		new_crc_bit[30] = crc_bit[4] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[10] ^ crc_bit[14] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[28] ^ crc_bit[29] ^ crc_bit[30];
-		new_crc_bit[29] = crc_bit[3] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[9] ^ crc_bit[13] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[25] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[29] ^ crc_bit[31] ^ crc_bit[28];
-		new_crc_bit[28] = crc_bit[2] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[8] ^ crc_bit[12] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[27] ^ crc_bit[28] ^ crc_bit[30] ^ crc_bit[26];
-		new_crc_bit[27] = crc_bit[1] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[7] ^ crc_bit[11] ^ crc_bit[19] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[29];
-		new_crc_bit[26] = crc_bit[0] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[6] ^ crc_bit[10] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[20] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[28] ^ crc_bit[31] ^ crc_bit[25];
-		new_crc_bit[25] = crc_bit[2] ^ crc_bit[3] ^ crc_bit[8] ^ crc_bit[11] ^ crc_bit[15] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[29] ^ crc_bit[31] ^ crc_bit[28];
-		new_crc_bit[24] = crc_bit[1] ^ crc_bit[2] ^ crc_bit[7] ^ crc_bit[10] ^ crc_bit[14] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[27] ^ crc_bit[28] ^ crc_bit[30];
-		new_crc_bit[23] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[6] ^ crc_bit[9] ^ crc_bit[13] ^ crc_bit[15] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[19] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[29] ^ crc_bit[31] ^ crc_bit[20];
-		new_crc_bit[22] = crc_bit[0] ^ crc_bit[9] ^ crc_bit[11] ^ crc_bit[12] ^ crc_bit[14] ^ crc_bit[16] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[29] ^ crc_bit[31] ^ crc_bit[23];
-		new_crc_bit[21] = crc_bit[5] ^ crc_bit[9] ^ crc_bit[10] ^ crc_bit[13] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[22] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[29] ^ crc_bit[31];
-		new_crc_bit[20] = crc_bit[4] ^ crc_bit[8] ^ crc_bit[9] ^ crc_bit[12] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[21] ^ crc_bit[23] ^ crc_bit[25] ^ crc_bit[26] ^ crc_bit[28] ^ crc_bit[30];
-		new_crc_bit[19] = crc_bit[3] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[11] ^ crc_bit[15] ^ crc_bit[16] ^ crc_bit[20] ^ crc_bit[22] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[27] ^ crc_bit[29];
-		new_crc_bit[18] = crc_bit[2] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[10] ^ crc_bit[14] ^ crc_bit[15] ^ crc_bit[19] ^ crc_bit[21] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[28] ^ crc_bit[31];
-		new_crc_bit[17] = crc_bit[1] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[9] ^ crc_bit[13] ^ crc_bit[14] ^ crc_bit[18] ^ crc_bit[20] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[27] ^ crc_bit[30] ^ crc_bit[31] ^ crc_bit[25];
-		new_crc_bit[16] = crc_bit[0] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[8] ^ crc_bit[12] ^ crc_bit[13] ^ crc_bit[17] ^ crc_bit[19] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[29] ^ crc_bit[30];
-		new_crc_bit[15] = crc_bit[3] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[9] ^ crc_bit[12] ^ crc_bit[15] ^ crc_bit[16] ^ crc_bit[18] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[24] ^ crc_bit[27] ^ crc_bit[30];
-		new_crc_bit[14] = crc_bit[2] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[11] ^ crc_bit[14] ^ crc_bit[15] ^ crc_bit[17] ^ crc_bit[19] ^ crc_bit[20] ^ crc_bit[23] ^ crc_bit[26] ^ crc_bit[29];
-		new_crc_bit[13] = crc_bit[1] ^ crc_bit[2] ^ crc_bit[3] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[10] ^ crc_bit[13] ^ crc_bit[14] ^ crc_bit[16] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[22] ^ crc_bit[25] ^ crc_bit[28] ^ crc_bit[31];
-		new_crc_bit[12] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[2] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[9] ^ crc_bit[12] ^ crc_bit[13] ^ crc_bit[15] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[21] ^ crc_bit[24] ^ crc_bit[27] ^ crc_bit[30] ^ crc_bit[31];
-		new_crc_bit[11] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[9] ^ crc_bit[12] ^ crc_bit[14] ^ crc_bit[15] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[20] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[28] ^ crc_bit[31];
-		new_crc_bit[10] = crc_bit[0] ^ crc_bit[2] ^ crc_bit[3] ^ crc_bit[5] ^ crc_bit[9] ^ crc_bit[13] ^ crc_bit[14] ^ crc_bit[16] ^ crc_bit[19] ^ crc_bit[26] ^ crc_bit[29] ^ crc_bit[31] ^ crc_bit[28];
-		new_crc_bit[9] = crc_bit[1] ^ crc_bit[2] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[9] ^ crc_bit[11] ^ crc_bit[12] ^ crc_bit[13] ^ crc_bit[18] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[29];
-		new_crc_bit[8] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[8] ^ crc_bit[10] ^ crc_bit[11] ^ crc_bit[12] ^ crc_bit[17] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[28] ^ crc_bit[31];
-		new_crc_bit[7] = crc_bit[0] ^ crc_bit[2] ^ crc_bit[3] ^ crc_bit[5] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[10] ^ crc_bit[15] ^ crc_bit[16] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[28] ^ crc_bit[29] ^ crc_bit[25];
-		new_crc_bit[6] = crc_bit[1] ^ crc_bit[2] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[11] ^ crc_bit[14] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[25] ^ crc_bit[29] ^ crc_bit[30];
-		new_crc_bit[5] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[10] ^ crc_bit[13] ^ crc_bit[19] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[24] ^ crc_bit[28] ^ crc_bit[29];
-		new_crc_bit[4] = crc_bit[0] ^ crc_bit[2] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[6] ^ crc_bit[8] ^ crc_bit[11] ^ crc_bit[12] ^ crc_bit[15] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[20] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[29] ^ crc_bit[30] ^ crc_bit[31];
-		new_crc_bit[3] = crc_bit[1] ^ crc_bit[2] ^ crc_bit[3] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[9] ^ crc_bit[10] ^ crc_bit[14] ^ crc_bit[15] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[25] ^ crc_bit[27] ^ crc_bit[31];
-		new_crc_bit[2] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[2] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[9] ^ crc_bit[13] ^ crc_bit[14] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[30] ^ crc_bit[31];
-		new_crc_bit[1] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[9] ^ crc_bit[11] ^ crc_bit[12] ^ crc_bit[13] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[24] ^ crc_bit[27] ^ crc_bit[28];
-		new_crc_bit[0] = crc_bit[0] ^ crc_bit[6] ^ crc_bit[9] ^ crc_bit[10] ^ crc_bit[12] ^ crc_bit[16] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[26] ^ crc_bit[28] ^ crc_bit[29] ^ crc_bit[30] ^ crc_bit[31];
-
-		crc = 0;
-		for (i = 31; i >= 0; i--)
-		{
-			crc = (crc << 1) | new_crc_bit[i];
-		}
+		((uint32_t *)data_out)[i] = ((const uint32_t *)data_in)[i] ^ TABLE_SCRAMBLE[i];
 	}
 }
 
@@ -230,173 +91,98 @@ static uint32_t calc_handshake_checksum(const void *data, uint32_t size)
 	return 0 - crc;
 }
 
-static void swap_bytes(uint8_t *data, uint32_t size)
-{
-	while (size > 1)
-	{
-		uint8_t temp;
-		temp = data[0];
-		data[0] = data[1];
-		data[1] = temp;
-		data += 2;
-		size -= 2;
-	}
-}
+// the parsed structs have room for every field of the views
+JMRAID_CHIP_INFO_FIELDS(JMRAID_VIEW_CHECK_DST, jmraid_chip_info_view, struct jmraid_chip_info)
+JMRAID_SATA_INFO_ITEM_FIELDS(JMRAID_VIEW_CHECK_DST, jmraid_sata_info_item_view, struct jmraid_sata_info_item)
+JMRAID_SATA_PORT_INFO_FIELDS(JMRAID_VIEW_CHECK_DST, jmraid_sata_port_info_view, struct jmraid_sata_port_info)
+JMRAID_RAID_PORT_INFO_FIELDS(JMRAID_VIEW_CHECK_DST, jmraid_raid_port_info_view, struct jmraid_raid_port_info)
+JMRAID_RAID_PORT_INFO_MEMBER_FIELDS(JMRAID_VIEW_CHECK_DST, jmraid_raid_port_info_member_view, struct jmraid_raid_port_info_member)
+JMRAID_SMART_ATTRIBUTE_FIELDS(JMRAID_VIEW_CHECK_DST, jmraid_smart_attribute_view, struct jmraid_disk_smart_info_attribute)
+JMRAID_SMART_THRESHOLD_FIELDS(JMRAID_VIEW_CHECK_DST, jmraid_smart_attribute_view, struct jmraid_disk_smart_info_attribute)
 
 void parse_jmraid_chip_info(const uint8_t *src, struct jmraid_chip_info *dst)
 {
-	const uint8_t *p = src;
+	struct jmraid_chip_info_view view = jmraid_chip_info_view(src);
 
 	debug_print("parse_jmraid_chip_info\n");
 
+	// callers compare whole structs (see cache.c), padding included
 	memset(dst, 0, sizeof(struct jmraid_chip_info));
 
-	dst->firmware_version[0] = p[0];
-	dst->firmware_version[1] = p[1];
-	dst->firmware_version[2] = p[2];
-	dst->firmware_version[3] = p[3];
-	memcpy(dst->product_name, p + 0x14, 0x20);
-	memcpy(dst->manufacturer, p + 0x34, 0x20);
-	dst->serial_number = read_u32_le(p + 0xA0);
+	JMRAID_CHIP_INFO_FIELDS(JMRAID_VIEW_PARSE, jmraid_chip_info_view, dst)
 }
 
 void parse_jmraid_sata_info(const uint8_t *src, struct jmraid_sata_info *dst)
 {
-	const uint8_t *p = src;
 	int i;
 
 	debug_print("parse_jmraid_sata_info\n");
 
 	memset(dst, 0, sizeof(struct jmraid_sata_info));
 
-	p += 0x04;
 	for (i = 0; i < 5; i++)
 	{
-		struct jmraid_sata_info_item *item = &dst->item[i];
-		memcpy(item->model_name, p + 0x00, 0x28);
-		swap_bytes(item->model_name, 0x28);
-		memcpy(item->serial_number, p + 0x28, 0x14);
-		swap_bytes(item->serial_number, 0x14);
-		item->capacity = ((uint64_t)read_u32_le(p + 0x3C)) * (32 * 1024 * 1024);
-		item->port_type = p[0x48];
-		item->port_speed = p[0x4A];
-		item->page_0_state = p[0x41];
-		item->page_0_raid_index = p[0x42];
-		item->page_0_raid_member_index = p[0x43];
-		item->port = p[0x49];
-		p += 0x50;
+		struct jmraid_sata_info_item_view view = jmraid_sata_info_view_item(src, i);
+		JMRAID_SATA_INFO_ITEM_FIELDS(JMRAID_VIEW_PARSE, jmraid_sata_info_item_view, &dst->item[i])
 	}
 }
 
 void parse_jmraid_sata_port_info(const uint8_t *src, struct jmraid_sata_port_info *dst)
 {
-	const uint8_t *p = src;
+	struct jmraid_sata_port_info_view view = jmraid_sata_port_info_view(src);
 
 	debug_print("parse_jmraid_sata_port_info\n");
 
 	memset(dst, 0, sizeof(struct jmraid_sata_port_info));
 
-	p += 0x04;
-	memcpy(dst->model_name, p + 0x00, 0x28);
-	swap_bytes(dst->model_name, 0x28);
-	memcpy(dst->serial_number, p + 0x28, 0x14);
-	swap_bytes(dst->serial_number, 0x14);
-	memcpy(dst->firmware_version, p + 0x40, 0x08);
-	swap_bytes(dst->firmware_version, 0x08);
-	dst->capacity = ((uint64_t)read_u32_le(p + 0x3C)) * (32 * 1024 * 1024);
-	dst->port_type = p[0x60];
-	dst->port = p[0x5A];
-	dst->capacity_used = ((uint64_t)read_u32_le(p + 0xCC)) * (32 * 1024 * 1024);
-	dst->page_0_state = p[0xBD];
-	dst->page_0_raid_index = p[0xBE];
-	dst->page_0_raid_member_index = p[0xBF];
+	JMRAID_SATA_PORT_INFO_FIELDS(JMRAID_VIEW_PARSE, jmraid_sata_port_info_view, dst)
+}
+
+static void parse_jmraid_raid_port_info_member(struct jmraid_raid_port_info_member_view view, struct jmraid_raid_port_info_member *dst)
+{
+	JMRAID_RAID_PORT_INFO_MEMBER_FIELDS(JMRAID_VIEW_PARSE, jmraid_raid_port_info_member_view, dst)
 }
 
 void parse_jmraid_raid_port_info(const uint8_t *src, struct jmraid_raid_port_info *dst)
 {
-	const uint8_t *p = src;
+	struct jmraid_raid_port_info_view view = jmraid_raid_port_info_view(src);
 	int i;
 
 	debug_print("parse_jmraid_raid_port_info\n");
 
 	memset(dst, 0, sizeof(struct jmraid_raid_port_info));
 
-	p += 0x04;
-	dst->port_state = p[0x40];
-	memcpy(dst->model_name, p + 0x00, 0x28);
-	swap_bytes(dst->model_name, 0x28);
-	memcpy(dst->serial_number, p + 0x28, 0x14);
-	swap_bytes(dst->serial_number, 0x14);
-	dst->level = p[0x50];
-	dst->capacity = ((uint64_t)read_u32_le(p + 0x3C)) * (32 * 1024 * 1024);
-	dst->state = p[0x42];
-	dst->member_count = p[0x51];
-	dst->rebuild_priority = read_u16_le(p + 0x60);
-	dst->standby_timer = read_u16_le(p + 0x62) * 10;
-	memcpy(dst->password, p + 0x78, 0x08);
-	dst->rebuild_progress = ((uint64_t)read_u32_le(p + 0x5C)) * (32 * 1024 * 1024);
-
-	p += 0xA0;
+	JMRAID_RAID_PORT_INFO_FIELDS(JMRAID_VIEW_PARSE, jmraid_raid_port_info_view, dst)
+
 	for (i = 0; i < 5; i++)
 	{
-		struct jmraid_raid_port_info_member *member = &dst->member[i];
-		member->ready = p[0x00];
-		member->lba48_support = p[0x04];
-		member->sata_page = p[0x06];
-		member->sata_port = p[0x07];
-		member->sata_base = read_u32_le(p + 0x08);
-		member->sata_size = ((uint64_t)read_u32_le(p + 0x0C)) * (32 * 1024 * 1024);
-		p += 0x20;
+		parse_jmraid_raid_port_info_member(jmraid_raid_port_info_view_member(view, i), &dst->member[i]);
 	}
 }
 
 void parse_jmraid_disk_smart_info(const uint8_t *src1, const uint8_t *src2, struct jmraid_disk_smart_info *dst)
 {
+	int i;
+
 	debug_print("parse_jmraid_disk_smart_info\n");
 
 	memset(dst, 0, sizeof(struct jmraid_disk_smart_info));
 
-	if (src1)
+	for (i = 0; src1 && (i < 30); i++)
 	{
-		const uint8_t *p = src1;
-		int i;
-
-		p += 0x14;
-		p += 0x02;
-		for (i = 0; i < 30; i++)
+		struct jmraid_smart_attribute_view view = jmraid_smart_view_attribute(src1, i);
+		if (jmraid_smart_attribute_view_id(view) != 0)
 		{
-			// 00h | 1 | Attribute ID Number (01h to FFh)
-			// 01h | 2 | Status Flags 2
-			// 03h | 1 | Attribute Value (valid values from 01h to FDh)
-			// 04h | 8 | Vendor specific
-			if (p[0] != 0)
-			{
-				struct jmraid_disk_smart_info_attribute *attribute = &dst->attribute[i];
-				attribute->id = p[0];
-				attribute->flags = read_u16_le(p + 1);
-				attribute->current_value = p[3];
-				attribute->worst_value = p[4];
-				attribute->raw_value = read_u32_le(p + 5) | ((uint64_t)read_u16_le(p + 9) << 32);
-			}
-			p += 0x0C;
+			JMRAID_SMART_ATTRIBUTE_FIELDS(JMRAID_VIEW_PARSE, jmraid_smart_attribute_view, &dst->attribute[i])
 		}
 	}
 
-	if (src2)
+	for (i = 0; src2 && (i < 30); i++)
 	{
-		const uint8_t *p = src2;
-		int i;
-
-		p += 0x14;
-		p += 0x02;
-		for (i = 0; i < 30; i++)
+		struct jmraid_smart_attribute_view view = jmraid_smart_view_attribute(src2, i);
+		if (jmraid_smart_attribute_view_id(view) != 0)
 		{
-			if (p[0] != 0)
-			{
-				struct jmraid_disk_smart_info_attribute *attribute = &dst->attribute[i];
-				attribute->threshold = p[1];
-			}
-			p += 0x0C;
+			JMRAID_SMART_THRESHOLD_FIELDS(JMRAID_VIEW_PARSE, jmraid_smart_attribute_view, &dst->attribute[i])
 		}
 	}
 }
@@ -404,6 +190,7 @@ void parse_jmraid_disk_smart_info(const uint8_t *src1, const uint8_t *src2, stru
 void jmraid_init(struct jmraid *jmraid)
 {
 	debug_print("jmraid_init\n");
+	crc_init();
 	memset(jmraid, 0, sizeof(struct jmraid));
 	disk_init(&jmraid->disk);
 	jmraid->unused_sector = (uint64_t)-1;
@@ -499,6 +286,36 @@ void jmraid_set_vendor_id(struct jmraid *jmraid, uint32_t vendor_id)
 	jmraid->vendor_id = vendor_id;
 }
 
+void jmraid_set_disk_backend(struct jmraid *jmraid, enum disk_backend backend)
+{
+	debug_print("jmraid_set_disk_backend | %s\n", disk_get_backend_name(backend));
+	disk_set_backend(&jmraid->disk, backend);
+}
+
+void jmraid_set_disk_timeout(struct jmraid *jmraid, uint32_t timeout)
+{
+	debug_print("jmraid_set_disk_timeout | %u\n", timeout);
+	disk_set_timeout(&jmraid->disk, timeout);
+}
+
+void jmraid_set_strict(struct jmraid *jmraid, bool is_strict)
+{
+	debug_print("jmraid_set_strict | %d\n", is_strict);
+	jmraid->is_strict = is_strict;
+}
+
+void jmraid_set_power_mode_check(struct jmraid *jmraid, bool is_checked)
+{
+	debug_print("jmraid_set_power_mode_check | %d\n", is_checked);
+	jmraid->is_power_mode_checked = is_checked;
+}
+
+void jmraid_set_smart_fresh(struct jmraid *jmraid, bool is_fresh_required)
+{
+	debug_print("jmraid_set_smart_fresh | %d\n", is_fresh_required);
+	jmraid->is_smart_fresh_required = is_fresh_required;
+}
+
 bool jmraid_find_unused_sector(struct jmraid *jmraid, uint32_t num, uint64_t *sector)
 {
 	uint32_t sector_max;
@@ -632,6 +449,7 @@ bool jmraid_prepare_unused_sector(struct jmraid *jmraid)
 
 	debug_print("jmraid_prepare_unused_sector\n");
 
+	jmraid->handshake_count++;
 	for (i = 0; i < 4; i++)
 	{
 		if (!jmraid_send_handshake(jmraid, magic[i]))
@@ -708,6 +526,82 @@ bool jmraid_close(struct jmraid *jmraid)
 	return true;
 }
 
+bool jmraid_session_open(struct jmraid *jmraid, const char *disk_name, uint32_t vendor_id)
+{
+	debug_print("jmraid_session_open | %s | %08X\n", disk_name, vendor_id);
+
+	if (!jmraid_open(jmraid, disk_name, vendor_id))
+	{
+		debug_print("jmraid_open failed\n");
+		return false;
+	}
+
+	if (vendor_id == 0)
+	{
+		if (!jmraid_detect_vendor_id(jmraid, &vendor_id))
+		{
+			debug_print("jmraid_detect_vendor_id failed\n");
+			jmraid_close(jmraid);
+			return false;
+		}
+		jmraid_set_vendor_id(jmraid, vendor_id);
+	}
+
+	jmraid->is_session = true;
+
+	return true;
+}
+
+bool jmraid_session_check(struct jmraid *jmraid)
+{
+	struct jmraid_chip_info chip_info;
+
+	debug_print("jmraid_session_check\n");
+
+	if (jmraid_get_chip_info(jmraid, &chip_info))
+	{
+		return true;
+	}
+
+	// never worked or the retry failed too, start over once more
+	if ((jmraid->last_result == JMRAID_RESULT_IO) || !jmraid_prepare_unused_sector(jmraid))
+	{
+		debug_print("jmraid_prepare_unused_sector failed\n");
+		return false;
+	}
+
+	return jmraid_get_chip_info(jmraid, &chip_info);
+}
+
+bool jmraid_session_close(struct jmraid *jmraid)
+{
+	debug_print("jmraid_session_close\n");
+
+	jmraid->is_session = false;
+
+	return jmraid_close(jmraid);
+}
+
+int jmraid_get_last_result(struct jmraid *jmraid)
+{
+	return jmraid->last_result;
+}
+
+void jmraid_get_stats(struct jmraid *jmraid, struct jmraid_stats *stats)
+{
+	memcpy(stats, &jmraid->stats, sizeof(struct jmraid_stats));
+	stats->handshake_count = jmraid->handshake_count;
+	disk_get_stats(&jmraid->disk, &stats->disk);
+}
+
+void jmraid_reset_stats(struct jmraid *jmraid)
+{
+	debug_print("jmraid_reset_stats\n");
+	memset(&jmraid->stats, 0, sizeof(struct jmraid_stats));
+	jmraid->handshake_count = 0;
+	disk_reset_stats(&jmraid->disk);
+}
+
 bool jmraid_detect_vendor_id(struct jmraid *jmraid, uint32_t *vendor_id)
 {
 	struct jmraid_chip_info chip_info;
@@ -764,17 +658,77 @@ bool jmraid_send_handshake(struct jmraid *jmraid, uint32_t magic)
 	return true;
 }
 
+void jmraid_scramble(const uint8_t *data_in, uint8_t *data_out, uint32_t size)
+{
+	scramble(data_in, data_out, size);
+}
+
+uint32_t jmraid_calc_crc(const uint8_t *data, uint32_t size)
+{
+	return calc_crc_fast(data, size);
+}
+
+uint32_t jmraid_calc_handshake_checksum(const void *data, uint32_t size)
+{
+	return calc_handshake_checksum(data, size);
+}
+
 #define min(X,Y) (((X) < (Y)) ? (X) : (Y))
 
-bool jmraid_invoke_command(struct jmraid *jmraid, const uint8_t *data_in, uint32_t size_in, uint8_t *data_out, uint32_t size_out)
+static struct jmraid_command_stats *jmraid_get_command_stats(struct jmraid *jmraid, uint8_t group, uint8_t command)
 {
-	uint8_t sector_data[SECTOR_SIZE];
+	struct jmraid_stats *stats = &jmraid->stats;
+	uint32_t i;
 
-	debug_print("jmraid_invoke_command | %02X %02X\n", data_in[0], data_in[1]);
+	for (i = 0; i < stats->command_count; i++)
+	{
+		if ((stats->command[i].group == group) && (stats->command[i].command == command))
+		{
+			return &stats->command[i];
+		}
+	}
+
+	if (stats->command_count == JMRAID_STATS_MAX_COMMANDS)
+	{
+		return NULL;
+	}
+
+	stats->command[i].group = group;
+	stats->command[i].command = command;
+	stats->command_count++;
+
+	return &stats->command[i];
+}
+
+static void jmraid_add_command_result(struct jmraid *jmraid, struct jmraid_command_stats *stats, int result)
+{
+	if ((result < 0) && (result > -JMRAID_STATS_ERROR_CODES))
+	{
+		stats->error_count[-result]++;
+	}
+	else if (result > 0)
+	{
+		stats->status_error_count++;
+		jmraid->stats.status_count[result & 0xFF]++;
+	}
+}
+
+void jmraid_prepare_command(struct jmraid *jmraid, struct jmraid_command *command, const uint8_t *data_in, uint32_t size_in)
+{
+	uint8_t *sector_data = command->sector_data;
+
+	debug_print("jmraid_prepare_command | %02X %02X | %u\n", data_in[0], data_in[1], jmraid->seq_id);
+
+	// every command gets its own id, so a response left over from an
+	// earlier command can not be taken for the answer to this one
+	command->seq_id = jmraid->seq_id++;
+	command->group = data_in[0];
+	command->command = data_in[1];
+	command->size_in = size_in;
 
 	memset(sector_data, 0, SECTOR_SIZE);
 	write_u32_le(sector_data + 0x00, jmraid->vendor_id);
-	write_u32_le(sector_data + 0x04, jmraid->seq_id);
+	write_u32_le(sector_data + 0x04, command->seq_id);
 	sector_data[0x09] = data_in[0];
 	sector_data[0x0A] = data_in[1];
 	sector_data[0x0B] = 0xFF;
@@ -782,266 +736,673 @@ bool jmraid_invoke_command(struct jmraid *jmraid, const uint8_t *data_in, uint32
 	write_u32_le(sector_data + SECTOR_SIZE - 4, calc_crc_fast(sector_data, SECTOR_SIZE - 4));
 
 	scramble(sector_data, sector_data, SECTOR_SIZE);
+}
 
-	if (!disk_write_sector(&jmraid->disk, jmraid->unused_sector, sector_data))
-	{
-		debug_print("disk_write_sector failed\n");
-		return false;
-	}
-
-	if (!disk_read_sector(&jmraid->disk, jmraid->unused_sector, sector_data))
-	{
-		debug_print("disk_read_sector failed\n");
-		return false;
-	}
-
+static int jmraid_check_response(const struct jmraid_command *command, struct jmraid_command_stats *stats, uint8_t *sector_data)
+{
 	scramble(sector_data, sector_data, SECTOR_SIZE);
 
 	if (read_u32_le(sector_data + SECTOR_SIZE - 4) != calc_crc_fast(sector_data, SECTOR_SIZE - 4))
 	{
 		debug_print("invoke command response error -1\n");
-		return false;
+		return JMRAID_RESULT_CRC;
 	}
 
-	if (read_u32_le(sector_data + 0x04) != jmraid->seq_id)
+	if (read_u32_le(sector_data + 0x04) != command->seq_id)
 	{
 		debug_print("invoke command response error -2\n");
-		return false;
+		return JMRAID_RESULT_SEQ;
 	}
 
-	if ((sector_data[0x09] != data_in[0x00]) || (sector_data[0x0A] != data_in[0x01]))
+	if ((sector_data[0x09] != command->group) || (sector_data[0x0A] != command->command))
 	{
 		debug_print("invoke command response command error -3\n");
-		return false;
+		return JMRAID_RESULT_COMMAND;
+	}
+
+	if (sector_data[0x0B] == 0xFF)
+	{
+		// our own command sector came back, nobody processed it
+		debug_print("invoke command no response\n");
+		return JMRAID_RESULT_NO_RESPONSE;
 	}
 
 	if (sector_data[0x0B] != 0)
 	{
 		debug_print("invoke command response command error %d\n", sector_data[0x0B]);
-		return false;
+		return sector_data[0x0B];
 	}
 
-	size_out = min(size_out, SECTOR_SIZE - 0x10);
-	memcpy(data_out, sector_data + 0x0C, size_out);
+	stats->bytes_out += JMRAID_PAYLOAD_SIZE;
 
-	return true;
+	return JMRAID_RESULT_OK;
 }
 
-bool jmraid_invoke_command_get_chip_info(struct jmraid *jmraid, uint8_t *data_out, uint32_t size_out)
+static int jmraid_submit_command_once(struct jmraid *jmraid, const struct jmraid_command *command, struct jmraid_command_stats *stats, uint8_t *sector_data)
 {
-	uint8_t data_in[2];
-
-	debug_print("jmraid_invoke_command_get_chip_info\n");
-
-	data_in[0] = 0x01;
-	data_in[1] = 0x01;
+	if (!disk_write_sector(&jmraid->disk, jmraid->unused_sector, command->sector_data))
+	{
+		debug_print("disk_write_sector failed\n");
+		return JMRAID_RESULT_IO;
+	}
+	stats->bytes_in += command->size_in;
 
-	if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
+	if (!disk_read_sector(&jmraid->disk, jmraid->unused_sector, sector_data))
 	{
-		debug_print("jmraid_invoke_command failed\n");
-		return false;
+		debug_print("disk_read_sector failed\n");
+		return JMRAID_RESULT_IO;
 	}
 
-	return true;
+	return jmraid_check_response(command, stats, sector_data);
 }
 
-bool jmraid_invoke_command_get_sata_info(struct jmraid *jmraid, uint8_t *data_out, uint32_t size_out)
+// writes the command and leaves the descrambled response in sector_data
+static int jmraid_submit_command_sector(struct jmraid *jmraid, const struct jmraid_command *command, uint8_t *sector_data)
 {
-	uint8_t data_in[2];
+	struct jmraid_command_stats *stats;
+	struct jmraid_command_stats overflow_stats;
+	uint64_t write_time;
+	uint64_t read_time;
+	uint64_t start;
+	uint64_t time;
+	int result;
+
+	debug_print("jmraid_submit_command | %02X %02X | %u\n", command->group, command->command, command->seq_id);
+
+	stats = jmraid_get_command_stats(jmraid, command->group, command->command);
+	if (!stats)
+	{
+		// table full, still run through the same code but drop the numbers
+		memset(&overflow_stats, 0, sizeof(overflow_stats));
+		stats = &overflow_stats;
+	}
 
-	debug_print("jmraid_invoke_command_get_sata_info\n");
+	// the sector transfers time themselves, take their share from there
+	write_time = jmraid->disk.stats.write.total;
+	read_time = jmraid->disk.stats.read.total;
+	start = stats_get_time();
+	result = jmraid_submit_command_once(jmraid, command, stats, sector_data);
 
-	data_in[0] = 0x02;
-	data_in[1] = 0x01;
+	// a session that worked before and now gets garbage or its own command
+	// back has lost the command mode (bridge reset, USB reconnect ...), the
+	// handshake overwrites the command sector so the same id can be reused
+	if (jmraid->is_session && jmraid->is_command_mode && ((result == JMRAID_RESULT_CRC) || (result == JMRAID_RESULT_NO_RESPONSE)))
+	{
+		debug_print("command mode lost, sending handshake again\n");
+		jmraid_add_command_result(jmraid, stats, result);
+		jmraid->is_command_mode = false;
+		if (jmraid_prepare_unused_sector(jmraid))
+		{
+			result = jmraid_submit_command_once(jmraid, command, stats, sector_data);
+		}
+	}
 
-	if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
+	time = stats_get_time() - start;
+	write_time = jmraid->disk.stats.write.total - write_time;
+	read_time = jmraid->disk.stats.read.total - read_time;
+	stats_histogram_add(&stats->latency, time);
+	stats->write_time += write_time;
+	stats->read_time += read_time;
+	stats->codec_time += (time > write_time + read_time) ? time - write_time - read_time : 0;
+	jmraid_add_command_result(jmraid, stats, result);
+
+	jmraid->last_result = result;
+	if (result == JMRAID_RESULT_OK)
 	{
-		debug_print("jmraid_invoke_command failed\n");
-		return false;
+		jmraid->is_command_mode = true;
 	}
 
-	return true;
+	return result;
 }
 
-bool jmraid_invoke_command_get_sata_port_info(struct jmraid *jmraid, uint8_t sata_port, uint8_t *data_out, uint32_t size_out)
+bool jmraid_submit_command(struct jmraid *jmraid, const struct jmraid_command *command, uint8_t *data_out, uint32_t size_out)
 {
-	uint8_t data_in[3];
-
-	debug_print("jmraid_invoke_command_get_sata_port_info\n");
-
-	data_in[0] = 0x02;
-	data_in[1] = 0x02;
-	data_in[2] = sata_port;
+	uint8_t sector_data[SECTOR_SIZE];
 
-	if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
+	if (jmraid_submit_command_sector(jmraid, command, sector_data) != JMRAID_RESULT_OK)
 	{
-		debug_print("jmraid_invoke_command failed\n");
 		return false;
 	}
 
+	memcpy(data_out, sector_data + JMRAID_PAYLOAD_OFFSET, min(size_out, JMRAID_PAYLOAD_SIZE));
+
 	return true;
 }
 
-bool jmraid_invoke_command_get_raid_port_info(struct jmraid *jmraid, uint8_t raid_port, uint8_t *data_out, uint32_t size_out)
+bool jmraid_submit_command_response(struct jmraid *jmraid, const struct jmraid_command *command, struct jmraid_response *response)
 {
-	uint8_t data_in[3];
+	return jmraid_submit_command_sector(jmraid, command, response->sector_data) == JMRAID_RESULT_OK;
+}
 
-	debug_print("jmraid_invoke_command_get_raid_port_info\n");
+const uint8_t *jmraid_response_get_payload(const struct jmraid_response *response)
+{
+	return response->sector_data + JMRAID_PAYLOAD_OFFSET;
+}
 
-	data_in[0] = 0x03;
-	data_in[1] = 0x02;
-	data_in[2] = raid_port;
+int jmraid_complete_command(struct jmraid *jmraid, const struct jmraid_command *command, uint8_t *sector_data, uint8_t *data_out, uint32_t size_out, uint64_t time)
+{
+	struct jmraid_command_stats *stats;
+	struct jmraid_command_stats overflow_stats;
+	int result = JMRAID_RESULT_IO;
 
-	if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
+	debug_print("jmraid_complete_command | %02X %02X | %u\n", command->group, command->command, command->seq_id);
+
+	stats = jmraid_get_command_stats(jmraid, command->group, command->command);
+	if (!stats)
 	{
-		debug_print("jmraid_invoke_command failed\n");
-		return false;
+		memset(&overflow_stats, 0, sizeof(overflow_stats));
+		stats = &overflow_stats;
 	}
 
-	return true;
+	if (sector_data)
+	{
+		stats->bytes_in += command->size_in;
+		result = jmraid_check_response(command, stats, sector_data);
+	}
+
+	// the transfers were not timed one by one, the whole round trip is
+	// latency only
+	stats_histogram_add(&stats->latency, time);
+	jmraid_add_command_result(jmraid, stats, result);
+
+	jmraid->last_result = result;
+	if (result == JMRAID_RESULT_OK)
+	{
+		memcpy(data_out, sector_data + JMRAID_PAYLOAD_OFFSET, min(size_out, JMRAID_PAYLOAD_SIZE));
+		jmraid->is_command_mode = true;
+	}
+
+	return result;
 }
 
-bool jmraid_invoke_command_ata_passthrough(struct jmraid *jmraid, uint8_t sata_port, uint8_t ata_read_addr, uint8_t ata_read_size, const uint8_t *ata_data, uint8_t *data_out, uint32_t size_out)
+bool jmraid_invoke_command(struct jmraid *jmraid, const uint8_t *data_in, uint32_t size_in, uint8_t *data_out, uint32_t size_out)
 {
-	uint8_t data_in[22];
+	struct jmraid_command command;
+
+	debug_print("jmraid_invoke_command | %02X %02X\n", data_in[0], data_in[1]);
+
+	jmraid_prepare_command(jmraid, &command, data_in, size_in);
+
+	return jmraid_submit_command(jmraid, &command, data_out, size_out);
+}
+
+bool jmraid_invoke_command_response(struct jmraid *jmraid, const uint8_t *data_in, uint32_t size_in, struct jmraid_response *response)
+{
+	struct jmraid_command command;
+
+	debug_print("jmraid_invoke_command_response | %02X %02X\n", data_in[0], data_in[1]);
+
+	jmraid_prepare_command(jmraid, &command, data_in, size_in);
+
+	return jmraid_submit_command_response(jmraid, &command, response);
+}
+
+uint32_t jmraid_invoke_batch(struct jmraid *jmraid, struct jmraid_batch_item *item, uint32_t count, bool is_stop_on_transport_error)
+{
+	struct jmraid_command command;
+	uint8_t sector_data[SECTOR_SIZE];
+	uint32_t ok_count = 0;
+	uint32_t i;
 
-	debug_print("jmraid_invoke_command_ata_passthrough\n");
+	debug_print("jmraid_invoke_batch | %u\n", count);
 
-	data_in[0] = 0x02;
-	data_in[1] = 0x03;
-	data_in[2] = sata_port;
-	data_in[3] = 0x02; // ?
-	data_in[4] = ata_read_addr;
-	data_in[5] = ata_read_size;
-	memcpy(data_in + 6, ata_data, 16);
+	for (i = 0; i < count; i++)
+	{
+		jmraid_prepare_command(jmraid, &command, item[i].data_in, item[i].size_in);
+		item[i].result = jmraid_submit_command_sector(jmraid, &command, sector_data);
+		if (item[i].result == JMRAID_RESULT_OK)
+		{
+			if (item[i].data_out)
+			{
+				memcpy(item[i].data_out, sector_data + JMRAID_PAYLOAD_OFFSET, min(item[i].size_out, JMRAID_PAYLOAD_SIZE));
+			}
+			ok_count++;
+		}
+		else if ((item[i].result < 0) && is_stop_on_transport_error)
+		{
+			debug_print("transport error %d, skipping %u commands\n", item[i].result, count - i - 1);
+			break;
+		}
+	}
 
-	if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
+	for (i++; i < count; i++)
 	{
-		debug_print("jmraid_invoke_command failed\n");
-		return false;
+		item[i].result = JMRAID_RESULT_SKIPPED;
 	}
 
-	return true;
+	return ok_count;
 }
 
+// jmraid_invoke_command_<name>(jmraid, args, data_out, size_out) for every
+// command of commands.h, args as laid out there
+#define JMRAID_COMMAND_INVOKER(name, opcode_0, opcode_1, args_size) \
+	bool jmraid_invoke_command_##name(struct jmraid *jmraid, const uint8_t *args, uint8_t *data_out, uint32_t size_out) \
+	{ \
+		uint8_t data_in[JMRAID_COMMAND_MAX_SIZE_IN]; \
+		uint32_t size_in = jmraid_encode_##name(data_in, args); \
+		debug_print("jmraid_invoke_command_" #name "\n"); \
+		return jmraid_invoke_command(jmraid, data_in, size_in, data_out, size_out); \
+	}
+
+JMRAID_COMMANDS(JMRAID_COMMAND_INVOKER)
+
 bool jmraid_get_chip_info(struct jmraid *jmraid, struct jmraid_chip_info *info)
 {
-	uint8_t data_out[SECTOR_SIZE];
+	uint8_t data_in[JMRAID_COMMAND_MAX_SIZE_IN];
+	uint32_t size_in = jmraid_encode_get_chip_info(data_in, NULL);
+	struct jmraid_response response;
 
 	debug_print("jmraid_get_chip_info\n");
 
-	if (!jmraid_invoke_command_get_chip_info(jmraid, data_out, sizeof(data_out)))
+	if (!jmraid_invoke_command_response(jmraid, data_in, size_in, &response))
 	{
-		debug_print("jmraid_invoke_command_get_chip_info failed\n");
+		debug_print("jmraid_invoke_command_response failed\n");
 		return false;
 	}
 
-	parse_jmraid_chip_info(data_out, info);
+	parse_jmraid_chip_info(jmraid_response_get_payload(&response), info);
 
 	return true;
 }
 
 bool jmraid_get_sata_info(struct jmraid *jmraid, struct jmraid_sata_info *info)
 {
-	uint8_t data_out[SECTOR_SIZE];
+	uint8_t data_in[JMRAID_COMMAND_MAX_SIZE_IN];
+	uint32_t size_in = jmraid_encode_get_sata_info(data_in, NULL);
+	struct jmraid_response response;
 
 	debug_print("jmraid_get_sata_info\n");
 
-	if (!jmraid_invoke_command_get_sata_info(jmraid, data_out, sizeof(data_out)))
+	if (!jmraid_invoke_command_response(jmraid, data_in, size_in, &response))
 	{
-		debug_print("jmraid_invoke_command_get_sata_info failed\n");
+		debug_print("jmraid_invoke_command_response failed\n");
 		return false;
 	}
 
-	parse_jmraid_sata_info(data_out, info);
+	parse_jmraid_sata_info(jmraid_response_get_payload(&response), info);
 
 	return true;
 }
 
 bool jmraid_get_sata_port_info(struct jmraid *jmraid, uint8_t index, struct jmraid_sata_port_info *info)
 {
-	uint8_t data_out[SECTOR_SIZE];
+	uint8_t data_in[JMRAID_COMMAND_MAX_SIZE_IN];
+	uint32_t size_in = jmraid_encode_get_sata_port_info(data_in, &index);
+	struct jmraid_response response;
 
 	debug_print("jmraid_get_sata_port_info\n");
 
-	if (!jmraid_invoke_command_get_sata_port_info(jmraid, index, data_out, sizeof(data_out)))
+	if (!jmraid_invoke_command_response(jmraid, data_in, size_in, &response))
 	{
-		debug_print("jmraid_invoke_command_get_sata_port_info failed\n");
+		debug_print("jmraid_invoke_command_response failed\n");
 		return false;
 	}
 
-	parse_jmraid_sata_port_info(data_out, info);
+	parse_jmraid_sata_port_info(jmraid_response_get_payload(&response), info);
 
 	return true;
 }
 
 bool jmraid_get_raid_port_info(struct jmraid *jmraid, uint8_t index, struct jmraid_raid_port_info *info)
 {
-	uint8_t data_out[SECTOR_SIZE];
+	uint8_t data_in[JMRAID_COMMAND_MAX_SIZE_IN];
+	uint32_t size_in = jmraid_encode_get_raid_port_info(data_in, &index);
+	struct jmraid_response response;
 
 	debug_print("jmraid_get_raid_port_info\n");
 
-	if (!jmraid_invoke_command_get_raid_port_info(jmraid, index, data_out, sizeof(data_out)))
+	if (!jmraid_invoke_command_response(jmraid, data_in, size_in, &response))
 	{
-		debug_print("jmraid_invoke_command_get_raid_port_info failed\n");
+		debug_print("jmraid_invoke_command_response failed\n");
 		return false;
 	}
 
-	parse_jmraid_raid_port_info(data_out, info);
+	parse_jmraid_raid_port_info(jmraid_response_get_payload(&response), info);
+	jmraid_raid_port_memory_store(jmraid, index, info);
 
 	return true;
 }
 
 bool jmraid_get_disk_smart_info(struct jmraid *jmraid, uint8_t sata_port, struct jmraid_disk_smart_info *info)
 {
-	uint8_t data_in[16];
-	uint8_t data_out_1[SECTOR_SIZE];
-	uint8_t data_out_2[SECTOR_SIZE];
+	uint8_t ata_data[16];
+	uint8_t args[JMRAID_ATA_PASSTHROUGH_ARGS_SIZE];
+	uint8_t data_in[JMRAID_COMMAND_MAX_SIZE_IN];
+	uint32_t size_in;
+	struct jmraid_response response_1;
+	struct jmraid_response response_2;
 
 	debug_print("jmraid_get_disk_smart_info\n");
 
-	memset(data_in, 0, sizeof(data_in));
-	data_in[2] = 0xD0;
-	data_in[8] = 0x4F;
-	data_in[10] = 0xC2;
-	data_in[12] = 0xA0;
-	data_in[14] = 0xB0;
+	jmraid_ata_smart_task_file(ata_data, 0xD0);
+	jmraid_ata_passthrough_args(args, sata_port, 0x00, 0xE0, ata_data);
+	size_in = jmraid_encode_ata_passthrough(data_in, args);
+	if (!jmraid_invoke_command_response(jmraid, data_in, size_in, &response_1))
+	{
+		debug_print("jmraid_invoke_command_response failed\n");
+		return false;
+	}
 
-	if (!jmraid_invoke_command_ata_passthrough(jmraid, sata_port, 0x00, 0xE0, data_in, data_out_1, sizeof(data_out_2)))
+	jmraid_ata_smart_task_file(ata_data, 0xD1);
+	jmraid_ata_passthrough_args(args, sata_port, 0x00, 0xE0, ata_data);
+	size_in = jmraid_encode_ata_passthrough(data_in, args);
+	if (!jmraid_invoke_command_response(jmraid, data_in, size_in, &response_2))
 	{
-		debug_print("jmraid_invoke_command_ata_passthrough failed\n");
+		debug_print("jmraid_invoke_command_response failed\n");
 		return false;
 	}
 
-	memset(data_in, 0, sizeof(data_in));
-	data_in[2] = 0xD1;
-	data_in[8] = 0x4F;
-	data_in[10] = 0xC2;
-	data_in[12] = 0xA0;
-	data_in[14] = 0xB0;
+	parse_jmraid_disk_smart_info(jmraid_response_get_payload(&response_1), jmraid_response_get_payload(&response_2), info);
 
-	if (!jmraid_invoke_command_ata_passthrough(jmraid, sata_port, 0x00, 0xE0, data_in, data_out_2, sizeof(data_out_2)))
+	return true;
+}
+
+void jmraid_plan_queries(struct jmraid *jmraid, const struct jmraid_sata_info *sata_info, struct jmraid_plan *plan)
+{
+	int i;
+
+	debug_print("jmraid_plan_queries\n");
+
+	if (jmraid->is_strict || !sata_info)
 	{
-		debug_print("jmraid_invoke_command_ata_passthrough failed\n");
+		for (i = 0; i < 5; i++)
+		{
+			plan->is_sata_port_info_needed[i] = true;
+			plan->is_raid_port_info_needed[i] = true;
+			plan->is_disk_smart_info_needed[i] = true;
+		}
+		if (!sata_info)
+		{
+			return;
+		}
+	}
+	else
+	{
+		memset(plan, 0, sizeof(struct jmraid_plan));
+	}
+
+	for (i = 0; i < 5; i++)
+	{
+		const struct jmraid_sata_info_item *item = &sata_info->item[i];
+
+		// no device, off and host ports all read back as an "off" port
+		if ((item->port_type != 0x00) && (item->port_type != 0x06) && (item->port_type != 0x07))
+		{
+			plan->is_sata_port_info_needed[i] = true;
+		}
+
+		// a RAID port only has something to say when a disk belongs to it
+		// or it held a set the last time
+		if ((item->port_type == 0x02) && (item->page_0_raid_index < 5))
+		{
+			plan->is_raid_port_info_needed[item->page_0_raid_index] = true;
+		}
+		if (jmraid->is_raid_port_active[i])
+		{
+			plan->is_raid_port_info_needed[i] = true;
+		}
+
+		// SMART only makes sense for RAID members and spare disks, even in
+		// strict mode
+		plan->is_disk_smart_info_needed[i] = (item->port_type == 0x02) || ((item->port_type == 0x01) && (item->page_0_state == 0x03));
+	}
+}
+
+void jmraid_plan_fill_sata_port_info(struct jmraid_sata_port_info *info)
+{
+	memset(info, 0, sizeof(struct jmraid_sata_port_info));
+	info->port_type = 0x06;
+}
+
+void jmraid_raid_port_memory_store(struct jmraid *jmraid, uint8_t index, const struct jmraid_raid_port_info *info)
+{
+	jmraid->is_raid_port_active[index] = (info->port_state != 0x00);
+}
+
+bool jmraid_power_mode_is_standby(uint8_t power_mode)
+{
+	return (power_mode == JMRAID_POWER_MODE_STANDBY) || (power_mode == 0x01);
+}
+
+bool jmraid_parse_power_mode(const uint8_t *payload, uint8_t *power_mode)
+{
+	uint8_t sector_count = jmraid_ata_registers_view_sector_count(jmraid_ata_registers_view(payload));
+
+	if (sector_count == JMRAID_ATA_POWER_MODE_SENTINEL)
+	{
+		debug_print("sector count unchanged, no power mode\n");
 		return false;
 	}
 
-	parse_jmraid_disk_smart_info(data_out_1, data_out_2, info);
+	*power_mode = sector_count;
 
 	return true;
 }
 
+bool jmraid_smart_memory_load(struct jmraid *jmraid, struct jmraid_snapshot *snapshot, uint8_t sata_port)
+{
+	const struct jmraid_smart_memory *memory = &jmraid->smart_memory[sata_port];
+
+	debug_print("jmraid_smart_memory_load | %d\n", sata_port);
+
+	// a different disk on the port, the values are of no use
+	if (!memory->is_valid || !snapshot->is_sata_info_valid || (strcmp(memory->serial_number, snapshot->sata_info.item[sata_port].serial_number) != 0))
+	{
+		return false;
+	}
+
+	memcpy(&snapshot->disk_smart_info[sata_port], &memory->info, sizeof(struct jmraid_disk_smart_info));
+	snapshot->disk_smart_info_time[sata_port] = memory->time;
+	snapshot->is_disk_smart_info_valid[sata_port] = true;
+
+	return true;
+}
+
+void jmraid_smart_memory_store(struct jmraid *jmraid, const struct jmraid_snapshot *snapshot, uint8_t sata_port)
+{
+	struct jmraid_smart_memory *memory = &jmraid->smart_memory[sata_port];
+
+	debug_print("jmraid_smart_memory_store | %d\n", sata_port);
+
+	memory->is_valid = snapshot->is_sata_info_valid;
+	memory->time = snapshot->disk_smart_info_time[sata_port];
+	memcpy(memory->serial_number, snapshot->sata_info.item[sata_port].serial_number, sizeof(memory->serial_number));
+	memcpy(&memory->info, &snapshot->disk_smart_info[sata_port], sizeof(struct jmraid_disk_smart_info));
+}
+
+// chip and SATA info go first as the plan depends on them, then the SATA
+// port and RAID port info and the power modes, and at last SMART data +
+// thresholds of the ports that are awake
+#define SNAPSHOT_MAX_ITEMS (5 + 5 + 2 * 5)
+
+struct jmraid_snapshot_batch
+{
+	uint32_t count;
+	struct jmraid_batch_item item[SNAPSHOT_MAX_ITEMS];
+	uint8_t data_in[SNAPSHOT_MAX_ITEMS][JMRAID_COMMAND_MAX_SIZE_IN];
+	uint8_t data_out[SNAPSHOT_MAX_ITEMS][JMRAID_PAYLOAD_SIZE];
+};
+
+static int jmraid_snapshot_batch_add(struct jmraid_snapshot_batch *batch, const uint8_t *data_in, uint32_t size_in)
+{
+	struct jmraid_batch_item *item = &batch->item[batch->count];
+
+	memcpy(batch->data_in[batch->count], data_in, size_in);
+	item->data_in = batch->data_in[batch->count];
+	item->size_in = size_in;
+	item->data_out = batch->data_out[batch->count];
+	item->size_out = JMRAID_PAYLOAD_SIZE;
+
+	return (int)batch->count++;
+}
+
+static bool jmraid_snapshot_batch_is_ok(const struct jmraid_snapshot_batch *batch, int index)
+{
+	return (index >= 0) && (batch->item[index].result == JMRAID_RESULT_OK);
+}
+
+bool jmraid_get_snapshot(struct jmraid *jmraid, struct jmraid_snapshot *snapshot)
+{
+	struct jmraid_snapshot_batch batch;
+	struct jmraid_plan plan;
+	uint8_t data_in[JMRAID_COMMAND_MAX_SIZE_IN];
+	uint8_t ata_data[16];
+	uint8_t args[JMRAID_ATA_PASSTHROUGH_ARGS_SIZE];
+	int sata_port_item[5];
+	int raid_port_item[5];
+	int power_item[5];
+	int smart_item[5];
+	bool result = true;
+	uint8_t i;
+
+	debug_print("jmraid_get_snapshot\n");
+
+	memset(snapshot, 0, sizeof(struct jmraid_snapshot));
+	snapshot->time = time(NULL);
+
+	batch.count = 0;
+	jmraid_snapshot_batch_add(&batch, data_in, jmraid_encode_get_chip_info(data_in, NULL));
+	jmraid_snapshot_batch_add(&batch, data_in, jmraid_encode_get_sata_info(data_in, NULL));
+	jmraid_invoke_batch(jmraid, batch.item, batch.count, false);
+
+	snapshot->is_chip_info_valid = jmraid_snapshot_batch_is_ok(&batch, 0);
+	if (snapshot->is_chip_info_valid)
+	{
+		parse_jmraid_chip_info(batch.data_out[0], &snapshot->chip_info);
+	}
+	result &= snapshot->is_chip_info_valid;
+
+	snapshot->is_sata_info_valid = jmraid_snapshot_batch_is_ok(&batch, 1);
+	if (snapshot->is_sata_info_valid)
+	{
+		parse_jmraid_sata_info(batch.data_out[1], &snapshot->sata_info);
+	}
+	result &= snapshot->is_sata_info_valid;
+
+	jmraid_plan_queries(jmraid, snapshot->is_sata_info_valid ? &snapshot->sata_info : NULL, &plan);
+
+	batch.count = 0;
+	for (i = 0; i < 5; i++)
+	{
+		sata_port_item[i] = -1;
+		if (plan.is_sata_port_info_needed[i])
+		{
+			sata_port_item[i] = jmraid_snapshot_batch_add(&batch, data_in, jmraid_encode_get_sata_port_info(data_in, &i));
+		}
+	}
+	for (i = 0; i < 5; i++)
+	{
+		raid_port_item[i] = -1;
+		if (plan.is_raid_port_info_needed[i])
+		{
+			raid_port_item[i] = jmraid_snapshot_batch_add(&batch, data_in, jmraid_encode_get_raid_port_info(data_in, &i));
+		}
+	}
+	for (i = 0; i < 5; i++)
+	{
+		power_item[i] = -1;
+		if (snapshot->is_sata_info_valid && plan.is_disk_smart_info_needed[i] && jmraid->is_power_mode_checked && !jmraid->is_smart_fresh_required)
+		{
+			jmraid_ata_check_power_mode_task_file(ata_data);
+			jmraid_ata_passthrough_args(args, i, 0x00, 0x00, ata_data);
+			power_item[i] = jmraid_snapshot_batch_add(&batch, data_in, jmraid_encode_ata_passthrough(data_in, args));
+		}
+	}
+	jmraid_invoke_batch(jmraid, batch.item, batch.count, false);
+
+	for (i = 0; i < 5; i++)
+	{
+		if (sata_port_item[i] < 0)
+		{
+			jmraid_plan_fill_sata_port_info(&snapshot->sata_port_info[i]);
+			snapshot->is_sata_port_info_valid[i] = true;
+			continue;
+		}
+		snapshot->is_sata_port_info_valid[i] = jmraid_snapshot_batch_is_ok(&batch, sata_port_item[i]);
+		if (snapshot->is_sata_port_info_valid[i])
+		{
+			parse_jmraid_sata_port_info(batch.data_out[sata_port_item[i]], &snapshot->sata_port_info[i]);
+		}
+		result &= snapshot->is_sata_port_info_valid[i];
+	}
+
+	for (i = 0; i < 5; i++)
+	{
+		// not asked, nothing is known about it
+		if (raid_port_item[i] < 0)
+		{
+			continue;
+		}
+		snapshot->is_raid_port_info_valid[i] = jmraid_snapshot_batch_is_ok(&batch, raid_port_item[i]);
+		if (snapshot->is_raid_port_info_valid[i])
+		{
+			parse_jmraid_raid_port_info(batch.data_out[raid_port_item[i]], &snapshot->raid_port_info[i]);
+			jmraid_raid_port_memory_store(jmraid, i, &snapshot->raid_port_info[i]);
+		}
+		result &= snapshot->is_raid_port_info_valid[i];
+	}
+
+	// a bridge without CHECK POWER MODE just gets SMART read as before
+	for (i = 0; i < 5; i++)
+	{
+		snapshot->is_power_mode_valid[i] = jmraid_snapshot_batch_is_ok(&batch, power_item[i]) && jmraid_parse_power_mode(batch.data_out[power_item[i]], &snapshot->power_mode[i]);
+	}
+
+	batch.count = 0;
+	for (i = 0; i < 5; i++)
+	{
+		smart_item[i] = -1;
+		if (!snapshot->is_sata_info_valid || !plan.is_disk_smart_info_needed[i])
+		{
+			continue;
+		}
+		if (snapshot->is_power_mode_valid[i] && jmraid_power_mode_is_standby(snapshot->power_mode[i]))
+		{
+			debug_print("disk %d in standby\n", i);
+			jmraid_smart_memory_load(jmraid, snapshot, i);
+			continue;
+		}
+		// data and thresholds, always next to each other
+		jmraid_ata_smart_task_file(ata_data, 0xD0);
+		jmraid_ata_passthrough_args(args, i, 0x00, 0xE0, ata_data);
+		smart_item[i] = jmraid_snapshot_batch_add(&batch, data_in, jmraid_encode_ata_passthrough(data_in, args));
+		jmraid_ata_smart_task_file(ata_data, 0xD1);
+		jmraid_ata_passthrough_args(args, i, 0x00, 0xE0, ata_data);
+		jmraid_snapshot_batch_add(&batch, data_in, jmraid_encode_ata_passthrough(data_in, args));
+	}
+	jmraid_invoke_batch(jmraid, batch.item, batch.count, false);
+
+	for (i = 0; i < 5; i++)
+	{
+		if (smart_item[i] < 0)
+		{
+			continue;
+		}
+		snapshot->is_disk_smart_info_valid[i] = jmraid_snapshot_batch_is_ok(&batch, smart_item[i]) && jmraid_snapshot_batch_is_ok(&batch, smart_item[i] + 1);
+		if (snapshot->is_disk_smart_info_valid[i])
+		{
+			parse_jmraid_disk_smart_info(batch.data_out[smart_item[i]], batch.data_out[smart_item[i] + 1], &snapshot->disk_smart_info[i]);
+			snapshot->disk_smart_info_time[i] = snapshot->time;
+			jmraid_smart_memory_store(jmraid, snapshot, i);
+		}
+		result &= snapshot->is_disk_smart_info_valid[i];
+	}
+
+	return result;
+}
+
 bool jmraid_ata_identify_device(struct jmraid *jmraid, uint8_t sata_port, uint8_t *data_out)
 {
-	uint8_t data_in[16];
+	uint8_t ata_data[16];
+	uint8_t args[JMRAID_ATA_PASSTHROUGH_ARGS_SIZE];
 	uint8_t temp_data_out[SECTOR_SIZE];
 
 	debug_print("jmraid_ata_identify_device\n");
 
-	memset(data_in, 0, sizeof(data_in));
-	data_in[14] = 0xEC;
+	jmraid_ata_task_file(ata_data, 0xEC);
 
-	if (!jmraid_invoke_command_ata_passthrough(jmraid, sata_port, 0x00, 0x80, data_in, temp_data_out, sizeof(temp_data_out)))
+	jmraid_ata_passthrough_args(args, sata_port, 0x00, 0x80, ata_data);
+	if (!jmraid_invoke_command_ata_passthrough(jmraid, args, temp_data_out, sizeof(temp_data_out)))
 	{
 		debug_print("jmraid_invoke_command_ata_passthrough failed\n");
 		return false;
@@ -1049,7 +1410,8 @@ bool jmraid_ata_identify_device(struct jmraid *jmraid, uint8_t sata_port, uint8_
 
 	memcpy(data_out, temp_data_out + 0x14, 0x100);
 
-	if (!jmraid_invoke_command_ata_passthrough(jmraid, sata_port, 0x80, 0x80, data_in, temp_data_out, sizeof(temp_data_out)))
+	jmraid_ata_passthrough_args(args, sata_port, 0x80, 0x80, ata_data);
+	if (!jmraid_invoke_command_ata_passthrough(jmraid, args, temp_data_out, sizeof(temp_data_out)))
 	{
 		debug_print("jmraid_invoke_command_ata_passthrough failed\n");
 		return false;
@@ -1060,21 +1422,41 @@ bool jmraid_ata_identify_device(struct jmraid *jmraid, uint8_t sata_port, uint8_
 	return true;
 }
 
+bool jmraid_ata_check_power_mode(struct jmraid *jmraid, uint8_t sata_port, uint8_t *power_mode)
+{
+	uint8_t ata_data[16];
+	uint8_t args[JMRAID_ATA_PASSTHROUGH_ARGS_SIZE];
+	uint8_t data_in[JMRAID_COMMAND_MAX_SIZE_IN];
+	uint32_t size_in;
+	struct jmraid_response response;
+
+	debug_print("jmraid_ata_check_power_mode\n");
+
+	// no data, the answer is in the sector count register
+	jmraid_ata_check_power_mode_task_file(ata_data);
+	jmraid_ata_passthrough_args(args, sata_port, 0x00, 0x00, ata_data);
+	size_in = jmraid_encode_ata_passthrough(data_in, args);
+	if (!jmraid_invoke_command_response(jmraid, data_in, size_in, &response))
+	{
+		debug_print("jmraid_invoke_command_response failed\n");
+		return false;
+	}
+
+	return jmraid_parse_power_mode(jmraid_response_get_payload(&response), power_mode);
+}
+
 bool jmraid_ata_smart_read_data(struct jmraid *jmraid, uint8_t sata_port, uint8_t *data_out)
 {
-	uint8_t data_in[16];
+	uint8_t ata_data[16];
+	uint8_t args[JMRAID_ATA_PASSTHROUGH_ARGS_SIZE];
 	uint8_t temp_data_out[SECTOR_SIZE];
 
 	debug_print("jmraid_ata_smart_read_data\n");
 
-	memset(data_in, 0, sizeof(data_in));
-	data_in[2] = 0xD0;
-	data_in[8] = 0x4F;
-	data_in[10] = 0xC2;
-	data_in[12] = 0xA0;
-	data_in[14] = 0xB0;
+	jmraid_ata_smart_task_file(ata_data, 0xD0);
 
-	if (!jmraid_invoke_command_ata_passthrough(jmraid, sata_port, 0x00, 0x80, data_in, temp_data_out, sizeof(temp_data_out)))
+	jmraid_ata_passthrough_args(args, sata_port, 0x00, 0x80, ata_data);
+	if (!jmraid_invoke_command_ata_passthrough(jmraid, args, temp_data_out, sizeof(temp_data_out)))
 	{
 		debug_print("jmraid_invoke_command_ata_passthrough failed\n");
 		return false;
@@ -1082,7 +1464,8 @@ bool jmraid_ata_smart_read_data(struct jmraid *jmraid, uint8_t sata_port, uint8_
 
 	memcpy(data_out, temp_data_out + 0x14, 0x100);
 
-	if (!jmraid_invoke_command_ata_passthrough(jmraid, sata_port, 0x80, 0x80, data_in, temp_data_out, sizeof(temp_data_out)))
+	jmraid_ata_passthrough_args(args, sata_port, 0x80, 0x80, ata_data);
+	if (!jmraid_invoke_command_ata_passthrough(jmraid, args, temp_data_out, sizeof(temp_data_out)))
 	{
 		debug_print("jmraid_invoke_command_ata_passthrough failed\n");
 		return false;
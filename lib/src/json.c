@@ -0,0 +1,109 @@
+#include "json.h"
+
+#include <inttypes.h>
+
+static void json_write_string(FILE *file, const char *value)
+{
+	const unsigned char *c;
+
+	fputc('"', file);
+	for (c = (const unsigned char *)value; *c; c++)
+	{
+		switch (*c)
+		{
+			case '"': fputs("\\\"", file); break;
+			case '\\': fputs("\\\\", file); break;
+			case '\n': fputs("\\n", file); break;
+			case '\r': fputs("\\r", file); break;
+			case '\t': fputs("\\t", file); break;
+			default:
+				// strings come from the bridge and are not necessarily
+				// UTF-8, keep the output valid by reading them as Latin-1
+				if ((*c < 0x20) || (*c >= 0x7F))
+				{
+					fprintf(file, "\\u%04X", *c);
+				}
+				else
+				{
+					fputc(*c, file);
+				}
+				break;
+		}
+	}
+	fputc('"', file);
+}
+
+static void json_write_key(struct json_writer *writer, const char *key)
+{
+	if ((writer->depth > 0) && (writer->depth <= JSON_MAX_DEPTH))
+	{
+		if (!writer->is_empty[writer->depth - 1])
+		{
+			fputc(',', writer->file);
+		}
+		writer->is_empty[writer->depth - 1] = false;
+	}
+	if (key)
+	{
+		json_write_string(writer->file, key);
+		fputc(':', writer->file);
+	}
+}
+
+static void json_begin(struct json_writer *writer, const char *key, char c)
+{
+	json_write_key(writer, key);
+	fputc(c, writer->file);
+	if (writer->depth < JSON_MAX_DEPTH)
+	{
+		writer->is_empty[writer->depth] = true;
+	}
+	writer->depth++;
+}
+
+static void json_end(struct json_writer *writer, char c)
+{
+	fputc(c, writer->file);
+	if (writer->depth > 0)
+	{
+		writer->depth--;
+	}
+}
+
+void json_init(struct json_writer *writer, FILE *file)
+{
+	writer->file = file;
+	writer->depth = 0;
+}
+
+void json_begin_object(struct json_writer *writer, const char *key)
+{
+	json_begin(writer, key, '{');
+}
+
+void json_end_object(struct json_writer *writer)
+{
+	json_end(writer, '}');
+}
+
+void json_begin_array(struct json_writer *writer, const char *key)
+{
+	json_begin(writer, key, '[');
+}
+
+void json_end_array(struct json_writer *writer)
+{
+	json_end(writer, ']');
+}
+
+void json_add_string(struct json_writer *writer, const char *key, const char *value)
+{
+	json_write_key(writer, key);
+	json_write_string(writer->file, value);
+}
+
+void json_add_int(struct json_writer *writer, const char *key, int64_t value)
+{
+	json_write_key(writer, key);
+	fprintf(writer->file, "%" PRId64, value);
+}
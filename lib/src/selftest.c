@@ -0,0 +1,205 @@
+#include "selftest.h"
+#include "commands.h"
+
+#include <string.h>
+
+#ifdef DEBUG_PRINT
+extern void debug_print(const char* format, ...);
+#else
+#define debug_print(...)
+#endif
+
+// byte 363 of the SMART data, the high byte of word 181
+#define SELF_TEST_STATUS_WORD 181
+
+bool jmraid_ata_smart_execute_off_line(struct jmraid *jmraid, uint8_t sata_port, uint8_t subcommand)
+{
+	uint8_t ata_data[16];
+	uint8_t args[JMRAID_ATA_PASSTHROUGH_ARGS_SIZE];
+	uint8_t data_in[JMRAID_COMMAND_MAX_SIZE_IN];
+	uint32_t size_in;
+	struct jmraid_response response;
+
+	debug_print("jmraid_ata_smart_execute_off_line | %d | %02X\n", sata_port, subcommand);
+
+	// no data, the subcommand goes in LBA low
+	jmraid_ata_smart_task_file(ata_data, 0xD4);
+	ata_data[6] = subcommand;
+	jmraid_ata_passthrough_args(args, sata_port, 0x00, 0x00, ata_data);
+	size_in = jmraid_encode_ata_passthrough(data_in, args);
+	if (!jmraid_invoke_command_response(jmraid, data_in, size_in, &response))
+	{
+		debug_print("jmraid_invoke_command_response failed\n");
+		return false;
+	}
+
+	return true;
+}
+
+bool jmraid_ata_self_test_status(struct jmraid *jmraid, uint8_t sata_port, uint8_t *status)
+{
+	uint8_t ata_data[16];
+	uint8_t args[JMRAID_ATA_PASSTHROUGH_ARGS_SIZE];
+	uint8_t data_in[JMRAID_COMMAND_MAX_SIZE_IN];
+	uint32_t size_in;
+	struct jmraid_response response;
+
+	debug_print("jmraid_ata_self_test_status | %d\n", sata_port);
+
+	jmraid_ata_smart_task_file(ata_data, 0xD0);
+	jmraid_ata_passthrough_args(args, sata_port, SELF_TEST_STATUS_WORD, 0x01, ata_data);
+	size_in = jmraid_encode_ata_passthrough(data_in, args);
+	if (!jmraid_invoke_command_response(jmraid, data_in, size_in, &response))
+	{
+		debug_print("jmraid_invoke_command_response failed\n");
+		return false;
+	}
+
+	*status = jmraid_response_get_payload(&response)[0x14 + 1];
+
+	return true;
+}
+
+static bool jmraid_self_test_is_running(uint8_t status)
+{
+	return (status >> 4) == JMRAID_SELF_TEST_STATUS_IN_PROGRESS;
+}
+
+static uint32_t jmraid_self_test_count_running(const struct jmraid_self_test_scheduler *scheduler, uint8_t group)
+{
+	uint32_t count = 0;
+	int i;
+
+	for (i = 0; i < 5; i++)
+	{
+		if ((scheduler->port[i].state == JMRAID_SELF_TEST_STATE_RUNNING) && (scheduler->port[i].group == group))
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void jmraid_self_test_init(struct jmraid_self_test_scheduler *scheduler, uint8_t subcommand, uint32_t max_per_raid)
+{
+	debug_print("jmraid_self_test_init | %02X | %u\n", subcommand, max_per_raid);
+
+	memset(scheduler, 0, sizeof(struct jmraid_self_test_scheduler));
+	scheduler->subcommand = subcommand;
+	scheduler->max_per_raid = max_per_raid ? max_per_raid : JMRAID_SELF_TEST_DEFAULT_MAX_PER_RAID;
+}
+
+void jmraid_self_test_plan(struct jmraid_self_test_scheduler *scheduler, const struct jmraid_sata_info *sata_info)
+{
+	int i;
+
+	debug_print("jmraid_self_test_plan\n");
+
+	for (i = 0; i < 5; i++)
+	{
+		const struct jmraid_sata_info_item *item = &sata_info->item[i];
+		struct jmraid_self_test_port *port = &scheduler->port[i];
+
+		if (port->state == JMRAID_SELF_TEST_STATE_RUNNING)
+		{
+			continue;
+		}
+		// the disks jmraid_plan_queries() reads SMART of
+		if ((item->port_type == 0x02) && (item->page_0_raid_index < 5))
+		{
+			port->state = JMRAID_SELF_TEST_STATE_PENDING;
+			port->group = item->page_0_raid_index;
+		}
+		else if ((item->port_type == 0x02) || ((item->port_type == 0x01) && (item->page_0_state == 0x03)))
+		{
+			port->state = JMRAID_SELF_TEST_STATE_PENDING;
+			port->group = (uint8_t)(5 + i);
+		}
+		else
+		{
+			port->state = JMRAID_SELF_TEST_STATE_IDLE;
+		}
+	}
+}
+
+bool jmraid_self_test_is_busy(const struct jmraid_self_test_scheduler *scheduler)
+{
+	int i;
+
+	for (i = 0; i < 5; i++)
+	{
+		if ((scheduler->port[i].state == JMRAID_SELF_TEST_STATE_PENDING) || (scheduler->port[i].state == JMRAID_SELF_TEST_STATE_RUNNING))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool jmraid_self_test_poll(struct jmraid *jmraid, struct jmraid_self_test_scheduler *scheduler)
+{
+	time_t now = time(NULL);
+	uint8_t status;
+	uint8_t i;
+
+	debug_print("jmraid_self_test_poll\n");
+
+	for (i = 0; i < 5; i++)
+	{
+		struct jmraid_self_test_port *port = &scheduler->port[i];
+		if (port->state != JMRAID_SELF_TEST_STATE_RUNNING)
+		{
+			continue;
+		}
+		// a failed read says nothing about the test, try again next time
+		if (!jmraid_ata_self_test_status(jmraid, i, &status))
+		{
+			debug_print("jmraid_ata_self_test_status failed\n");
+			continue;
+		}
+		port->status = status;
+		if (!jmraid_self_test_is_running(status))
+		{
+			debug_print("disk %d done | %02X\n", i, status);
+			port->state = JMRAID_SELF_TEST_STATE_DONE;
+			port->end_time = now;
+		}
+	}
+
+	// tests started by someone else are followed (a new one would abort
+	// them) and count against the cap before anything is started
+	for (i = 0; i < 5; i++)
+	{
+		struct jmraid_self_test_port *port = &scheduler->port[i];
+		if ((port->state == JMRAID_SELF_TEST_STATE_PENDING) && jmraid_ata_self_test_status(jmraid, i, &status) && jmraid_self_test_is_running(status))
+		{
+			debug_print("disk %d already testing | %02X\n", i, status);
+			port->state = JMRAID_SELF_TEST_STATE_RUNNING;
+			port->status = status;
+			port->start_time = now;
+		}
+	}
+
+	for (i = 0; i < 5; i++)
+	{
+		struct jmraid_self_test_port *port = &scheduler->port[i];
+		if ((port->state != JMRAID_SELF_TEST_STATE_PENDING) || (jmraid_self_test_count_running(scheduler, port->group) >= scheduler->max_per_raid))
+		{
+			continue;
+		}
+		port->start_time = now;
+		if (!jmraid_ata_smart_execute_off_line(jmraid, i, scheduler->subcommand))
+		{
+			debug_print("jmraid_ata_smart_execute_off_line failed\n");
+			port->state = JMRAID_SELF_TEST_STATE_FAILED;
+			port->end_time = now;
+			continue;
+		}
+		port->state = JMRAID_SELF_TEST_STATE_RUNNING;
+		port->status = JMRAID_SELF_TEST_STATUS_IN_PROGRESS << 4;
+	}
+
+	return jmraid_self_test_is_busy(scheduler);
+}
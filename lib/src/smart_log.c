@@ -0,0 +1,143 @@
+#include "smart_log.h"
+#include "commands.h"
+
+#include <string.h>
+
+#ifdef DEBUG_PRINT
+extern void debug_print(const char* format, ...);
+#else
+#define debug_print(...)
+#endif
+
+#define min(X,Y) (((X) < (Y)) ? (X) : (Y))
+
+// the two windows of a page, in words
+#define LOG_WINDOW_FIRST 0xE0
+#define LOG_WINDOW_SECOND ((SECTOR_SIZE / 2) - LOG_WINDOW_FIRST)
+
+// the ATA data of a passthrough answer, after the returned task file
+#define LOG_DATA_OFFSET 0x14
+
+static uint32_t jmraid_log_encode(uint8_t *data_in, const struct jmraid_log_cursor *cursor, uint16_t page, uint8_t window_addr, uint8_t window_size)
+{
+	uint8_t ata_data[16];
+	uint8_t args[JMRAID_ATA_PASSTHROUGH_ARGS_SIZE];
+
+	jmraid_ata_read_log_task_file(ata_data, cursor->is_ext, cursor->log_address, page);
+	jmraid_ata_passthrough_args(args, cursor->sata_port, window_addr, window_size, ata_data);
+	return jmraid_encode_ata_passthrough(data_in, args);
+}
+
+void jmraid_log_cursor_init(struct jmraid_log_cursor *cursor, uint8_t sata_port, uint8_t log_address, bool is_ext, uint16_t page_count)
+{
+	debug_print("jmraid_log_cursor_init | %d | %02X | %d | %u\n", sata_port, log_address, is_ext, page_count);
+
+	memset(cursor, 0, sizeof(struct jmraid_log_cursor));
+	cursor->sata_port = sata_port;
+	cursor->log_address = log_address;
+	cursor->is_ext = is_ext;
+	// see smart_log.h, no way to the later pages of a SMART log
+	cursor->page_count = is_ext ? page_count : min(page_count, 1);
+}
+
+bool jmraid_log_cursor_is_done(const struct jmraid_log_cursor *cursor)
+{
+	return cursor->page >= cursor->page_count;
+}
+
+uint32_t jmraid_ata_read_log(struct jmraid *jmraid, struct jmraid_log_cursor *cursor, uint8_t *data_out, uint32_t page_max)
+{
+	uint8_t data_in[JMRAID_LOG_BATCH_PAGES * 2][JMRAID_COMMAND_MAX_SIZE_IN];
+	uint8_t payload[JMRAID_LOG_BATCH_PAGES * 2][JMRAID_PAYLOAD_SIZE];
+	struct jmraid_batch_item item[JMRAID_LOG_BATCH_PAGES * 2];
+	uint32_t page_read = 0;
+
+	debug_print("jmraid_ata_read_log | %d | %02X | %u | %u\n", cursor->sata_port, cursor->log_address, cursor->page, page_max);
+
+	while ((page_read < page_max) && !jmraid_log_cursor_is_done(cursor))
+	{
+		uint32_t count = min(min(page_max - page_read, (uint32_t)(cursor->page_count - cursor->page)), JMRAID_LOG_BATCH_PAGES);
+		uint32_t i;
+
+		for (i = 0; i < count * 2; i++)
+		{
+			uint16_t page = (uint16_t)(cursor->page + i / 2);
+			if (i % 2 == 0)
+			{
+				item[i].size_in = jmraid_log_encode(data_in[i], cursor, page, 0x00, LOG_WINDOW_FIRST);
+			}
+			else
+			{
+				item[i].size_in = jmraid_log_encode(data_in[i], cursor, page, LOG_WINDOW_FIRST, LOG_WINDOW_SECOND);
+			}
+			item[i].data_in = data_in[i];
+			item[i].data_out = payload[i];
+			item[i].size_out = JMRAID_PAYLOAD_SIZE;
+		}
+
+		jmraid_invoke_batch(jmraid, item, count * 2, true);
+
+		for (i = 0; i < count; i++)
+		{
+			uint8_t *page_data = data_out + page_read * SECTOR_SIZE;
+			if ((item[i * 2].result != JMRAID_RESULT_OK) || (item[i * 2 + 1].result != JMRAID_RESULT_OK))
+			{
+				debug_print("page %u failed | %d | %d\n", cursor->page, item[i * 2].result, item[i * 2 + 1].result);
+				return page_read;
+			}
+			memcpy(page_data, payload[i * 2] + LOG_DATA_OFFSET, LOG_WINDOW_FIRST * 2);
+			memcpy(page_data + LOG_WINDOW_FIRST * 2, payload[i * 2 + 1] + LOG_DATA_OFFSET, LOG_WINDOW_SECOND * 2);
+			cursor->page++;
+			page_read++;
+		}
+	}
+
+	return page_read;
+}
+
+bool jmraid_ata_read_log_directory(struct jmraid *jmraid, uint8_t sata_port, bool is_ext, uint16_t *page_count)
+{
+	struct jmraid_log_cursor cursor;
+	uint8_t data[SECTOR_SIZE];
+	int i;
+
+	debug_print("jmraid_ata_read_log_directory | %d | %d\n", sata_port, is_ext);
+
+	jmraid_log_cursor_init(&cursor, sata_port, JMRAID_LOG_DIRECTORY, is_ext, 1);
+	if (jmraid_ata_read_log(jmraid, &cursor, data, 1) != 1)
+	{
+		debug_print("jmraid_ata_read_log failed\n");
+		return false;
+	}
+
+	// word 0 is the version, word i the page count of log i
+	page_count[0] = 1;
+	for (i = 1; i < 256; i++)
+	{
+		page_count[i] = (uint16_t)(data[i * 2] | (data[i * 2 + 1] << 8));
+	}
+
+	return true;
+}
+
+bool jmraid_log_cursor_open(struct jmraid *jmraid, struct jmraid_log_cursor *cursor, uint8_t sata_port, uint8_t log_address, bool is_ext)
+{
+	uint16_t page_count[256];
+
+	debug_print("jmraid_log_cursor_open | %d | %02X | %d\n", sata_port, log_address, is_ext);
+
+	if (!jmraid_ata_read_log_directory(jmraid, sata_port, is_ext, page_count))
+	{
+		debug_print("jmraid_ata_read_log_directory failed\n");
+		return false;
+	}
+	if (page_count[log_address] == 0)
+	{
+		debug_print("log %02X not supported\n", log_address);
+		return false;
+	}
+
+	jmraid_log_cursor_init(cursor, sata_port, log_address, is_ext, page_count[log_address]);
+
+	return true;
+}
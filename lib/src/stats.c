@@ -0,0 +1,82 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
+#include "stats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+uint64_t stats_get_time(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000 + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void stats_histogram_add(struct stats_histogram *histogram, uint64_t time)
+{
+	uint64_t us = time / 1000;
+	uint32_t i = 0;
+
+	while ((us != 0) && (i < STATS_HISTOGRAM_BUCKETS - 1))
+	{
+		us >>= 1;
+		i++;
+	}
+	histogram->bucket[i]++;
+
+	if ((histogram->count == 0) || (time < histogram->min))
+	{
+		histogram->min = time;
+	}
+	if (time > histogram->max)
+	{
+		histogram->max = time;
+	}
+	histogram->count++;
+	histogram->total += time;
+}
+
+uint64_t stats_histogram_percentile(const struct stats_histogram *histogram, uint32_t percent)
+{
+	uint64_t limit;
+	uint64_t sum = 0;
+	uint32_t i;
+
+	if (histogram->count == 0)
+	{
+		return 0;
+	}
+
+	limit = (histogram->count * percent + 99) / 100;
+	for (i = 0; i < STATS_HISTOGRAM_BUCKETS - 1; i++)
+	{
+		sum += histogram->bucket[i];
+		if (sum >= limit)
+		{
+			uint64_t bound = ((uint64_t)1000) << i;
+			return (bound < histogram->max) ? bound : histogram->max;
+		}
+	}
+
+	return histogram->max;
+}
@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <jmraid.h>
+#include <commands.h>
+#include <crc.h>
+#include <emu.h>
+#include <smart_log.h>
+
+#include "reference.h"
+
+#define DEFAULT_MIN_TIME 200
+
+struct bench_context
+{
+	struct emu emu;
+	struct jmraid jmraid;
+	uint8_t sector[SECTOR_SIZE];
+	uint8_t payload[SECTOR_SIZE];
+	uint8_t smart_data[SECTOR_SIZE];
+	uint8_t smart_thresholds[SECTOR_SIZE];
+	uint8_t log[8 * SECTOR_SIZE];
+	bool is_ok;
+};
+
+struct bench_case
+{
+	const char *name;
+	// sector transfers (or sectors worth of data) per op, for sectors/s
+	uint32_t sectors;
+	bool (*supported)(void);
+	void (*run)(struct bench_context *ctx, uint64_t count);
+};
+
+struct bench_result
+{
+	uint64_t ops;
+	uint64_t elapsed;
+	uint64_t allocs;
+};
+
+int g_print_json = 0;
+int g_min_time = DEFAULT_MIN_TIME;
+const char *g_filter = NULL;
+
+volatile uint32_t g_sink;
+
+// counts heap allocations of the measured loop, glibc only since it relies
+// on its internal entry points to forward to
+uint64_t g_alloc_count = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t num, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+	g_alloc_count++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+	g_alloc_count++;
+	return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	g_alloc_count++;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+#define HAS_ALLOC_COUNT 1
+#else
+#define HAS_ALLOC_COUNT 0
+#endif
+
+uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void bench_scramble(struct bench_context *ctx, uint64_t count)
+{
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		jmraid_scramble(ctx->sector, ctx->sector, SECTOR_SIZE);
+	}
+	g_sink = ctx->sector[0];
+}
+
+void bench_scramble_bitwise(struct bench_context *ctx, uint64_t count)
+{
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		scramble_bitwise(ctx->sector, ctx->sector, SECTOR_SIZE);
+	}
+	g_sink = ctx->sector[0];
+}
+
+void bench_crc(struct bench_context *ctx, uint64_t count)
+{
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		g_sink = jmraid_calc_crc(ctx->sector, SECTOR_SIZE - 4);
+	}
+}
+
+void bench_crc_table(struct bench_context *ctx, uint64_t count)
+{
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		g_sink = crc_calc_table(CRC_SEED, ctx->sector, SECTOR_SIZE - 4);
+	}
+}
+
+void bench_crc_slice8(struct bench_context *ctx, uint64_t count)
+{
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		g_sink = crc_calc_slice8(CRC_SEED, ctx->sector, SECTOR_SIZE - 4);
+	}
+}
+
+void bench_crc_clmul(struct bench_context *ctx, uint64_t count)
+{
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		g_sink = crc_calc_clmul(CRC_SEED, ctx->sector, SECTOR_SIZE - 4);
+	}
+}
+
+void bench_handshake_checksum(struct bench_context *ctx, uint64_t count)
+{
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		g_sink = jmraid_calc_handshake_checksum(ctx->sector, SECTOR_SIZE - 8);
+	}
+}
+
+void bench_parse_chip_info(struct bench_context *ctx, uint64_t count)
+{
+	struct jmraid_chip_info info;
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		parse_jmraid_chip_info(ctx->emu.config.chip_info, &info);
+	}
+	g_sink = info.serial_number;
+}
+
+void bench_parse_sata_info(struct bench_context *ctx, uint64_t count)
+{
+	struct jmraid_sata_info info;
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		parse_jmraid_sata_info(ctx->emu.config.sata_info, &info);
+	}
+	g_sink = info.item[0].port_type;
+}
+
+void bench_parse_sata_port_info(struct bench_context *ctx, uint64_t count)
+{
+	struct jmraid_sata_port_info info;
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		parse_jmraid_sata_port_info(ctx->emu.config.sata_port_info[0], &info);
+	}
+	g_sink = info.port_type;
+}
+
+void bench_parse_raid_port_info(struct bench_context *ctx, uint64_t count)
+{
+	struct jmraid_raid_port_info info;
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		parse_jmraid_raid_port_info(ctx->emu.config.raid_port_info[0], &info);
+	}
+	g_sink = info.level;
+}
+
+void bench_parse_disk_smart_info(struct bench_context *ctx, uint64_t count)
+{
+	struct jmraid_disk_smart_info info;
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		parse_jmraid_disk_smart_info(ctx->smart_data, ctx->smart_thresholds, &info);
+	}
+	g_sink = info.attribute[0].id;
+}
+
+void bench_prepare_command(struct bench_context *ctx, uint64_t count)
+{
+	struct jmraid_command command;
+	uint8_t data_in[2] = { 0x01, 0x01 };
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		jmraid_prepare_command(&ctx->jmraid, &command, data_in, sizeof(data_in));
+	}
+	g_sink = command.sector_data[0];
+}
+
+void bench_invoke_command(struct bench_context *ctx, uint64_t count)
+{
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		ctx->is_ok &= jmraid_invoke_command_get_chip_info(&ctx->jmraid, NULL, ctx->payload, EMU_PAYLOAD_SIZE);
+	}
+}
+
+void bench_get_disk_smart_info(struct bench_context *ctx, uint64_t count)
+{
+	struct jmraid_disk_smart_info info;
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		ctx->is_ok &= jmraid_get_disk_smart_info(&ctx->jmraid, 0, &info);
+	}
+}
+
+void bench_read_log(struct bench_context *ctx, uint64_t count)
+{
+	struct jmraid_log_cursor cursor;
+	uint64_t i;
+	for (i = 0; i < count; i++)
+	{
+		jmraid_log_cursor_init(&cursor, 0, JMRAID_LOG_DEVICE_STATISTICS, true, 8);
+		ctx->is_ok &= (jmraid_ata_read_log(&ctx->jmraid, &cursor, ctx->log, 8) == 8);
+	}
+}
+
+bool has_clmul(void)
+{
+	return crc_has_clmul();
+}
+
+static const struct bench_case TABLE_BENCH_CASE[] =
+{
+	{ "scramble", 1, NULL, bench_scramble },
+	// the bit by bit scramble() TABLE_SCRAMBLE replaced
+	{ "scramble_bitwise", 1, NULL, bench_scramble_bitwise },
+	{ "calc_crc", 1, NULL, bench_crc },
+	{ "calc_crc_table", 1, NULL, bench_crc_table },
+	{ "calc_crc_slice8", 1, NULL, bench_crc_slice8 },
+	{ "calc_crc_clmul", 1, has_clmul, bench_crc_clmul },
+	{ "calc_handshake_checksum", 1, NULL, bench_handshake_checksum },
+	{ "parse_jmraid_chip_info", 1, NULL, bench_parse_chip_info },
+	{ "parse_jmraid_sata_info", 1, NULL, bench_parse_sata_info },
+	{ "parse_jmraid_sata_port_info", 1, NULL, bench_parse_sata_port_info },
+	{ "parse_jmraid_raid_port_info", 1, NULL, bench_parse_raid_port_info },
+	{ "parse_jmraid_disk_smart_info", 2, NULL, bench_parse_disk_smart_info },
+	{ "jmraid_prepare_command", 1, NULL, bench_prepare_command },
+	// one command is a sector write and a sector read
+	{ "jmraid_invoke_command", 2, NULL, bench_invoke_command },
+	{ "jmraid_get_disk_smart_info", 4, NULL, bench_get_disk_smart_info },
+	// the 8 pages of device statistics, two commands per page
+	{ "jmraid_ata_read_log", 32, NULL, bench_read_log },
+};
+
+bool bench_init(struct bench_context *ctx)
+{
+	uint8_t ata_data[16];
+	uint8_t args[JMRAID_ATA_PASSTHROUGH_ARGS_SIZE];
+	uint32_t i;
+
+	memset(ctx, 0, sizeof(struct bench_context));
+	ctx->is_ok = true;
+
+	for (i = 0; i < SECTOR_SIZE; i++)
+	{
+		ctx->sector[i] = (uint8_t)(i * 7);
+	}
+
+	emu_init(&ctx->emu);
+	jmraid_init(&ctx->jmraid);
+	disk_set_emulator(&ctx->jmraid.disk, &ctx->emu);
+	if (!jmraid_session_open(&ctx->jmraid, "emu", 0))
+	{
+		fprintf(stderr, "jmraid_session_open failed\n");
+		return false;
+	}
+
+	// the SMART parser gets the responses as they come off the wire
+	jmraid_ata_smart_task_file(ata_data, 0xD0);
+	jmraid_ata_passthrough_args(args, 0, 0x00, 0xE0, ata_data);
+	if (!jmraid_invoke_command_ata_passthrough(&ctx->jmraid, args, ctx->smart_data, SECTOR_SIZE))
+	{
+		fprintf(stderr, "jmraid_invoke_command_ata_passthrough failed\n");
+		return false;
+	}
+	jmraid_ata_smart_task_file(ata_data, 0xD1);
+	jmraid_ata_passthrough_args(args, 0, 0x00, 0xE0, ata_data);
+	if (!jmraid_invoke_command_ata_passthrough(&ctx->jmraid, args, ctx->smart_thresholds, SECTOR_SIZE))
+	{
+		fprintf(stderr, "jmraid_invoke_command_ata_passthrough failed\n");
+		return false;
+	}
+
+	return true;
+}
+
+// doubles the op count until one pass takes at least g_min_time ms
+void run_case(struct bench_context *ctx, const struct bench_case *bench_case, struct bench_result *result)
+{
+	uint64_t count = 1;
+	uint64_t start;
+
+	bench_case->run(ctx, 16);
+
+	for (;;)
+	{
+		g_alloc_count = 0;
+		start = get_time_ns();
+		bench_case->run(ctx, count);
+		result->elapsed = get_time_ns() - start;
+		result->allocs = g_alloc_count;
+		result->ops = count;
+		if ((result->elapsed >= (uint64_t)g_min_time * 1000000) || (count >= ((uint64_t)1 << 40)))
+		{
+			break;
+		}
+		count *= 2;
+	}
+}
+
+void print_result(const struct bench_case *bench_case, const struct bench_result *result)
+{
+	double ns_per_op = (double)result->elapsed / result->ops;
+	double sectors_per_sec = bench_case->sectors * 1e9 / ns_per_op;
+	double allocs_per_op = (double)result->allocs / result->ops;
+
+	if (g_print_json) {
+		printf("{\"name\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.3f,\"sectors_per_sec\":%.0f,\"allocs_per_op\":", bench_case->name, (unsigned long long)result->ops, ns_per_op, sectors_per_sec);
+		if (HAS_ALLOC_COUNT) {
+			printf("%.3f}\n", allocs_per_op);
+		}
+		else {
+			printf("null}\n");
+		}
+	}
+	else {
+		printf("%-30s %12llu %12.1f %14.0f ", bench_case->name, (unsigned long long)result->ops, ns_per_op, sectors_per_sec);
+		if (HAS_ALLOC_COUNT) {
+			printf("%10.3f\n", allocs_per_op);
+		}
+		else {
+			printf("%10s\n", "-");
+		}
+	}
+}
+
+void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-j] [-t min_time_ms] [-f filter]\n", name);
+	fprintf(stderr, "  -j  one JSON object per case (NDJSON)\n");
+	fprintf(stderr, "  -t  minimum measuring time per case, default %d ms\n", DEFAULT_MIN_TIME);
+	fprintf(stderr, "  -f  only run cases whose name contains filter\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static struct bench_context ctx;
+	size_t i;
+	int c;
+
+	while ((c = getopt(argc, argv, "jt:f:")) != -1) {
+		switch (c) {
+		case 'j':
+			g_print_json = 1;
+			break;
+		case 't':
+			g_min_time = atoi(optarg);
+			break;
+		case 'f':
+			g_filter = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!bench_init(&ctx)) {
+		return 1;
+	}
+
+	if (!g_print_json) {
+		printf("crc kernel: %s\n\n", crc_get_kernel_name());
+		printf("%-30s %12s %12s %14s %10s\n", "case", "ops", "ns/op", "sectors/s", "allocs/op");
+	}
+
+	for (i = 0; i < sizeof(TABLE_BENCH_CASE) / sizeof(TABLE_BENCH_CASE[0]); i++)
+	{
+		const struct bench_case *bench_case = &TABLE_BENCH_CASE[i];
+		struct bench_result result;
+
+		if (g_filter && !strstr(bench_case->name, g_filter)) {
+			continue;
+		}
+		if (bench_case->supported && !bench_case->supported()) {
+			continue;
+		}
+
+		run_case(&ctx, bench_case, &result);
+		print_result(bench_case, &result);
+	}
+
+	jmraid_session_close(&ctx.jmraid);
+
+	if (!ctx.is_ok) {
+		fprintf(stderr, "commands against the emulator failed\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,1127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <getopt.h>
+
+#include <jmraid.h>
+#include <async.h>
+#include <crc.h>
+#include <selftest.h>
+#include <discover.h>
+
+#define DEFAULT_SOCKET_PATH "/run/jmraidd.sock"
+#define DEFAULT_POLL_INTERVAL 60
+
+struct enclosure
+{
+	char disk_name[64];
+	struct jmraid jmraid;
+	bool is_open;
+	bool has_snapshot;
+	uint32_t poll_count;
+	uint32_t error_count;
+	struct jmraid_snapshot snapshot;
+	// filled by the engine while a poll is running
+	struct jmraid_async_snapshot async_snapshot;
+	struct jmraid_snapshot new_snapshot;
+	// the chip info of the last snapshot did not come, see poll_enclosures()
+	bool is_check_needed;
+	// self-tests, the poll thread works on new_self_test and publishes
+	// it as self_test after every step
+	struct jmraid_self_test_scheduler self_test;
+	struct jmraid_self_test_scheduler new_self_test;
+	time_t self_test_time;
+};
+
+struct enclosure *g_enclosures = NULL;
+int g_enclosure_count = 0;
+int g_poll_interval = DEFAULT_POLL_INTERVAL;
+const char *g_socket_path = DEFAULT_SOCKET_PATH;
+int g_foreground = 0;
+int g_metrics_port = 0;
+// -n, check the power mode and leave disks in standby alone
+int g_no_wake = 0;
+// SMART of a disk in standby is served from the last read until it is older
+// than this, then the disk gets woken up; 0 never wakes disks
+int g_smart_max_age = 0;
+// seconds between two rounds of self-tests on every disk, 0 never tests
+int g_self_test_interval = 0;
+uint8_t g_self_test_subcommand = JMRAID_SELF_TEST_SHORT;
+uint32_t g_self_test_max_per_raid = JMRAID_SELF_TEST_DEFAULT_MAX_PER_RAID;
+// one thread polls every enclosure, their commands run side by side
+struct jmraid_async g_async;
+
+volatile sig_atomic_t g_stop = 0;
+pthread_mutex_t g_snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t g_poll_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_poll_cond = PTHREAD_COND_INITIALIZER;
+
+void debug_print(const char* format, ...)
+{
+	va_list arglist;
+	if (!g_foreground)
+	{
+		return;
+	}
+	fprintf(stderr, "[DEBUG] ");
+	va_start(arglist, format);
+	vfprintf(stderr, format, arglist);
+	va_end(arglist);
+}
+
+void log_print(const char* format, ...)
+{
+	va_list arglist;
+	va_start(arglist, format);
+	vfprintf(stderr, format, arglist);
+	va_end(arglist);
+}
+
+void on_signal(int sig)
+{
+	(void)sig;
+	g_stop = 1;
+}
+
+// the bridge stopped answering, drops the snapshot so jmraid_up goes to 0 and
+// the old values do not pass for current ones
+void mark_enclosure_down(struct enclosure *enclosure)
+{
+	pthread_mutex_lock(&g_snapshot_mutex);
+	enclosure->has_snapshot = false;
+	enclosure->error_count++;
+	pthread_mutex_unlock(&g_snapshot_mutex);
+}
+
+// opens the session if it is not, false if the enclosure can not be polled
+// this time
+bool prepare_enclosure(struct enclosure *enclosure)
+{
+	if (!enclosure->is_open)
+	{
+		struct jmraid_smart_memory smart_memory[5];
+		bool is_raid_port_active[5];
+		// a new session, but the same disks, their SMART read last and the
+		// RAID sets seen stay
+		memcpy(smart_memory, enclosure->jmraid.smart_memory, sizeof(smart_memory));
+		memcpy(is_raid_port_active, enclosure->jmraid.is_raid_port_active, sizeof(is_raid_port_active));
+		jmraid_init(&enclosure->jmraid);
+		memcpy(enclosure->jmraid.smart_memory, smart_memory, sizeof(smart_memory));
+		memcpy(enclosure->jmraid.is_raid_port_active, is_raid_port_active, sizeof(is_raid_port_active));
+		jmraid_set_power_mode_check(&enclosure->jmraid, g_no_wake);
+		if (!jmraid_session_open(&enclosure->jmraid, enclosure->disk_name, 0))
+		{
+			log_print("%s: jmraid_session_open failed\n", enclosure->disk_name);
+			mark_enclosure_down(enclosure);
+			return false;
+		}
+		enclosure->is_open = true;
+	}
+
+	return true;
+}
+
+// whether a disk in standby has to be woken up for its SMART data
+bool is_smart_stale(const struct enclosure *enclosure)
+{
+	const struct jmraid_snapshot *snapshot = &enclosure->snapshot;
+	time_t now = time(NULL);
+	int i;
+
+	if ((g_smart_max_age <= 0) || !enclosure->has_snapshot)
+	{
+		return false;
+	}
+	for (i = 0; i < 5; i++)
+	{
+		if (!snapshot->is_power_mode_valid[i] || !jmraid_power_mode_is_standby(snapshot->power_mode[i]))
+		{
+			continue;
+		}
+		if (!snapshot->is_disk_smart_info_valid[i] || (now - snapshot->disk_smart_info_time[i] >= g_smart_max_age))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void store_snapshot(struct jmraid *jmraid, struct jmraid_snapshot *snapshot, bool result, void *context)
+{
+	struct enclosure *enclosure = (struct enclosure *)context;
+	(void)jmraid;
+
+	// the first command of the snapshot doubles as the liveness check
+	enclosure->is_check_needed = !snapshot->is_chip_info_valid;
+
+	pthread_mutex_lock(&g_snapshot_mutex);
+	if (!result)
+	{
+		enclosure->error_count++;
+	}
+	memcpy(&enclosure->snapshot, snapshot, sizeof(struct jmraid_snapshot));
+	enclosure->has_snapshot = true;
+	enclosure->poll_count++;
+	pthread_mutex_unlock(&g_snapshot_mutex);
+}
+
+void poll_enclosures(void)
+{
+	int i;
+
+	for (i = 0; (i < g_enclosure_count) && !g_stop; i++)
+	{
+		struct enclosure *enclosure = &g_enclosures[i];
+		if (prepare_enclosure(enclosure))
+		{
+			jmraid_set_smart_fresh(&enclosure->jmraid, is_smart_stale(enclosure));
+			jmraid_async_get_snapshot(&g_async, &enclosure->jmraid, &enclosure->async_snapshot, &enclosure->new_snapshot, store_snapshot, enclosure);
+		}
+		if (g_async.active_count == g_async.slot_count)
+		{
+			// more enclosures than slots, let this batch finish first
+			jmraid_async_run(&g_async);
+		}
+	}
+	if (jmraid_async_run(&g_async) < 0)
+	{
+		log_print("async engine failed, polling synchronously\n");
+	}
+
+	// only a bridge that did not even answer the chip info gets the
+	// blocking recovery of jmraid_session_check()
+	for (i = 0; (i < g_enclosure_count) && !g_stop; i++)
+	{
+		struct enclosure *enclosure = &g_enclosures[i];
+		if (!enclosure->is_open || !enclosure->is_check_needed)
+		{
+			continue;
+		}
+		enclosure->is_check_needed = false;
+		if (!jmraid_session_check(&enclosure->jmraid))
+		{
+			log_print("%s: bridge not responding, reopening next time\n", enclosure->disk_name);
+			jmraid_session_close(&enclosure->jmraid);
+			enclosure->is_open = false;
+			mark_enclosure_down(enclosure);
+		}
+	}
+}
+
+// starts a round of self-tests once the interval is over and moves the
+// running ones on, after the snapshots so the tests never share the bridge
+// with a poll
+void run_self_tests(void)
+{
+	time_t now = time(NULL);
+	int i;
+
+	if (g_self_test_interval <= 0)
+	{
+		return;
+	}
+
+	for (i = 0; (i < g_enclosure_count) && !g_stop; i++)
+	{
+		struct enclosure *enclosure = &g_enclosures[i];
+		struct jmraid_self_test_scheduler *scheduler = &enclosure->new_self_test;
+		if (!enclosure->is_open || !enclosure->has_snapshot)
+		{
+			continue;
+		}
+		if (!jmraid_self_test_is_busy(scheduler))
+		{
+			if (!enclosure->snapshot.is_sata_info_valid || (now - enclosure->self_test_time < g_self_test_interval))
+			{
+				continue;
+			}
+			log_print("%s: starting self-tests\n", enclosure->disk_name);
+			jmraid_self_test_plan(scheduler, &enclosure->snapshot.sata_info);
+			enclosure->self_test_time = now;
+		}
+		jmraid_self_test_poll(&enclosure->jmraid, scheduler);
+
+		pthread_mutex_lock(&g_snapshot_mutex);
+		memcpy(&enclosure->self_test, scheduler, sizeof(struct jmraid_self_test_scheduler));
+		pthread_mutex_unlock(&g_snapshot_mutex);
+	}
+}
+
+void *poll_thread(void *arg)
+{
+	int i;
+	(void)arg;
+
+	jmraid_async_init(&g_async, g_enclosure_count);
+
+	while (!g_stop)
+	{
+		struct timespec deadline;
+
+		poll_enclosures();
+		run_self_tests();
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += g_poll_interval;
+		pthread_mutex_lock(&g_poll_mutex);
+		while (!g_stop)
+		{
+			if (pthread_cond_timedwait(&g_poll_cond, &g_poll_mutex, &deadline) == ETIMEDOUT)
+			{
+				break;
+			}
+		}
+		pthread_mutex_unlock(&g_poll_mutex);
+	}
+
+	for (i = 0; i < g_enclosure_count; i++)
+	{
+		if (g_enclosures[i].is_open)
+		{
+			jmraid_session_close(&g_enclosures[i].jmraid);
+			g_enclosures[i].is_open = false;
+		}
+	}
+
+	jmraid_async_exit(&g_async);
+
+	return NULL;
+}
+
+void render_snapshot(FILE *out, const struct enclosure *enclosure)
+{
+	const struct jmraid_snapshot *snapshot = &enclosure->snapshot;
+	int i;
+	int j;
+
+	fprintf(out, "enclosure %s\n", enclosure->disk_name);
+	fprintf(out, "poll_count %u\n", enclosure->poll_count);
+	fprintf(out, "error_count %u\n", enclosure->error_count);
+	if (!enclosure->has_snapshot)
+	{
+		fprintf(out, "\n");
+		return;
+	}
+	fprintf(out, "time %lld\n", (long long)snapshot->time);
+
+	if (snapshot->is_chip_info_valid)
+	{
+		const struct jmraid_chip_info *info = &snapshot->chip_info;
+		fprintf(out, "chip.firmware_version %02d.%02d.%02d.%02d\n", info->firmware_version[3], info->firmware_version[2], info->firmware_version[1], info->firmware_version[0]);
+		fprintf(out, "chip.manufacturer %s\n", info->manufacturer);
+		fprintf(out, "chip.product_name %s\n", info->product_name);
+		fprintf(out, "chip.serial_number %u\n", info->serial_number);
+	}
+
+	for (i = 0; snapshot->is_sata_info_valid && (i < 5); i++)
+	{
+		const struct jmraid_sata_info_item *item = &snapshot->sata_info.item[i];
+		fprintf(out, "sata.%d.port_type %u\n", i, item->port_type);
+		if ((item->port_type == 0x01) || (item->port_type == 0x02))
+		{
+			fprintf(out, "sata.%d.model_name %s\n", i, item->model_name);
+			fprintf(out, "sata.%d.serial_number %s\n", i, item->serial_number);
+			fprintf(out, "sata.%d.capacity %llu\n", i, (unsigned long long)item->capacity);
+			fprintf(out, "sata.%d.port_speed %u\n", i, item->port_speed);
+			fprintf(out, "sata.%d.page_0_state %u\n", i, item->page_0_state);
+			fprintf(out, "sata.%d.raid_index %u\n", i, item->page_0_raid_index);
+			fprintf(out, "sata.%d.raid_member_index %u\n", i, item->page_0_raid_member_index);
+		}
+	}
+
+	for (i = 0; i < 5; i++)
+	{
+		const struct jmraid_sata_port_info *info = &snapshot->sata_port_info[i];
+		if (!snapshot->is_sata_port_info_valid[i] || ((info->port_type != 0x01) && (info->port_type != 0x02)))
+		{
+			continue;
+		}
+		fprintf(out, "sata_port.%d.firmware_version %s\n", i, info->firmware_version);
+		fprintf(out, "sata_port.%d.capacity_used %llu\n", i, (unsigned long long)info->capacity_used);
+	}
+
+	for (i = 0; i < 5; i++)
+	{
+		const struct jmraid_raid_port_info *info = &snapshot->raid_port_info[i];
+		if (!snapshot->is_raid_port_info_valid[i])
+		{
+			continue;
+		}
+		fprintf(out, "raid.%d.port_state %u\n", i, info->port_state);
+		if (info->port_state == 0x00)
+		{
+			continue;
+		}
+		fprintf(out, "raid.%d.model_name %s\n", i, info->model_name);
+		fprintf(out, "raid.%d.serial_number %s\n", i, info->serial_number);
+		fprintf(out, "raid.%d.level %u\n", i, info->level);
+		fprintf(out, "raid.%d.capacity %llu\n", i, (unsigned long long)info->capacity);
+		fprintf(out, "raid.%d.state %u\n", i, info->state);
+		fprintf(out, "raid.%d.member_count %u\n", i, info->member_count);
+		fprintf(out, "raid.%d.rebuild_priority %u\n", i, info->rebuild_priority);
+		fprintf(out, "raid.%d.standby_timer %u\n", i, info->standby_timer);
+		fprintf(out, "raid.%d.rebuild_progress %llu\n", i, (unsigned long long)info->rebuild_progress);
+		for (j = 0; (j < info->member_count) && (j < 5); j++)
+		{
+			const struct jmraid_raid_port_info_member *member = &info->member[j];
+			fprintf(out, "raid.%d.member.%d.ready %u\n", i, j, member->ready);
+			fprintf(out, "raid.%d.member.%d.sata_port %u\n", i, j, member->sata_port);
+			fprintf(out, "raid.%d.member.%d.sata_size %llu\n", i, j, (unsigned long long)member->sata_size);
+		}
+	}
+
+	for (i = 0; i < 5; i++)
+	{
+		if (snapshot->is_power_mode_valid[i])
+		{
+			fprintf(out, "power_mode.%d %u\n", i, snapshot->power_mode[i]);
+		}
+	}
+
+	for (i = 0; i < 5; i++)
+	{
+		if (!snapshot->is_disk_smart_info_valid[i])
+		{
+			continue;
+		}
+		fprintf(out, "smart.%d.time %lld\n", i, (long long)snapshot->disk_smart_info_time[i]);
+		for (j = 0; j < 30; j++)
+		{
+			const struct jmraid_disk_smart_info_attribute *attr = &snapshot->disk_smart_info[i].attribute[j];
+			if (attr->id == 0)
+			{
+				continue;
+			}
+			fprintf(out, "smart.%d.%u %u %u %u %llu\n", i, attr->id, attr->current_value, attr->worst_value, attr->threshold, (unsigned long long)attr->raw_value);
+		}
+	}
+
+	for (i = 0; i < 5; i++)
+	{
+		const struct jmraid_self_test_port *port = &enclosure->self_test.port[i];
+		if (port->state == JMRAID_SELF_TEST_STATE_IDLE)
+		{
+			continue;
+		}
+		fprintf(out, "self_test.%d.state %u\n", i, port->state);
+		fprintf(out, "self_test.%d.status %u\n", i, port->status);
+		fprintf(out, "self_test.%d.start_time %lld\n", i, (long long)port->start_time);
+		fprintf(out, "self_test.%d.end_time %lld\n", i, (long long)port->end_time);
+	}
+
+	fprintf(out, "\n");
+}
+
+void print_label_value(FILE *out, const char *value)
+{
+	const char *p;
+	for (p = value; *p; p++)
+	{
+		switch (*p)
+		{
+			case '\\': fputs("\\\\", out); break;
+			case '"': fputs("\\\"", out); break;
+			case '\n': fputs("\\n", out); break;
+			default: fputc(*p, out); break;
+		}
+	}
+}
+
+void print_metric_family(FILE *out, const char *name, const char *type, const char *help)
+{
+	fprintf(out, "# TYPE %s %s\n", name, type);
+	fprintf(out, "# HELP %s %s\n", name, help);
+}
+
+void print_metric_device(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	fprintf(out, "%s{device=\"", name);
+	print_label_value(out, enclosure->disk_name);
+	fprintf(out, "\"");
+}
+
+typedef void (*render_metric_t)(FILE *out, const char *name, const struct enclosure *enclosure);
+
+void render_up(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	print_metric_device(out, name, enclosure);
+	fprintf(out, "} %d\n", enclosure->has_snapshot && enclosure->snapshot.is_chip_info_valid);
+}
+
+void render_poll_errors(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	print_metric_device(out, name, enclosure);
+	fprintf(out, "} %u\n", enclosure->error_count);
+}
+
+void render_poll_time(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	print_metric_device(out, name, enclosure);
+	fprintf(out, "} %lld\n", (long long)enclosure->snapshot.time);
+}
+
+void render_chip_info(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	const struct jmraid_chip_info *info = &enclosure->snapshot.chip_info;
+	char version[16];
+	if (!enclosure->snapshot.is_chip_info_valid)
+	{
+		return;
+	}
+	sprintf(version, "%02d.%02d.%02d.%02d", info->firmware_version[3], info->firmware_version[2], info->firmware_version[1], info->firmware_version[0]);
+	print_metric_device(out, name, enclosure);
+	fprintf(out, ",firmware_version=\"%s\",manufacturer=\"", version);
+	print_label_value(out, info->manufacturer);
+	fprintf(out, "\",product_name=\"");
+	print_label_value(out, info->product_name);
+	fprintf(out, "\",serial_number=\"%u\"} 1\n", info->serial_number);
+}
+
+void render_sata_port_type(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	int i;
+	for (i = 0; enclosure->snapshot.is_sata_info_valid && (i < 5); i++)
+	{
+		print_metric_device(out, name, enclosure);
+		fprintf(out, ",port=\"%d\"} %u\n", i, enclosure->snapshot.sata_info.item[i].port_type);
+	}
+}
+
+void render_sata_port_speed(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	int i;
+	for (i = 0; enclosure->snapshot.is_sata_info_valid && (i < 5); i++)
+	{
+		const struct jmraid_sata_info_item *item = &enclosure->snapshot.sata_info.item[i];
+		if ((item->port_type != 0x01) && (item->port_type != 0x02))
+		{
+			continue;
+		}
+		print_metric_device(out, name, enclosure);
+		fprintf(out, ",port=\"%d\",model_name=\"", i);
+		print_label_value(out, item->model_name);
+		fprintf(out, "\",serial_number=\"");
+		print_label_value(out, item->serial_number);
+		fprintf(out, "\"} %u\n", item->port_speed);
+	}
+}
+
+// the RAID set on RAID port i, NULL if there is none
+const struct jmraid_raid_port_info *get_raid_set(const struct enclosure *enclosure, int i)
+{
+	const struct jmraid_raid_port_info *info = &enclosure->snapshot.raid_port_info[i];
+	if (!enclosure->snapshot.is_raid_port_info_valid[i] || (info->port_state == 0x00))
+	{
+		return NULL;
+	}
+	return info;
+}
+
+void render_raid_state(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	int i;
+	for (i = 0; i < 5; i++)
+	{
+		const struct jmraid_raid_port_info *info = get_raid_set(enclosure, i);
+		if (!info)
+		{
+			continue;
+		}
+		print_metric_device(out, name, enclosure);
+		fprintf(out, ",raid=\"%d\",level=\"%u\"} %u\n", i, info->level, info->state);
+	}
+}
+
+void render_raid_capacity(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	int i;
+	for (i = 0; i < 5; i++)
+	{
+		const struct jmraid_raid_port_info *info = get_raid_set(enclosure, i);
+		if (!info)
+		{
+			continue;
+		}
+		print_metric_device(out, name, enclosure);
+		fprintf(out, ",raid=\"%d\"} %llu\n", i, (unsigned long long)info->capacity);
+	}
+}
+
+void render_raid_member_count(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	int i;
+	for (i = 0; i < 5; i++)
+	{
+		const struct jmraid_raid_port_info *info = get_raid_set(enclosure, i);
+		if (!info)
+		{
+			continue;
+		}
+		print_metric_device(out, name, enclosure);
+		fprintf(out, ",raid=\"%d\"} %u\n", i, info->member_count);
+	}
+}
+
+void render_raid_rebuild_progress(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	int i;
+	for (i = 0; i < 5; i++)
+	{
+		const struct jmraid_raid_port_info *info = get_raid_set(enclosure, i);
+		if (!info)
+		{
+			continue;
+		}
+		print_metric_device(out, name, enclosure);
+		fprintf(out, ",raid=\"%d\"} %.6f\n", i, info->capacity ? (double)info->rebuild_progress / info->capacity : 0.0);
+	}
+}
+
+void render_raid_member_ready(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	int i;
+	int j;
+	for (i = 0; i < 5; i++)
+	{
+		const struct jmraid_raid_port_info *info = get_raid_set(enclosure, i);
+		if (!info)
+		{
+			continue;
+		}
+		for (j = 0; (j < info->member_count) && (j < 5); j++)
+		{
+			print_metric_device(out, name, enclosure);
+			fprintf(out, ",raid=\"%d\",member=\"%d\",sata_port=\"%u\"} %u\n", i, j, info->member[j].sata_port, info->member[j].ready);
+		}
+	}
+}
+
+void render_power_mode(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	int i;
+	for (i = 0; i < 5; i++)
+	{
+		if (!enclosure->snapshot.is_power_mode_valid[i])
+		{
+			continue;
+		}
+		print_metric_device(out, name, enclosure);
+		fprintf(out, ",port=\"%d\"} %u\n", i, enclosure->snapshot.power_mode[i]);
+	}
+}
+
+void render_smart_time(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	int i;
+	for (i = 0; i < 5; i++)
+	{
+		if (!enclosure->snapshot.is_disk_smart_info_valid[i])
+		{
+			continue;
+		}
+		print_metric_device(out, name, enclosure);
+		fprintf(out, ",port=\"%d\"} %lld\n", i, (long long)enclosure->snapshot.disk_smart_info_time[i]);
+	}
+}
+
+void render_self_test_status(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	int i;
+	for (i = 0; i < 5; i++)
+	{
+		const struct jmraid_self_test_port *port = &enclosure->self_test.port[i];
+		if ((port->state != JMRAID_SELF_TEST_STATE_RUNNING) && (port->state != JMRAID_SELF_TEST_STATE_DONE))
+		{
+			continue;
+		}
+		print_metric_device(out, name, enclosure);
+		fprintf(out, ",port=\"%d\"} %u\n", i, port->status);
+	}
+}
+
+typedef unsigned long long (*smart_value_t)(const struct jmraid_disk_smart_info_attribute *attr);
+
+// one sample per attribute of every disk with SMART, value picks the field
+void render_smart_attributes(FILE *out, const char *name, const struct enclosure *enclosure, smart_value_t value)
+{
+	int i;
+	int j;
+	for (i = 0; i < 5; i++)
+	{
+		if (!enclosure->snapshot.is_disk_smart_info_valid[i])
+		{
+			continue;
+		}
+		for (j = 0; j < 30; j++)
+		{
+			const struct jmraid_disk_smart_info_attribute *attr = &enclosure->snapshot.disk_smart_info[i].attribute[j];
+			if (attr->id == 0)
+			{
+				continue;
+			}
+			print_metric_device(out, name, enclosure);
+			fprintf(out, ",port=\"%d\",id=\"%u\"} %llu\n", i, attr->id, value(attr));
+		}
+	}
+}
+
+unsigned long long get_smart_current_value(const struct jmraid_disk_smart_info_attribute *attr)
+{
+	return attr->current_value;
+}
+
+unsigned long long get_smart_worst_value(const struct jmraid_disk_smart_info_attribute *attr)
+{
+	return attr->worst_value;
+}
+
+unsigned long long get_smart_threshold(const struct jmraid_disk_smart_info_attribute *attr)
+{
+	return attr->threshold;
+}
+
+unsigned long long get_smart_raw_value(const struct jmraid_disk_smart_info_attribute *attr)
+{
+	return attr->raw_value;
+}
+
+void render_smart_value(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	render_smart_attributes(out, name, enclosure, get_smart_current_value);
+}
+
+void render_smart_worst_value(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	render_smart_attributes(out, name, enclosure, get_smart_worst_value);
+}
+
+void render_smart_threshold(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	render_smart_attributes(out, name, enclosure, get_smart_threshold);
+}
+
+void render_smart_raw_value(FILE *out, const char *name, const struct enclosure *enclosure)
+{
+	render_smart_attributes(out, name, enclosure, get_smart_raw_value);
+}
+
+struct metric_family
+{
+	const char *name;
+	const char *suffix;
+	const char *type;
+	const char *help;
+	render_metric_t render;
+	bool needs_snapshot;
+};
+
+static const struct metric_family TABLE_METRIC_FAMILY[] =
+{
+	{ "jmraid_up", "", "gauge", "Whether the last poll of the bridge succeeded.", render_up, false },
+	{ "jmraid_poll_errors", "_total", "counter", "Polls that failed at least partially.", render_poll_errors, false },
+	{ "jmraid_last_poll_timestamp_seconds", "", "gauge", "Time of the cached snapshot.", render_poll_time, true },
+	{ "jmraid_chip", "_info", "info", "Bridge chip identity.", render_chip_info, true },
+	{ "jmraid_sata_port_type", "", "gauge", "SATA port type (0 no device, 1 hard disk, 2 RAID disk, 6 off, 7 host).", render_sata_port_type, true },
+	{ "jmraid_sata_port_speed", "", "gauge", "SATA link generation (0 no connection).", render_sata_port_speed, true },
+	{ "jmraid_raid_state", "", "gauge", "RAID state (0 broken, 1 degraded, 2 rebuilding, 3 normal, 4 expansion, 5 backup).", render_raid_state, true },
+	{ "jmraid_raid_capacity_bytes", "", "gauge", "RAID capacity.", render_raid_capacity, true },
+	{ "jmraid_raid_member_count", "", "gauge", "Number of RAID members.", render_raid_member_count, true },
+	{ "jmraid_raid_rebuild_progress_ratio", "", "gauge", "Rebuild progress.", render_raid_rebuild_progress, true },
+	{ "jmraid_raid_member_ready", "", "gauge", "Whether the RAID member is ready.", render_raid_member_ready, true },
+	{ "jmraid_disk_power_mode", "", "gauge", "ATA power mode of the disk (0 standby, 128 idle, 255 active or idle).", render_power_mode, true },
+	{ "jmraid_smart_timestamp_seconds", "", "gauge", "Time the SMART data was read from the disk, older while it sleeps.", render_smart_time, true },
+	{ "jmraid_self_test_status", "", "gauge", "SMART self-test execution status byte (upper nibble 15 while running with the remaining tenths below, 0 passed).", render_self_test_status, false },
+	{ "jmraid_smart_value", "", "gauge", "Normalized SMART attribute value.", render_smart_value, true },
+	{ "jmraid_smart_worst_value", "", "gauge", "Worst normalized SMART attribute value.", render_smart_worst_value, true },
+	{ "jmraid_smart_threshold", "", "gauge", "SMART attribute threshold.", render_smart_threshold, true },
+	{ "jmraid_smart_raw_value", "", "gauge", "Raw SMART attribute value.", render_smart_raw_value, true },
+};
+
+void render_metrics(FILE *out)
+{
+	char sample[64];
+	size_t i;
+	int j;
+	for (i = 0; i < sizeof(TABLE_METRIC_FAMILY) / sizeof(TABLE_METRIC_FAMILY[0]); i++)
+	{
+		const struct metric_family *family = &TABLE_METRIC_FAMILY[i];
+		print_metric_family(out, family->name, family->type, family->help);
+		snprintf(sample, sizeof(sample), "%s%s", family->name, family->suffix);
+		for (j = 0; j < g_enclosure_count; j++)
+		{
+			const struct enclosure *enclosure = &g_enclosures[j];
+			if (family->needs_snapshot && !enclosure->has_snapshot)
+			{
+				continue;
+			}
+			family->render(out, sample, enclosure);
+		}
+	}
+	fprintf(out, "# EOF\n");
+}
+
+void write_all(int fd, const char *data, size_t size)
+{
+	size_t done = 0;
+	while (done < size)
+	{
+		ssize_t len = write(fd, data + done, size - done);
+		if (len <= 0)
+		{
+			break;
+		}
+		done += len;
+	}
+}
+
+void serve_metrics_client(int client)
+{
+	char request[1024];
+	char header[256];
+	char *buffer = NULL;
+	size_t size = 0;
+	struct pollfd pfd;
+	ssize_t len;
+	FILE *out;
+
+	// a scrape sends its request line right away, don't let idle
+	// connections block the loop
+	pfd.fd = client;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 1000) <= 0)
+	{
+		return;
+	}
+	len = read(client, request, sizeof(request) - 1);
+	if (len <= 0)
+	{
+		return;
+	}
+	request[len] = 0;
+
+	if ((strncmp(request, "GET /metrics ", 13) != 0) && (strncmp(request, "GET / ", 6) != 0))
+	{
+		const char *response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		write_all(client, response, strlen(response));
+		return;
+	}
+
+	out = open_memstream(&buffer, &size);
+	if (!out)
+	{
+		return;
+	}
+	pthread_mutex_lock(&g_snapshot_mutex);
+	render_metrics(out);
+	pthread_mutex_unlock(&g_snapshot_mutex);
+	fclose(out);
+
+	snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", size);
+	write_all(client, header, strlen(header));
+	write_all(client, buffer, size);
+	free(buffer);
+}
+
+void serve_client(int client)
+{
+	char *buffer = NULL;
+	size_t size = 0;
+	FILE *out;
+	int i;
+
+	out = open_memstream(&buffer, &size);
+	if (!out)
+	{
+		return;
+	}
+	pthread_mutex_lock(&g_snapshot_mutex);
+	for (i = 0; i < g_enclosure_count; i++)
+	{
+		render_snapshot(out, &g_enclosures[i]);
+	}
+	pthread_mutex_unlock(&g_snapshot_mutex);
+	fclose(out);
+
+	write_all(client, buffer, size);
+	free(buffer);
+}
+
+int open_socket(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+	{
+		log_print("socket failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path);
+	if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(fd, 16) != 0))
+	{
+		log_print("bind %s failed: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	chmod(path, 0660);
+
+	return fd;
+}
+
+int open_metrics_socket(int port)
+{
+	struct sockaddr_in addr;
+	int fd;
+	int on = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1)
+	{
+		log_print("socket failed: %s\n", strerror(errno));
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(fd, 16) != 0))
+	{
+		log_print("bind port %d failed: %s\n", port, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// parses a decimal, 0x hex or 0 octal number, nothing else on the line
+bool parse_uint32(const char *text, uint32_t *value)
+{
+	unsigned long number;
+	char *end;
+	if ((*text < '0') || (*text > '9'))
+	{
+		return false;
+	}
+	errno = 0;
+	number = strtoul(text, &end, 0);
+	if ((*end != '\0') || (errno == ERANGE) || (number > 0xFFFFFFFFUL))
+	{
+		return false;
+	}
+	*value = (uint32_t)number;
+	return true;
+}
+
+// parse_uint32() for the int options, at most max
+bool parse_int(const char *text, int max, int *value)
+{
+	uint32_t number;
+	if (!parse_uint32(text, &number) || (number > (uint32_t)max))
+	{
+		return false;
+	}
+	*value = (int)number;
+	return true;
+}
+
+void usage(void)
+{
+	fprintf(stderr, "usage: jmraidd [-f] [-i interval] [-s socket] [-p metrics_port] [-n] [-w smart_max_age] [-e self_test_interval] [-E short|extended] [-m tests_per_raid] [disk ...]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct discover_device *devices;
+	struct sigaction sa;
+	pthread_t thread;
+	int server;
+	int metrics_server = -1;
+	int c;
+	int i;
+
+	while ((c = getopt(argc, argv, "fi:s:p:nw:e:E:m:")) != -1) {
+		switch (c) {
+		case 'f':
+			g_foreground = 1;
+			break;
+		case 'i':
+			if (!parse_int(optarg, INT_MAX, &g_poll_interval)) {
+				fprintf(stderr, "invalid poll interval \"%s\"\n", optarg);
+				return 1;
+			}
+			if (g_poll_interval == 0) {
+				g_poll_interval = DEFAULT_POLL_INTERVAL;
+			}
+			break;
+		case 's':
+			g_socket_path = optarg;
+			break;
+		case 'p':
+			if (!parse_int(optarg, 65535, &g_metrics_port)) {
+				fprintf(stderr, "invalid metrics port \"%s\"\n", optarg);
+				return 1;
+			}
+			break;
+		case 'n':
+			g_no_wake = 1;
+			break;
+		case 'w':
+			if (!parse_int(optarg, INT_MAX, &g_smart_max_age)) {
+				fprintf(stderr, "invalid SMART max age \"%s\"\n", optarg);
+				return 1;
+			}
+			break;
+		case 'e':
+			if (!parse_int(optarg, INT_MAX, &g_self_test_interval)) {
+				fprintf(stderr, "invalid self-test interval \"%s\"\n", optarg);
+				return 1;
+			}
+			break;
+		case 'E':
+			if (strcmp(optarg, "short") == 0) {
+				g_self_test_subcommand = JMRAID_SELF_TEST_SHORT;
+			}
+			else if (strcmp(optarg, "extended") == 0) {
+				g_self_test_subcommand = JMRAID_SELF_TEST_EXTENDED;
+			}
+			else {
+				usage();
+				return 1;
+			}
+			break;
+		case 'm':
+			if (!parse_uint32(optarg, &g_self_test_max_per_raid)) {
+				fprintf(stderr, "invalid number of tests per RAID set \"%s\"\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	g_enclosures = (struct enclosure *)calloc(DISCOVER_MAX_DEVICES, sizeof(struct enclosure));
+	devices = (struct discover_device *)calloc(DISCOVER_MAX_DEVICES, sizeof(struct discover_device));
+	if (!g_enclosures || !devices) {
+		log_print("out of memory\n");
+		return 1;
+	}
+	if (optind < argc) {
+		for (; (optind < argc) && (g_enclosure_count < DISCOVER_MAX_DEVICES); optind++)
+		{
+			strncpy(g_enclosures[g_enclosure_count++].disk_name, argv[optind], sizeof(g_enclosures[0].disk_name) - 1);
+		}
+	}
+	else {
+		int count = discover_jmraid_devices(devices, DISCOVER_MAX_DEVICES);
+		for (i = 0; i < count; i++)
+		{
+			strcpy(g_enclosures[g_enclosure_count++].disk_name, devices[i].disk_name);
+		}
+	}
+	free(devices);
+	if (g_enclosure_count == 0) {
+		log_print("no enclosures found\n");
+		return 1;
+	}
+	// the first round of self-tests comes one interval after the start, a
+	// restart does not start one right away
+	for (i = 0; i < g_enclosure_count; i++)
+	{
+		jmraid_self_test_init(&g_enclosures[i].new_self_test, g_self_test_subcommand, g_self_test_max_per_raid);
+		memcpy(&g_enclosures[i].self_test, &g_enclosures[i].new_self_test, sizeof(struct jmraid_self_test_scheduler));
+		g_enclosures[i].self_test_time = time(NULL);
+	}
+
+	server = open_socket(g_socket_path);
+	if (server == -1) {
+		return 1;
+	}
+	if (g_metrics_port > 0) {
+		metrics_server = open_metrics_socket(g_metrics_port);
+		if (metrics_server == -1) {
+			return 1;
+		}
+	}
+
+	if (!g_foreground && (daemon(0, 0) != 0)) {
+		log_print("daemon failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	// before the threads start, see crc_init()
+	crc_init();
+	if (pthread_create(&thread, NULL, poll_thread, NULL) != 0) {
+		log_print("pthread_create failed\n");
+		return 1;
+	}
+
+	while (!g_stop)
+	{
+		struct pollfd pfd[2];
+		pfd[0].fd = server;
+		pfd[0].events = POLLIN;
+		pfd[0].revents = 0;
+		pfd[1].fd = metrics_server;
+		pfd[1].events = POLLIN;
+		pfd[1].revents = 0;
+		if (poll(pfd, (metrics_server != -1) ? 2 : 1, 1000) > 0) {
+			if (pfd[0].revents & POLLIN) {
+				int client = accept(server, NULL, NULL);
+				if (client != -1) {
+					serve_client(client);
+					close(client);
+				}
+			}
+			if (pfd[1].revents & POLLIN) {
+				int client = accept(metrics_server, NULL, NULL);
+				if (client != -1) {
+					serve_metrics_client(client);
+					close(client);
+				}
+			}
+		}
+	}
+
+	pthread_mutex_lock(&g_poll_mutex);
+	pthread_cond_broadcast(&g_poll_cond);
+	pthread_mutex_unlock(&g_poll_mutex);
+	pthread_join(thread, NULL);
+
+	close(server);
+	if (metrics_server != -1) {
+		close(metrics_server);
+	}
+	unlink(g_socket_path);
+	free(g_enclosures);
+
+	return 0;
+}
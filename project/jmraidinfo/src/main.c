@@ -1,15 +1,52 @@
 #include <stdio.h>
+#include <stdlib.h>
 #ifdef _WIN32
 #include <windows.h>
 #endif
 #include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 #include <getopt.h>
-#include <json-c/json.h>
 
 #include <jmraid.h>
+#include <crc.h>
+#include <discover.h>
+#include <cache.h>
+#include <json.h>
+
+// parts of the report selected with -o, each only costs the commands it needs
+#define SECTION_CHIP 0x01
+#define SECTION_PORTS 0x02
+#define SECTION_RAID 0x04
+#define SECTION_SMART 0x08
+#define SECTION_ALL (SECTION_CHIP | SECTION_PORTS | SECTION_RAID | SECTION_SMART)
+
+#ifdef _WIN32
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
 
 int g_print_json = 0;
-int g_print_indent = 0;
+int g_print_ndjson = 0;
+int g_parallel = 0;
+int g_scan_all = 0;
+int g_print_stats = 0;
+int g_strict = 0;
+// -n, leave disks in standby alone instead of spinning them up for SMART
+int g_no_wake = 0;
+uint32_t g_sections = SECTION_ALL;
+int g_use_cache = 0;
+const char *g_cache_dir = CACHE_DEFAULT_DIR;
+uint32_t g_cache_ttl = CACHE_DEFAULT_TTL;
+// per thread, so parallel probes can indent into their own buffer
+THREAD_LOCAL int g_print_indent = 0;
+THREAD_LOCAL FILE *g_print_file = NULL;
+enum disk_backend g_disk_backend = DISK_BACKEND_DEFAULT;
+uint32_t g_disk_timeout = DISK_DEFAULT_TIMEOUT;
 
 const char *get_raid_state_text(uint8_t raid_state)
 {
@@ -137,16 +174,21 @@ const char *get_smart_attribute_name(uint8_t id)
 	}
 }
 
+FILE *get_print_file(void)
+{
+	return g_print_file ? g_print_file : stdout;
+}
+
 void print(const char* format, ...)
 {
 	va_list arglist;
 	int len = g_print_indent * 2;
 	while (len-- > 0)
 	{
-		putchar(' ');
+		fputc(' ', get_print_file());
 	}
 	va_start(arglist, format);
-	vprintf(format, arglist);
+	vfprintf(get_print_file(), format, arglist);
 	va_end(arglist);
 }
 
@@ -156,11 +198,11 @@ void debug_print(const char* format, ...)
 	int len = g_print_indent * 2;
 	while (len-- > 0)
 	{
-		putchar(' ');
+		fputc(' ', get_print_file());
 	}
-	printf("[DEBUG] ");
+	fprintf(get_print_file(), "[DEBUG] ");
 	va_start(arglist, format);
-	vprintf(format, arglist);
+	vfprintf(get_print_file(), format, arglist);
 	va_end(arglist);
 }
 
@@ -174,43 +216,43 @@ void print_buffer(const void *data, uint32_t size, bool print_addr, bool print_t
 		int len = g_print_indent * 2;
 		while (len-- > 0)
 		{
-			putchar(' ');
+			fputc(' ', get_print_file());
 		}
 		if (print_addr)
 		{
-			printf("%08X | ", i);
+			fprintf(get_print_file(), "%08X | ", i);
 		}
 		for (j = i; j < i + 16; j++)
 		{
 			if (j > i)
 			{
-				putchar(' ');
+				fputc(' ', get_print_file());
 			}
 			if (j < size)
 			{
-				printf("%02X", d[j]);
+				fprintf(get_print_file(), "%02X", d[j]);
 			}
 			else
 			{
-				printf("  ");
+				fprintf(get_print_file(), "  ");
 			}
 		}
 		if (print_text)
 		{
-			printf(" | ");
+			fprintf(get_print_file(), " | ");
 			for (j = i; j < i + 16; j++)
 			{
 				if (j < size)
 				{
-					putchar((d[j] >= 32) && (d[j] < 128) ? d[j] : '.');
+					fputc((d[j] >= 32) && (d[j] < 128) ? d[j] : '.', get_print_file());
 				}
 				else
 				{
-					putchar(' ');
+					fputc(' ', get_print_file());
 				}
 			}
 		}
-		printf("\n");
+		fprintf(get_print_file(), "\n");
 	}
 }
 
@@ -222,17 +264,17 @@ void print_chip_info(const struct jmraid_chip_info *info)
 	print("Serial number    = %d\n", info->serial_number);
 }
 
-void add_chip_info(json_object* parent, const struct jmraid_chip_info* info)
+void add_chip_info(struct json_writer *json, const struct jmraid_chip_info* info)
 {
-	json_object* obj = json_object_new_object();
 	char str[64];
 
 	sprintf(str, "%02d.%02d.%02d.%02d", info->firmware_version[3], info->firmware_version[2], info->firmware_version[1], info->firmware_version[0]);
-	json_object_object_add(obj, "firmware_version", json_object_new_string(str));
-	json_object_object_add(obj, "manufacturer", json_object_new_string(info->manufacturer));
-	json_object_object_add(obj, "product_name", json_object_new_string(info->product_name));
-	json_object_object_add(obj, "serial_number", json_object_new_int64(info->serial_number));
-	json_object_object_add(parent, "chip_info", obj);
+	json_begin_object(json, "chip_info");
+	json_add_string(json, "firmware_version", str);
+	json_add_string(json, "manufacturer", info->manufacturer);
+	json_add_string(json, "product_name", info->product_name);
+	json_add_int(json, "serial_number", info->serial_number);
+	json_end_object(json);
 }
 
 
@@ -269,32 +311,32 @@ void print_sata_info(const struct jmraid_sata_info *info)
 	}
 }
 
-void add_sata_info(json_object* parent, const struct jmraid_sata_info* info)
+void add_sata_info(struct json_writer *json, const struct jmraid_sata_info* info)
 {
 	int i;
-	json_object* arr = json_object_new_array();
+	json_begin_array(json, "sata_info");
 	for (i = 0; i < 5; i++)
 	{
 		const struct jmraid_sata_info_item* item = &info->item[i];
-		json_object* obj = json_object_new_object();
-		json_object_object_add(obj, "port", json_object_new_int(item->port));
-		json_object_object_add(obj, "type", json_object_new_int(item->port_type));
-		json_object_object_add(obj, "type_str", json_object_new_string(get_sata_port_type_text(item->port_type)));
+		json_begin_object(json, NULL);
+		json_add_int(json, "port", item->port);
+		json_add_int(json, "type", item->port_type);
+		json_add_string(json, "type_str", get_sata_port_type_text(item->port_type));
 		if ((item->port_type == 0x01) || (item->port_type == 0x02))
 		{
-			json_object_object_add(obj, "model_name", json_object_new_string(item->model_name));
-			json_object_object_add(obj, "serial_number", json_object_new_string(item->serial_number));
-			json_object_object_add(obj, "capacity", json_object_new_int64(item->capacity));
-			json_object_object_add(obj, "port_speed", json_object_new_int(item->port_speed));
-			json_object_object_add(obj, "port_speed_str", json_object_new_string(get_sata_port_speed_text(item->port_speed)));
-			json_object_object_add(obj, "page_0_state", json_object_new_int(item->page_0_state));
-			json_object_object_add(obj, "page_0_state_str", json_object_new_string(get_sata_page_state_text(item->page_0_state)));
-			json_object_object_add(obj, "raid_index", json_object_new_int(item->page_0_raid_index));
-			json_object_object_add(obj, "raid_member_index", json_object_new_int(item->page_0_raid_member_index));
+			json_add_string(json, "model_name", item->model_name);
+			json_add_string(json, "serial_number", item->serial_number);
+			json_add_int(json, "capacity", item->capacity);
+			json_add_int(json, "port_speed", item->port_speed);
+			json_add_string(json, "port_speed_str", get_sata_port_speed_text(item->port_speed));
+			json_add_int(json, "page_0_state", item->page_0_state);
+			json_add_string(json, "page_0_state_str", get_sata_page_state_text(item->page_0_state));
+			json_add_int(json, "raid_index", item->page_0_raid_index);
+			json_add_int(json, "raid_member_index", item->page_0_raid_member_index);
 		}
-		json_object_array_add(arr, obj);
+		json_end_object(json);
 	}
-	json_object_object_add(parent, "sata_info", arr);
+	json_end_array(json);
 }
 
 
@@ -319,25 +361,26 @@ void print_sata_port_info(const struct jmraid_sata_port_info *info)
 	}
 }
 
-void add_sata_port_info(json_object* parent, const struct jmraid_sata_port_info* info)
+// an element of the "sata_port_info" array
+void add_sata_port_info(struct json_writer *json, const struct jmraid_sata_port_info* info)
 {
-	json_object* obj = json_object_new_object();
-	json_object_object_add(obj, "port", json_object_new_int(info->port));
-	json_object_object_add(obj, "type", json_object_new_int(info->port_type));
-	json_object_object_add(obj, "type_str", json_object_new_string(get_sata_port_type_text(info->port_type)));
+	json_begin_object(json, NULL);
+	json_add_int(json, "port", info->port);
+	json_add_int(json, "type", info->port_type);
+	json_add_string(json, "type_str", get_sata_port_type_text(info->port_type));
 	if ((info->port_type == 0x01) || (info->port_type == 0x02))
 	{
-		json_object_object_add(obj, "model_name", json_object_new_string(info->model_name));
-		json_object_object_add(obj, "serial_number", json_object_new_string(info->serial_number));
-		json_object_object_add(obj, "firmware_version", json_object_new_string(info->firmware_version));
-		json_object_object_add(obj, "capacity", json_object_new_int64(info->capacity));
-		json_object_object_add(obj, "capacity_used", json_object_new_int64(info->capacity_used));
-		json_object_object_add(obj, "page_0_state", json_object_new_int(info->page_0_state));
-		json_object_object_add(obj, "page_0_state_str", json_object_new_string(get_sata_page_state_text(info->page_0_state)));
-		json_object_object_add(obj, "raid_index", json_object_new_int(info->page_0_raid_index));
-		json_object_object_add(obj, "raid_member_index", json_object_new_int(info->page_0_raid_member_index));
+		json_add_string(json, "model_name", info->model_name);
+		json_add_string(json, "serial_number", info->serial_number);
+		json_add_string(json, "firmware_version", info->firmware_version);
+		json_add_int(json, "capacity", info->capacity);
+		json_add_int(json, "capacity_used", info->capacity_used);
+		json_add_int(json, "page_0_state", info->page_0_state);
+		json_add_string(json, "page_0_state_str", get_sata_page_state_text(info->page_0_state));
+		json_add_int(json, "raid_index", info->page_0_raid_index);
+		json_add_int(json, "raid_member_index", info->page_0_raid_member_index);
 	}
-	json_object_object_add(parent, "sata_port_info", obj);
+	json_end_object(json);
 }
 
 void print_raid_port_info(const struct jmraid_raid_port_info *info)
@@ -378,43 +421,45 @@ void print_raid_port_info(const struct jmraid_raid_port_info *info)
 	}
 }
 
-void add_raid_port_info(json_object* parent, const struct jmraid_raid_port_info* info)
+// an element of the "raid_port_info" array
+void add_raid_port_info(struct json_writer *json, const struct jmraid_raid_port_info* info)
 {
-	json_object* obj = json_object_new_object();
-	json_object_object_add(obj, "port", json_object_new_int(info->port_state));
+	json_begin_object(json, NULL);
+	json_add_int(json, "port", info->port_state);
 	if (info->port_state != 0x00)
 	{
 		int i;
-		json_object* arr = json_object_new_array();
-		json_object_object_add(obj, "model_name", json_object_new_string(info->model_name));
-		json_object_object_add(obj, "serial_number", json_object_new_string(info->serial_number));
-		json_object_object_add(obj, "raid_level", json_object_new_int(info->level));
-		json_object_object_add(obj, "raid_level_str", json_object_new_string(get_raid_level_text(info->level)));
-		json_object_object_add(obj, "capacity", json_object_new_int64(info->capacity));
-		json_object_object_add(obj, "state", json_object_new_int(info->state));
-		json_object_object_add(obj, "state_str", json_object_new_string(get_raid_state_text(info->state)));
-		json_object_object_add(obj, "member_count", json_object_new_int(info->member_count));
-		json_object_object_add(obj, "rebuild_priority", json_object_new_int(info->rebuild_priority));
-		json_object_object_add(obj, "rebuild_priority_str", json_object_new_string(get_raid_rebuild_priority_text(info->rebuild_priority)));
-		json_object_object_add(obj, "standby_timer", json_object_new_int(info->standby_timer));
-		json_object_object_add(obj, "password", json_object_new_string(info->password));
-		json_object_object_add(obj, "rebuild_progress", json_object_new_int64(info->rebuild_progress));
+		json_add_string(json, "model_name", info->model_name);
+		json_add_string(json, "serial_number", info->serial_number);
+		json_add_int(json, "raid_level", info->level);
+		json_add_string(json, "raid_level_str", get_raid_level_text(info->level));
+		json_add_int(json, "capacity", info->capacity);
+		json_add_int(json, "state", info->state);
+		json_add_string(json, "state_str", get_raid_state_text(info->state));
+		json_add_int(json, "member_count", info->member_count);
+		json_add_int(json, "rebuild_priority", info->rebuild_priority);
+		json_add_string(json, "rebuild_priority_str", get_raid_rebuild_priority_text(info->rebuild_priority));
+		json_add_int(json, "standby_timer", info->standby_timer);
+		json_add_string(json, "password", info->password);
+		json_add_int(json, "rebuild_progress", info->rebuild_progress);
 
+		json_begin_array(json, "members");
 		for (i = 0; i < info->member_count; i++)
 		{
 			const struct jmraid_raid_port_info_member* member = &info->member[i];
-			json_object* obj2 = json_object_new_object();
-			json_object_object_add(obj2, "id", json_object_new_int(i));
-			json_object_object_add(obj2, "ready", json_object_new_int(member->ready));
-			json_object_object_add(obj2, "lba48_support", json_object_new_int(member->lba48_support));
-			json_object_object_add(obj2, "sata_port", json_object_new_int(member->sata_port));
-			json_object_object_add(obj2, "sata_page", json_object_new_int(member->sata_page));
-			json_object_object_add(obj2, "sata_base", json_object_new_int(member->sata_base));
-			json_object_object_add(obj2, "sata_size", json_object_new_int64(member->sata_size));
-			json_object_array_add(arr, obj2);
+			json_begin_object(json, NULL);
+			json_add_int(json, "id", i);
+			json_add_int(json, "ready", member->ready);
+			json_add_int(json, "lba48_support", member->lba48_support);
+			json_add_int(json, "sata_port", member->sata_port);
+			json_add_int(json, "sata_page", member->sata_page);
+			json_add_int(json, "sata_base", member->sata_base);
+			json_add_int(json, "sata_size", member->sata_size);
+			json_end_object(json);
 		}
+		json_end_array(json);
 	}
-	json_object_object_add(parent, "raid_port_info", obj);
+	json_end_object(json);
 }
 
 void print_disk_smart_info(const struct jmraid_disk_smart_info *info)
@@ -430,39 +475,234 @@ void print_disk_smart_info(const struct jmraid_disk_smart_info *info)
 	}
 }
 
-void add_disk_smart_info(json_object* parent, const struct jmraid_disk_smart_info* info)
+// an element of the "disk_smart_info" array
+void add_disk_smart_info(struct json_writer *json, int port, const struct jmraid_disk_smart_info* info)
 {
 	int i;
-	json_object* arr = json_object_new_array();
+	json_begin_object(json, NULL);
+	json_add_int(json, "port", port);
+	json_begin_array(json, "attributes");
 	for (i = 0; i < 30; i++)
 	{
 		const struct jmraid_disk_smart_info_attribute* attr = &info->attribute[i];
 		if (attr->id != 0)
 		{
-			json_object* obj2 = json_object_new_object();
-			json_object_object_add(obj2, "id", json_object_new_int(attr->id));
-			json_object_object_add(obj2, "name", json_object_new_string(get_smart_attribute_name(attr->id)));
-			json_object_object_add(obj2, "flags", json_object_new_int(attr->flags));
-			json_object_object_add(obj2, "threshold", json_object_new_int(attr->threshold));
-			json_object_object_add(obj2, "current_value", json_object_new_int(attr->current_value));
-			json_object_object_add(obj2, "worst_value", json_object_new_int(attr->worst_value));
-			json_object_object_add(obj2, "raw_value", json_object_new_int64(attr->raw_value));
-			json_object_array_add(arr, obj2);
+			json_begin_object(json, NULL);
+			json_add_int(json, "id", attr->id);
+			json_add_string(json, "name", get_smart_attribute_name(attr->id));
+			json_add_int(json, "flags", attr->flags);
+			json_add_int(json, "threshold", attr->threshold);
+			json_add_int(json, "current_value", attr->current_value);
+			json_add_int(json, "worst_value", attr->worst_value);
+			json_add_int(json, "raw_value", (int64_t)attr->raw_value);
+			json_end_object(json);
+		}
+	}
+	json_end_array(json);
+	json_end_object(json);
+}
+
+void print_histogram(const char *name, const struct stats_histogram *histogram)
+{
+	if (histogram->count == 0) {
+		print("%s = -\n", name);
+		return;
+	}
+	print("%s = avg %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n", name,
+		(double)histogram->total / histogram->count / 1000,
+		(double)stats_histogram_percentile(histogram, 50) / 1000,
+		(double)stats_histogram_percentile(histogram, 99) / 1000,
+		(double)histogram->max / 1000);
+}
+
+void print_stats(const struct jmraid_stats *stats)
+{
+	uint32_t i;
+
+	print("Handshakes    = %u\n", stats->handshake_count);
+	print("Sector reads  = %llu (%llu bytes, %u errors)\n", (unsigned long long)stats->disk.read.count, (unsigned long long)stats->disk.bytes_read, stats->disk.read_error_count);
+	print_histogram("Read latency ", &stats->disk.read);
+	print("Sector writes = %llu (%llu bytes, %u errors)\n", (unsigned long long)stats->disk.write.count, (unsigned long long)stats->disk.bytes_written, stats->disk.write_error_count);
+	print_histogram("Write latency", &stats->disk.write);
+	for (i = 0; i < stats->command_count; i++)
+	{
+		const struct jmraid_command_stats *command = &stats->command[i];
+		uint64_t count = command->latency.count;
+		print("\n");
+		print("Command %02X/%02X\n", command->group, command->command);
+		print("\n");
+		g_print_indent++;
+		print("Count      = %llu\n", (unsigned long long)count);
+		print_histogram("Latency   ", &command->latency);
+		if (count) {
+			print("Time       = write %.1f us, read %.1f us, codec %.1f us (avg)\n",
+				(double)command->write_time / count / 1000,
+				(double)command->read_time / count / 1000,
+				(double)command->codec_time / count / 1000);
+		}
+		print("Bytes      = %llu in, %llu out\n", (unsigned long long)command->bytes_in, (unsigned long long)command->bytes_out);
+		print("Errors     = %u crc, %u seq, %u command, %u io, %u no response, %u status\n",
+			command->error_count[-JMRAID_RESULT_CRC], command->error_count[-JMRAID_RESULT_SEQ], command->error_count[-JMRAID_RESULT_COMMAND],
+			command->error_count[-JMRAID_RESULT_IO], command->error_count[-JMRAID_RESULT_NO_RESPONSE], command->status_error_count);
+		g_print_indent--;
+	}
+	for (i = 0; i < 256; i++)
+	{
+		if (stats->status_count[i]) {
+			print("\n");
+			print("Status %02X  = %u\n", i, stats->status_count[i]);
 		}
 	}
-	json_object_object_add(parent, "disk_smart_info", arr);
 }
 
-void check_disk(json_object* parent, const char *disk_name)
+void add_histogram(struct json_writer *json, const char *key, const struct stats_histogram *histogram)
+{
+	int i;
+
+	json_begin_object(json, key);
+	json_add_int(json, "count", histogram->count);
+	json_add_int(json, "total_ns", histogram->total);
+	json_add_int(json, "min_ns", histogram->min);
+	json_add_int(json, "max_ns", histogram->max);
+	json_add_int(json, "p50_ns", stats_histogram_percentile(histogram, 50));
+	json_add_int(json, "p99_ns", stats_histogram_percentile(histogram, 99));
+	// bucket i counts latencies below 2^i us
+	json_begin_array(json, "buckets");
+	for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+	{
+		json_add_int(json, NULL, histogram->bucket[i]);
+	}
+	json_end_array(json);
+	json_end_object(json);
+}
+
+void add_stats(struct json_writer *json, const struct jmraid_stats *stats)
+{
+	uint32_t i;
+
+	json_begin_object(json, "stats");
+	json_add_int(json, "handshake_count", stats->handshake_count);
+	json_begin_object(json, "disk");
+	add_histogram(json, "read", &stats->disk.read);
+	add_histogram(json, "write", &stats->disk.write);
+	json_add_int(json, "bytes_read", stats->disk.bytes_read);
+	json_add_int(json, "bytes_written", stats->disk.bytes_written);
+	json_add_int(json, "read_error_count", stats->disk.read_error_count);
+	json_add_int(json, "write_error_count", stats->disk.write_error_count);
+	json_end_object(json);
+	json_begin_array(json, "commands");
+	for (i = 0; i < stats->command_count; i++)
+	{
+		const struct jmraid_command_stats *command = &stats->command[i];
+		json_begin_object(json, NULL);
+		json_add_int(json, "group", command->group);
+		json_add_int(json, "command", command->command);
+		add_histogram(json, "latency", &command->latency);
+		json_add_int(json, "write_time_ns", command->write_time);
+		json_add_int(json, "read_time_ns", command->read_time);
+		json_add_int(json, "codec_time_ns", command->codec_time);
+		json_add_int(json, "bytes_in", command->bytes_in);
+		json_add_int(json, "bytes_out", command->bytes_out);
+		json_add_int(json, "crc_error_count", command->error_count[-JMRAID_RESULT_CRC]);
+		json_add_int(json, "seq_error_count", command->error_count[-JMRAID_RESULT_SEQ]);
+		json_add_int(json, "command_error_count", command->error_count[-JMRAID_RESULT_COMMAND]);
+		json_add_int(json, "io_error_count", command->error_count[-JMRAID_RESULT_IO]);
+		json_add_int(json, "no_response_count", command->error_count[-JMRAID_RESULT_NO_RESPONSE]);
+		json_add_int(json, "status_error_count", command->status_error_count);
+		json_end_object(json);
+	}
+	json_end_array(json);
+	json_end_object(json);
+}
+
+// parses a decimal, 0x hex or 0 octal number, nothing else on the line
+bool parse_uint32(const char *text, uint32_t *value)
+{
+	unsigned long number;
+	char *end;
+	if ((*text < '0') || (*text > '9'))
+	{
+		return false;
+	}
+	errno = 0;
+	number = strtoul(text, &end, 0);
+	if ((*end != '\0') || (errno == ERANGE) || (number > 0xFFFFFFFFUL))
+	{
+		return false;
+	}
+	*value = (uint32_t)number;
+	return true;
+}
+
+// parses a comma separated list like "raid,smart"
+bool parse_sections(const char *text, uint32_t *sections)
+{
+	static const struct
+	{
+		const char *name;
+		uint32_t section;
+	} names[] = {
+		{ "chip", SECTION_CHIP },
+		{ "ports", SECTION_PORTS },
+		{ "raid", SECTION_RAID },
+		{ "smart", SECTION_SMART },
+		{ "all", SECTION_ALL },
+	};
+	*sections = 0;
+	while (*text)
+	{
+		size_t len = strcspn(text, ",");
+		size_t i;
+		for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		{
+			if ((strlen(names[i].name) == len) && (strncmp(names[i].name, text, len) == 0))
+			{
+				*sections |= names[i].section;
+				break;
+			}
+		}
+		if (i == sizeof(names) / sizeof(names[0]))
+		{
+			return false;
+		}
+		text += len;
+		if (*text == ',')
+		{
+			text++;
+		}
+	}
+	return *sections != 0;
+}
+
+// the vendor id stored for the device does not fit the bridge (anymore)
+bool redetect_vendor_id(struct jmraid *jmraid, const char *device_key)
+{
+	uint32_t vendor_id;
+	if (!jmraid_detect_vendor_id(jmraid, &vendor_id))
+	{
+		return false;
+	}
+	jmraid_set_vendor_id(jmraid, vendor_id);
+	jmraid_cache_save_vendor_id(g_cache_dir, device_key, vendor_id);
+	return true;
+}
+
+void check_disk(struct json_writer *json, const char *disk_name)
 {
 	struct jmraid jmraid;
 
-	if (!g_print_json) {
+	if (g_print_json) {
+		json_begin_object(json, NULL);
+	}
+	else {
 		print("\n");
 		print("Check \"%s\" ...\n", disk_name);
 	}
 	g_print_indent++;
 	jmraid_init(&jmraid);
+	jmraid_set_disk_backend(&jmraid, g_disk_backend);
+	jmraid_set_disk_timeout(&jmraid, g_disk_timeout);
+	jmraid_set_strict(&jmraid, g_strict);
 	if (!jmraid_open(&jmraid, disk_name, 0))
 	{
 		if (g_print_json) {
@@ -476,7 +716,10 @@ void check_disk(json_object* parent, const char *disk_name)
 	else
 	{
 		uint32_t vendor_id;
-		if (!jmraid_detect_vendor_id(&jmraid, &vendor_id))
+		char device_key[128];
+		bool has_device_key = g_use_cache && discover_get_device_key(disk_name, device_key, sizeof(device_key));
+		bool is_vendor_id_cached = false;
+		if (!jmraid_cache_detect_vendor_id(g_cache_dir, has_device_key ? device_key : NULL, &jmraid, &vendor_id, &is_vendor_id_cached))
 		{
 			if (g_print_json) {
 				fprintf(stderr, "%s\n", "jmraid_detect_vendor_id failed");
@@ -489,66 +732,111 @@ void check_disk(json_object* parent, const char *disk_name)
 		else
 		{
 			int i;
+			bool is_chip_info_needed;
+			bool is_chip_info_valid = false;
 			struct jmraid_chip_info chip_info;
 			struct jmraid_sata_info sata_info;
 			struct jmraid_sata_port_info sata_port_info;
 			struct jmraid_raid_port_info raid_port_info;
 			struct jmraid_disk_smart_info disk_smart_info;
+			struct jmraid_cache cache;
+			// only set once the cache is loaded and checked against the ports
+			struct jmraid_cache *valid_cache = NULL;
+			bool is_cache_loaded = false;
 			bool is_raid_or_spare_disk[5];
+			bool is_sata_info_valid = false;
+			struct jmraid_plan plan;
 
 			memset(is_raid_or_spare_disk, 0, sizeof(is_raid_or_spare_disk));
 
 			jmraid_set_vendor_id(&jmraid, vendor_id);
 
-			if (!g_print_json) {
-				print("\n");
-				print("Get chip info ...\n");
-				print("\n");
-			}
-			g_print_indent++;
-			if (!jmraid_get_chip_info(&jmraid, &chip_info))
+			// the cache is keyed by the chip, so it needs the chip info even
+			// when that is not printed
+			is_chip_info_needed = (g_sections & SECTION_CHIP) || (g_use_cache && (g_sections & SECTION_PORTS));
+			if (is_chip_info_needed)
 			{
-				if (g_print_json) {
-					fprintf(stderr, "%s\n", "jmraid_get_chip_info failed");
+				if (!g_print_json && (g_sections & SECTION_CHIP)) {
+					print("\n");
+					print("Get chip info ...\n");
+					print("\n");
 				}
-				else {
-					print("jmraid_get_chip_info failed\n");
+				g_print_indent++;
+				is_chip_info_valid = jmraid_get_chip_info(&jmraid, &chip_info);
+				if (!is_chip_info_valid && is_vendor_id_cached && redetect_vendor_id(&jmraid, device_key))
+				{
+					is_vendor_id_cached = false;
+					is_chip_info_valid = jmraid_get_chip_info(&jmraid, &chip_info);
 				}
+				if (!is_chip_info_valid)
+				{
+					if (g_print_json) {
+						fprintf(stderr, "%s\n", "jmraid_get_chip_info failed");
+					}
+					else {
+						print("jmraid_get_chip_info failed\n");
+					}
+				}
+				else
+				{
+					if (g_sections & SECTION_CHIP) {
+						if (g_print_json) add_chip_info(json, &chip_info);
+						else print_chip_info(&chip_info);
+					}
+					if (g_use_cache) {
+						jmraid_cache_init(&cache, g_cache_dir, g_cache_ttl);
+						jmraid_cache_load(&cache, &chip_info);
+						is_cache_loaded = true;
+					}
+				}
+				g_print_indent--;
 			}
-			else
-			{
-				if (g_print_json) add_chip_info(parent, &chip_info);
-				else print_chip_info(&chip_info);
-			}
-			g_print_indent--;
 
-			if (!g_print_json) {
-				print("\n");
-				print("Get SATA info ...\n");
-				print("\n");
-			}
-			g_print_indent++;
-			if (!jmraid_get_sata_info(&jmraid, &sata_info))
+			// every other section is planned from the SATA info
+			if (g_sections & (SECTION_PORTS | SECTION_RAID | SECTION_SMART))
 			{
-				if (g_print_json) {
-					fprintf(stderr, "%s\n", "jmraid_get_sata_info failed");
+				if (!g_print_json && (g_sections & SECTION_PORTS)) {
+					print("\n");
+					print("Get SATA info ...\n");
+					print("\n");
 				}
-				else {
-					print("jmraid_get_sata_info failed\n");
+				g_print_indent++;
+				is_sata_info_valid = jmraid_get_sata_info(&jmraid, &sata_info);
+				if (!is_sata_info_valid && is_vendor_id_cached && redetect_vendor_id(&jmraid, device_key))
+				{
+					is_sata_info_valid = jmraid_get_sata_info(&jmraid, &sata_info);
 				}
-			}
-			else
-			{
-				if (g_print_json) add_sata_info(parent, &sata_info);
-				else print_sata_info(&sata_info);
-				for (i = 0; i < 5; i++)
+				if (!is_sata_info_valid)
 				{
-					is_raid_or_spare_disk[i] = (sata_info.item[i].port_type == 0x02) || ((sata_info.item[i].port_type == 0x01) && (sata_info.item[i].page_0_state == 0x03));
+					if (g_print_json) {
+						fprintf(stderr, "%s\n", "jmraid_get_sata_info failed");
+					}
+					else {
+						print("jmraid_get_sata_info failed\n");
+					}
+				}
+				else
+				{
+					if (g_sections & SECTION_PORTS) {
+						if (g_print_json) add_sata_info(json, &sata_info);
+						else print_sata_info(&sata_info);
+					}
+					for (i = 0; i < 5; i++)
+					{
+						is_raid_or_spare_disk[i] = (sata_info.item[i].port_type == 0x02) || ((sata_info.item[i].port_type == 0x01) && (sata_info.item[i].page_0_state == 0x03));
+					}
+					if (is_cache_loaded) {
+						jmraid_cache_validate(&cache, &sata_info);
+						valid_cache = &cache;
+					}
 				}
+				g_print_indent--;
 			}
-			g_print_indent--;
 
-			for (i = 0; i < 5; i++)
+			jmraid_plan_queries(&jmraid, is_sata_info_valid ? &sata_info : NULL, &plan);
+
+			if (g_print_json && (g_sections & SECTION_PORTS)) json_begin_array(json, "sata_port_info");
+			for (i = 0; (g_sections & SECTION_PORTS) && (i < 5); i++)
 			{
 				if (!g_print_json) {
 					print("\n");
@@ -556,7 +844,13 @@ void check_disk(json_object* parent, const char *disk_name)
 					print("\n");
 				}
 				g_print_indent++;
-				if (!jmraid_get_sata_port_info(&jmraid, i, &sata_port_info))
+				if (!plan.is_sata_port_info_needed[i])
+				{
+					jmraid_plan_fill_sata_port_info(&sata_port_info);
+					if (g_print_json) add_sata_port_info(json, &sata_port_info);
+					else print_sata_port_info(&sata_port_info);
+				}
+				else if (!jmraid_get_sata_port_info_cached(&jmraid, valid_cache, i, &sata_port_info))
 				{
 					if (g_print_json) {
 						fprintf(stderr, "%s\n", "jmraid_get_sata_port_info failed");
@@ -567,13 +861,16 @@ void check_disk(json_object* parent, const char *disk_name)
 				}
 				else
 				{
-					if (g_print_json) add_sata_port_info(parent, &sata_port_info);
+					if (g_print_json) add_sata_port_info(json, &sata_port_info);
 					else print_sata_port_info(&sata_port_info);
 				}
 				g_print_indent--;
 			}
 
-			for (i = 0; i < 5; i++)
+			if (g_print_json && (g_sections & SECTION_PORTS)) json_end_array(json);
+
+			if (g_print_json && (g_sections & SECTION_RAID)) json_begin_array(json, "raid_port_info");
+			for (i = 0; (g_sections & SECTION_RAID) && (i < 5); i++)
 			{
 				if (!g_print_json) {
 					print("\n");
@@ -581,7 +878,20 @@ void check_disk(json_object* parent, const char *disk_name)
 					print("\n");
 				}
 				g_print_indent++;
-				if (!jmraid_get_raid_port_info(&jmraid, i, &raid_port_info))
+				if (!plan.is_raid_port_info_needed[i])
+				{
+					// no disk belongs to it, a set without members would
+					// only show up in strict mode
+					if (g_print_json) {
+						json_begin_object(json, NULL);
+						json_add_string(json, "status", "not queried");
+						json_end_object(json);
+					}
+					else {
+						print("not queried\n");
+					}
+				}
+				else if (!jmraid_get_raid_port_info(&jmraid, i, &raid_port_info))
 				{
 					if (g_print_json) {
 						fprintf(stderr, "%s\n", "jmraid_get_raid_port_info failed");
@@ -592,23 +902,41 @@ void check_disk(json_object* parent, const char *disk_name)
 				}
 				else
 				{
-					if (g_print_json) add_raid_port_info(parent, &raid_port_info);
+					if (g_print_json) add_raid_port_info(json, &raid_port_info);
 					else print_raid_port_info(&raid_port_info);
 				}
 				g_print_indent--;
 			}
 
-			for (i = 0; i < 5; i++)
+			if (g_print_json && (g_sections & SECTION_RAID)) json_end_array(json);
+
+			if (g_print_json && (g_sections & SECTION_SMART)) json_begin_array(json, "disk_smart_info");
+			for (i = 0; (g_sections & SECTION_SMART) && (i < 5); i++)
 			{
 				if (is_raid_or_spare_disk[i])
 				{
+					uint8_t power_mode;
 					if (!g_print_json) {
 						print("\n");
 						print("Get SMART info (disk %d) ...\n", i);
 						print("\n");
 					}
 					g_print_indent++;
-					if (!jmraid_get_disk_smart_info(&jmraid, i, &disk_smart_info))
+					if (g_no_wake && jmraid_ata_check_power_mode(&jmraid, i, &power_mode) && jmraid_power_mode_is_standby(power_mode))
+					{
+						if (g_print_json) {
+							json_begin_object(json, NULL);
+							json_add_int(json, "port", i);
+							json_add_int(json, "power_mode", power_mode);
+							json_begin_array(json, "attributes");
+							json_end_array(json);
+							json_end_object(json);
+						}
+						else {
+							print("disk in standby, not woken up\n");
+						}
+					}
+					else if (!jmraid_get_disk_smart_info(&jmraid, i, &disk_smart_info))
 					{
 						if (g_print_json) {
 							fprintf(stderr, "%s\n", "jmraid_get_disk_smart_info failed");
@@ -619,13 +947,19 @@ void check_disk(json_object* parent, const char *disk_name)
 					}
 					else
 					{
-						if (g_print_json) add_disk_smart_info(parent, &disk_smart_info);
+						if (g_print_json) add_disk_smart_info(json, i, &disk_smart_info);
 						else print_disk_smart_info(&disk_smart_info);
 					}
 					g_print_indent--;
 				}
 			}
 
+			if (g_print_json && (g_sections & SECTION_SMART)) json_end_array(json);
+
+			if (valid_cache && !jmraid_cache_save(valid_cache)) {
+				fprintf(stderr, "writing the cache to %s failed\n", g_cache_dir);
+			}
+
 #if 0
 			for (i = 0; i < 5; i++)
 			{
@@ -683,21 +1017,250 @@ void check_disk(json_object* parent, const char *disk_name)
 				print("jmraid_close failed\n");
 			}
 		}
+
+		if (g_print_stats)
+		{
+			struct jmraid_stats stats;
+			jmraid_get_stats(&jmraid, &stats);
+			if (g_print_json) {
+				add_stats(json, &stats);
+			}
+			else {
+				print("\n");
+				print("Statistics ...\n");
+				print("\n");
+				g_print_indent++;
+				print_stats(&stats);
+				g_print_indent--;
+			}
+		}
 	}
 	g_print_indent--;
+
+	if (g_print_json) {
+		json_end_object(json);
+	}
+}
+
+struct probe_job
+{
+	char disk_name[64];
+	int index;
+	char *output;
+	size_t output_size;
+	bool done;
+};
+
+// with -j the enclosures are elements of one array (unless only one disk
+// was given), with -J each one is a line of its own, so a consumer can
+// handle them as they come
+void probe_job_run(struct probe_job *job)
+{
+	struct json_writer json;
+	FILE *file = get_print_file();
+
+	json_init(&json, file);
+	if (g_print_json && !g_print_ndjson && (job->index > 0)) {
+		fputc(',', file);
+	}
+	check_disk(&json, job->disk_name);
+	if (g_print_json && g_print_ndjson) {
+		fputc('\n', file);
+	}
+	fflush(file);
+}
+
+#ifndef _WIN32
+
+struct probe_pool
+{
+	struct probe_job *jobs;
+	int job_count;
+	int next_job;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+void *probe_worker(void *arg)
+{
+	struct probe_pool *pool = (struct probe_pool *)arg;
+	for (;;)
+	{
+		struct probe_job *job;
+		int i;
+
+		pthread_mutex_lock(&pool->mutex);
+		i = pool->next_job++;
+		pthread_mutex_unlock(&pool->mutex);
+		if (i >= pool->job_count)
+		{
+			break;
+		}
+
+		job = &pool->jobs[i];
+		g_print_file = open_memstream(&job->output, &job->output_size);
+		probe_job_run(job);
+		if (g_print_file)
+		{
+			fclose(g_print_file);
+			g_print_file = NULL;
+		}
+
+		pthread_mutex_lock(&pool->mutex);
+		job->done = true;
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+	return NULL;
+}
+
+// probes the disks on up to "workers" threads, the output of each disk is
+// buffered and written in job order as soon as all previous jobs are done
+void probe_disks_parallel(struct probe_job *jobs, int job_count, int workers)
+{
+	struct probe_pool pool;
+	pthread_t *threads;
+	int thread_count = 0;
+	int i;
+
+	memset(&pool, 0, sizeof(pool));
+	pool.jobs = jobs;
+	pool.job_count = job_count;
+	pthread_mutex_init(&pool.mutex, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+
+	if (workers > job_count)
+	{
+		workers = job_count;
+	}
+	threads = (pthread_t *)calloc(workers, sizeof(pthread_t));
+	for (i = 0; threads && (i < workers); i++)
+	{
+		if (pthread_create(&threads[thread_count], NULL, probe_worker, &pool) == 0)
+		{
+			thread_count++;
+		}
+	}
+	if (thread_count == 0)
+	{
+		// no threads, probe everything on the calling thread
+		probe_worker(&pool);
+	}
+
+	for (i = 0; i < job_count; i++)
+	{
+		pthread_mutex_lock(&pool.mutex);
+		while (!jobs[i].done)
+		{
+			pthread_cond_wait(&pool.cond, &pool.mutex);
+		}
+		pthread_mutex_unlock(&pool.mutex);
+		if (jobs[i].output)
+		{
+			fwrite(jobs[i].output, 1, jobs[i].output_size, stdout);
+			fflush(stdout);
+			free(jobs[i].output);
+			jobs[i].output = NULL;
+		}
+	}
+
+	for (i = 0; i < thread_count; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_cond_destroy(&pool.cond);
+	pthread_mutex_destroy(&pool.mutex);
+}
+
+#endif
+
+void probe_disks(struct probe_job *jobs, int job_count)
+{
+	int i;
+#ifndef _WIN32
+	if (g_parallel > 1)
+	{
+		probe_disks_parallel(jobs, job_count, g_parallel);
+		return;
+	}
+#endif
+	for (i = 0; i < job_count; i++)
+	{
+		probe_job_run(&jobs[i]);
+	}
 }
 
 int main(int argc, char *argv[])
 {
 	int disk_number;
 	int c;
-	char disk_name[32];
-	json_object* root;
-	while ((c = getopt(argc, argv, "j")) != -1) {
+	int i;
+	struct probe_job *jobs;
+	int job_count = 0;
+	bool is_array = false;
+	uint32_t workers;
+	// before the probe threads start, see crc_init()
+	crc_init();
+	while ((c = getopt(argc, argv, "jJab:T:P:ScC:t:xo:n")) != -1) {
 		switch (c) {
 		case 'j':
 			g_print_json = 1;
 			break;
+		case 'J':
+			g_print_json = 1;
+			g_print_ndjson = 1;
+			break;
+		case 'a':
+			g_scan_all = 1;
+			break;
+		case 'b':
+			if (!disk_parse_backend(optarg, &g_disk_backend)) {
+				fprintf(stderr, "unknown disk backend \"%s\"\n", optarg);
+				return 1;
+			}
+			break;
+		case 'T':
+			if (!parse_uint32(optarg, &g_disk_timeout)) {
+				fprintf(stderr, "invalid timeout \"%s\"\n", optarg);
+				return 1;
+			}
+			break;
+		case 'P':
+			if (!parse_uint32(optarg, &workers) || (workers > INT_MAX)) {
+				fprintf(stderr, "invalid worker count \"%s\"\n", optarg);
+				return 1;
+			}
+			g_parallel = (int)workers;
+			break;
+		case 'S':
+			g_print_stats = 1;
+			break;
+		case 'c':
+			g_use_cache = 1;
+			break;
+		case 'C':
+			g_use_cache = 1;
+			g_cache_dir = optarg;
+			break;
+		case 't':
+			if (!parse_uint32(optarg, &g_cache_ttl)) {
+				fprintf(stderr, "invalid cache TTL \"%s\"\n", optarg);
+				return 1;
+			}
+			break;
+		case 'x':
+			g_strict = 1;
+			break;
+		case 'n':
+			g_no_wake = 1;
+			break;
+		case 'o':
+			if (!parse_sections(optarg, &g_sections)) {
+				fprintf(stderr, "unknown section in \"%s\", use chip, ports, raid, smart or all\n", optarg);
+				return 1;
+			}
+			break;
 		case '?':
 			break;
 		default:
@@ -706,29 +1269,54 @@ int main(int argc, char *argv[])
 	}
 	if (!g_print_json) print("JMicron RAID info\n");
 
+	jobs = (struct probe_job *)calloc(DISCOVER_MAX_DEVICES, sizeof(struct probe_job));
+	if (!jobs) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
 	if (optind < argc) {
-		root = json_object_new_object();
-		strncpy(disk_name, argv[optind++], 32);
-		check_disk(root, disk_name);
+		strncpy(jobs[0].disk_name, argv[optind++], sizeof(jobs[0].disk_name) - 1);
+		job_count = 1;
 	}
 	else {
-		root = json_object_new_array();
-		for (disk_number = 0; disk_number < 16; disk_number++)
-		{
-			json_object* obj = json_object_new_object();
+		int device_count = -1;
+		is_array = true;
+		if (!g_scan_all) {
+			// only probe disks that sit behind a JMicron bridge, so other
+			// disks never see the handshake sectors
+			struct discover_device *devices = (struct discover_device *)calloc(DISCOVER_MAX_DEVICES, sizeof(struct discover_device));
+			if (devices) {
+				device_count = discover_jmraid_devices(devices, DISCOVER_MAX_DEVICES);
+				for (i = 0; i < device_count; i++)
+				{
+					strcpy(jobs[job_count].disk_name, devices[i].disk_name);
+					job_count++;
+				}
+				free(devices);
+			}
+		}
+		if (device_count < 0) {
+			for (disk_number = 0; disk_number < 16; disk_number++)
+			{
 #ifdef _WIN32
-			sprintf(disk_name, "\\\\.\\PhysicalDrive%d", disk_number + 1);
+				sprintf(jobs[job_count].disk_name, "\\\\.\\PhysicalDrive%d", disk_number + 1);
 #else
-			sprintf(disk_name, "/dev/sd%c", 'a' + disk_number);
+				sprintf(jobs[job_count].disk_name, "/dev/sd%c", 'a' + disk_number);
 #endif
-			check_disk(obj, disk_name);
-			json_object_array_add(root, obj);
+				job_count++;
+			}
 		}
 	}
-	if (g_print_json) {
-		printf("%s\n", json_object_to_json_string(root));
+
+	for (i = 0; i < job_count; i++)
+	{
+		jobs[i].index = i;
 	}
-	json_object_put(root);
+
+	if (g_print_json && !g_print_ndjson && is_array) printf("[");
+	probe_disks(jobs, job_count);
+	if (g_print_json && !g_print_ndjson) printf(is_array ? "]\n" : "\n");
+	free(jobs);
 
 	return 0;
 }
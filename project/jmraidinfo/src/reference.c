@@ -0,0 +1,108 @@
+#include "reference.h"
+
+// scramble() as jmraid.c had it before TABLE_SCRAMBLE, the state is run bit
+// by bit through the scrambler polynomial for every word
+void scramble_bitwise(const uint8_t *data_in, uint8_t *data_out, uint32_t size)
+{
+	uint32_t v3;
+	uint32_t crc;
+	uint32_t data;
+	int i;
+	uint8_t data_bit[32];
+	uint8_t new_crc_bit[32];
+	uint8_t crc_bit[32];
+
+	crc = 0x52325032;
+	for (v3 = 0; v3 < size >> 2; v3++)
+	{
+		for (i = 0; i < 32; i++)
+		{
+			crc_bit[i] = (uint8_t)((crc >> i) & 1);
+		}
+
+		data = ((uint32_t *)data_in)[v3];
+		for (i = 0; i < 32; i++)
+		{
+			data_bit[i] = (uint8_t)((data >> i) & 1);
+		}
+
+		data_bit[31] = data_bit[31] ^ crc_bit[27];
+		data_bit[30] = data_bit[30] ^ crc_bit[30];
+		data_bit[29] = data_bit[29] ^ crc_bit[23];
+		data_bit[28] = data_bit[28] ^ crc_bit[18];
+		data_bit[27] = data_bit[27] ^ crc_bit[8];
+		data_bit[26] = data_bit[26] ^ crc_bit[25];
+		data_bit[25] = data_bit[25] ^ crc_bit[3];
+		data_bit[24] = data_bit[24] ^ crc_bit[29];
+		data_bit[23] = data_bit[23] ^ crc_bit[9];
+		data_bit[22] = data_bit[22] ^ crc_bit[17];
+		data_bit[21] = data_bit[21] ^ crc_bit[1];
+		data_bit[20] = data_bit[20] ^ crc_bit[22];
+		data_bit[19] = data_bit[19] ^ crc_bit[10];
+		data_bit[18] = data_bit[18] ^ crc_bit[20];
+		data_bit[17] = data_bit[17] ^ crc_bit[5];
+		data_bit[16] = data_bit[16] ^ crc_bit[12];
+		data_bit[15] = data_bit[15] ^ crc_bit[28];
+		data_bit[14] = data_bit[14] ^ crc_bit[14];
+		data_bit[13] = data_bit[13] ^ crc_bit[2];
+		data_bit[12] = data_bit[12] ^ crc_bit[24];
+		data_bit[11] = data_bit[11] ^ crc_bit[15];
+		data_bit[10] = data_bit[10] ^ crc_bit[6];
+		data_bit[9] = data_bit[9] ^ crc_bit[26];
+		data_bit[8] = data_bit[8] ^ crc_bit[4];
+		data_bit[7] = data_bit[7] ^ crc_bit[19];
+		data_bit[6] = data_bit[6] ^ crc_bit[0];
+		data_bit[5] = data_bit[5] ^ crc_bit[16];
+		data_bit[4] = data_bit[4] ^ crc_bit[7];
+		data_bit[3] = data_bit[3] ^ crc_bit[21];
+		data_bit[2] = data_bit[2] ^ crc_bit[13];
+		data_bit[1] = data_bit[1] ^ crc_bit[31];
+		data_bit[0] = data_bit[0] ^ crc_bit[11];
+
+		data = 0;
+		for (i = 31; i >= 0; i--)
+		{
+			data = (data << 1) | data_bit[i];
+		}
+		((uint32_t *)data_out)[v3] = data;
+
+		new_crc_bit[31] = crc_bit[5] ^ crc_bit[8] ^ crc_bit[9] ^ crc_bit[11] ^ crc_bit[15] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[27] ^ crc_bit[28] ^ crc_bit[29] ^ crc_bit[30] ^ crc_bit[31];
+		new_crc_bit[30] = crc_bit[4] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[10] ^ crc_bit[14] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[28] ^ crc_bit[29] ^ crc_bit[30];
+		new_crc_bit[29] = crc_bit[3] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[9] ^ crc_bit[13] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[25] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[29] ^ crc_bit[31] ^ crc_bit[28];
+		new_crc_bit[28] = crc_bit[2] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[8] ^ crc_bit[12] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[27] ^ crc_bit[28] ^ crc_bit[30] ^ crc_bit[26];
+		new_crc_bit[27] = crc_bit[1] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[7] ^ crc_bit[11] ^ crc_bit[19] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[29];
+		new_crc_bit[26] = crc_bit[0] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[6] ^ crc_bit[10] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[20] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[28] ^ crc_bit[31] ^ crc_bit[25];
+		new_crc_bit[25] = crc_bit[2] ^ crc_bit[3] ^ crc_bit[8] ^ crc_bit[11] ^ crc_bit[15] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[29] ^ crc_bit[31] ^ crc_bit[28];
+		new_crc_bit[24] = crc_bit[1] ^ crc_bit[2] ^ crc_bit[7] ^ crc_bit[10] ^ crc_bit[14] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[27] ^ crc_bit[28] ^ crc_bit[30];
+		new_crc_bit[23] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[6] ^ crc_bit[9] ^ crc_bit[13] ^ crc_bit[15] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[19] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[29] ^ crc_bit[31] ^ crc_bit[20];
+		new_crc_bit[22] = crc_bit[0] ^ crc_bit[9] ^ crc_bit[11] ^ crc_bit[12] ^ crc_bit[14] ^ crc_bit[16] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[29] ^ crc_bit[31] ^ crc_bit[23];
+		new_crc_bit[21] = crc_bit[5] ^ crc_bit[9] ^ crc_bit[10] ^ crc_bit[13] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[22] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[29] ^ crc_bit[31];
+		new_crc_bit[20] = crc_bit[4] ^ crc_bit[8] ^ crc_bit[9] ^ crc_bit[12] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[21] ^ crc_bit[23] ^ crc_bit[25] ^ crc_bit[26] ^ crc_bit[28] ^ crc_bit[30];
+		new_crc_bit[19] = crc_bit[3] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[11] ^ crc_bit[15] ^ crc_bit[16] ^ crc_bit[20] ^ crc_bit[22] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[27] ^ crc_bit[29];
+		new_crc_bit[18] = crc_bit[2] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[10] ^ crc_bit[14] ^ crc_bit[15] ^ crc_bit[19] ^ crc_bit[21] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[28] ^ crc_bit[31];
+		new_crc_bit[17] = crc_bit[1] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[9] ^ crc_bit[13] ^ crc_bit[14] ^ crc_bit[18] ^ crc_bit[20] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[27] ^ crc_bit[30] ^ crc_bit[31] ^ crc_bit[25];
+		new_crc_bit[16] = crc_bit[0] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[8] ^ crc_bit[12] ^ crc_bit[13] ^ crc_bit[17] ^ crc_bit[19] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[29] ^ crc_bit[30];
+		new_crc_bit[15] = crc_bit[3] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[9] ^ crc_bit[12] ^ crc_bit[15] ^ crc_bit[16] ^ crc_bit[18] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[24] ^ crc_bit[27] ^ crc_bit[30];
+		new_crc_bit[14] = crc_bit[2] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[11] ^ crc_bit[14] ^ crc_bit[15] ^ crc_bit[17] ^ crc_bit[19] ^ crc_bit[20] ^ crc_bit[23] ^ crc_bit[26] ^ crc_bit[29];
+		new_crc_bit[13] = crc_bit[1] ^ crc_bit[2] ^ crc_bit[3] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[10] ^ crc_bit[13] ^ crc_bit[14] ^ crc_bit[16] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[22] ^ crc_bit[25] ^ crc_bit[28] ^ crc_bit[31];
+		new_crc_bit[12] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[2] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[9] ^ crc_bit[12] ^ crc_bit[13] ^ crc_bit[15] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[21] ^ crc_bit[24] ^ crc_bit[27] ^ crc_bit[30] ^ crc_bit[31];
+		new_crc_bit[11] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[9] ^ crc_bit[12] ^ crc_bit[14] ^ crc_bit[15] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[20] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[26] ^ crc_bit[27] ^ crc_bit[28] ^ crc_bit[31];
+		new_crc_bit[10] = crc_bit[0] ^ crc_bit[2] ^ crc_bit[3] ^ crc_bit[5] ^ crc_bit[9] ^ crc_bit[13] ^ crc_bit[14] ^ crc_bit[16] ^ crc_bit[19] ^ crc_bit[26] ^ crc_bit[29] ^ crc_bit[31] ^ crc_bit[28];
+		new_crc_bit[9] = crc_bit[1] ^ crc_bit[2] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[9] ^ crc_bit[11] ^ crc_bit[12] ^ crc_bit[13] ^ crc_bit[18] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[29];
+		new_crc_bit[8] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[8] ^ crc_bit[10] ^ crc_bit[11] ^ crc_bit[12] ^ crc_bit[17] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[28] ^ crc_bit[31];
+		new_crc_bit[7] = crc_bit[0] ^ crc_bit[2] ^ crc_bit[3] ^ crc_bit[5] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[10] ^ crc_bit[15] ^ crc_bit[16] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[23] ^ crc_bit[24] ^ crc_bit[28] ^ crc_bit[29] ^ crc_bit[25];
+		new_crc_bit[6] = crc_bit[1] ^ crc_bit[2] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[11] ^ crc_bit[14] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[22] ^ crc_bit[25] ^ crc_bit[29] ^ crc_bit[30];
+		new_crc_bit[5] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[5] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[10] ^ crc_bit[13] ^ crc_bit[19] ^ crc_bit[20] ^ crc_bit[21] ^ crc_bit[24] ^ crc_bit[28] ^ crc_bit[29];
+		new_crc_bit[4] = crc_bit[0] ^ crc_bit[2] ^ crc_bit[3] ^ crc_bit[4] ^ crc_bit[6] ^ crc_bit[8] ^ crc_bit[11] ^ crc_bit[12] ^ crc_bit[15] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[20] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[29] ^ crc_bit[30] ^ crc_bit[31];
+		new_crc_bit[3] = crc_bit[1] ^ crc_bit[2] ^ crc_bit[3] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[9] ^ crc_bit[10] ^ crc_bit[14] ^ crc_bit[15] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[19] ^ crc_bit[25] ^ crc_bit[27] ^ crc_bit[31];
+		new_crc_bit[2] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[2] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[8] ^ crc_bit[9] ^ crc_bit[13] ^ crc_bit[14] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[18] ^ crc_bit[24] ^ crc_bit[26] ^ crc_bit[30] ^ crc_bit[31];
+		new_crc_bit[1] = crc_bit[0] ^ crc_bit[1] ^ crc_bit[6] ^ crc_bit[7] ^ crc_bit[9] ^ crc_bit[11] ^ crc_bit[12] ^ crc_bit[13] ^ crc_bit[16] ^ crc_bit[17] ^ crc_bit[24] ^ crc_bit[27] ^ crc_bit[28];
+		new_crc_bit[0] = crc_bit[0] ^ crc_bit[6] ^ crc_bit[9] ^ crc_bit[10] ^ crc_bit[12] ^ crc_bit[16] ^ crc_bit[24] ^ crc_bit[25] ^ crc_bit[26] ^ crc_bit[28] ^ crc_bit[29] ^ crc_bit[30] ^ crc_bit[31];
+
+		crc = 0;
+		for (i = 31; i >= 0; i--)
+		{
+			crc = (crc << 1) | new_crc_bit[i];
+		}
+	}
+}
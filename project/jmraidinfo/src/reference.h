@@ -0,0 +1,11 @@
+#ifndef _REFERENCE_H_
+#define _REFERENCE_H_
+
+#include <stdint.h>
+
+// The bit by bit forms of what the library computes through tables, kept to
+// test the fast forms against (jmraid_test) and to measure them (jmraid_bench).
+
+void scramble_bitwise(const uint8_t *data_in, uint8_t *data_out, uint32_t size);
+
+#endif
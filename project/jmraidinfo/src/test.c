@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jmraid.h>
+#include <crc.h>
+#include <emu.h>
+
+#include "reference.h"
+
+// exit code of a case that can not run here, see SKIP_RETURN_CODE in
+// CMakeLists.txt
+#define TEST_SKIPPED 77
+
+#define TEST_SECTORS 1000
+
+struct test_case
+{
+	const char *name;
+	bool (*supported)(void);
+	bool (*run)(void);
+};
+
+// xorshift32, fixed seed so a failure can be reproduced
+uint32_t g_random = 0x52325032;
+
+uint32_t next_random(void)
+{
+	g_random ^= g_random << 13;
+	g_random ^= g_random >> 17;
+	g_random ^= g_random << 5;
+	return g_random;
+}
+
+void fill_random(uint8_t *data, uint32_t size)
+{
+	uint32_t i;
+	for (i = 0; i < size; i++)
+	{
+		data[i] = (uint8_t)next_random();
+	}
+}
+
+bool test_scramble(void)
+{
+	uint32_t data[SECTOR_SIZE / 4];
+	uint32_t expected[SECTOR_SIZE / 4];
+	uint32_t actual[SECTOR_SIZE / 4];
+	uint32_t i;
+
+	for (i = 0; i < TEST_SECTORS; i++)
+	{
+		// whole sectors mostly, some shorter runs of words
+		uint32_t size = (i % 4) ? SECTOR_SIZE : 4 * (1 + next_random() % (SECTOR_SIZE / 4));
+
+		fill_random((uint8_t *)data, SECTOR_SIZE);
+		memset(expected, 0, sizeof(expected));
+		memset(actual, 0, sizeof(actual));
+		scramble_bitwise((const uint8_t *)data, (uint8_t *)expected, size);
+		jmraid_scramble((const uint8_t *)data, (uint8_t *)actual, size);
+		if (memcmp(expected, actual, SECTOR_SIZE) != 0)
+		{
+			fprintf(stderr, "sector %u (%u bytes) differs\n", i, size);
+			return false;
+		}
+
+		// in place as the command path does it, and back again
+		memcpy(actual, data, SECTOR_SIZE);
+		jmraid_scramble((const uint8_t *)actual, (uint8_t *)actual, SECTOR_SIZE);
+		scramble_bitwise((const uint8_t *)data, (uint8_t *)expected, SECTOR_SIZE);
+		if (memcmp(expected, actual, SECTOR_SIZE) != 0)
+		{
+			fprintf(stderr, "sector %u differs in place\n", i);
+			return false;
+		}
+		jmraid_scramble((const uint8_t *)actual, (uint8_t *)actual, SECTOR_SIZE);
+		if (memcmp(data, actual, SECTOR_SIZE) != 0)
+		{
+			fprintf(stderr, "sector %u does not descramble\n", i);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+typedef uint32_t (*crc_kernel_t)(uint32_t crc, const uint8_t *data, uint32_t size);
+
+// against crc_calc_table() on the sizes of the protocol (a command sector
+// without its CRC, the handshake) and random ones, with every alignment of
+// the data and tails of 4 to 60 bytes past the kernel's blocks
+bool test_crc_kernel(crc_kernel_t kernel)
+{
+	static const uint32_t sizes[] = { 0, 4, 8, 12, 60, 64, 68, SECTOR_SIZE - 4, 0x1F8, SECTOR_SIZE };
+	uint8_t data[SECTOR_SIZE + 8];
+	uint32_t i;
+
+	for (i = 0; i < TEST_SECTORS; i++)
+	{
+		uint32_t size = (i < sizeof(sizes) / sizeof(sizes[0])) ? sizes[i] : 4 * (next_random() % (SECTOR_SIZE / 4 + 1));
+		uint32_t offset = i % 8;
+		uint32_t seed = (i % 2) ? CRC_SEED : next_random();
+		uint32_t expected;
+		uint32_t actual;
+
+		fill_random(data, sizeof(data));
+		expected = crc_calc_table(seed, data + offset, size);
+		actual = kernel(seed, data + offset, size);
+		if (expected != actual)
+		{
+			fprintf(stderr, "%u bytes at +%u: %08X, expected %08X\n", size, offset, actual, expected);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool test_crc_slice8(void)
+{
+	return test_crc_kernel(crc_calc_slice8);
+}
+
+bool test_crc_clmul(void)
+{
+	return test_crc_kernel(crc_calc_clmul);
+}
+
+// whatever crc_init() picked
+bool test_crc(void)
+{
+	crc_init();
+	return test_crc_kernel(crc_calc);
+}
+
+// fails the case with the line of the check
+#define EXPECT(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+			return false; \
+		} \
+	} while (0)
+
+// the parsed strings keep the space padding of the bridge
+bool is_same_text(const char *actual, const char *expected)
+{
+	size_t size = strlen(expected);
+
+	while (*actual == ' ')
+	{
+		actual++;
+	}
+	if (strncmp(actual, expected, size) != 0)
+	{
+		return false;
+	}
+	for (actual += size; *actual == ' '; actual++)
+	{
+	}
+	return *actual == '\0';
+}
+
+// a session with the emulated HOTWAY enclosure of the README (emu_init())
+bool open_emu(struct emu *emu, struct jmraid *jmraid)
+{
+	emu_init(emu);
+	jmraid_init(jmraid);
+	jmraid_set_disk_backend(jmraid, DISK_BACKEND_EMU);
+	disk_set_emulator(&jmraid->disk, emu);
+	if (!jmraid_session_open(jmraid, "emu", 0))
+	{
+		fprintf(stderr, "jmraid_session_open failed\n");
+		return false;
+	}
+	return true;
+}
+
+bool check_hotway_snapshot(const struct jmraid_snapshot *snapshot)
+{
+	const struct jmraid_raid_port_info *raid = &snapshot->raid_port_info[0];
+	int i;
+
+	EXPECT(snapshot->is_chip_info_valid);
+	EXPECT(is_same_text(snapshot->chip_info.product_name, "HOTWAY H/W RAID"));
+	EXPECT(is_same_text(snapshot->chip_info.manufacturer, "HOTWAY"));
+	EXPECT(snapshot->chip_info.serial_number == 427491329);
+
+	EXPECT(snapshot->is_sata_info_valid);
+	for (i = 0; i < 2; i++)
+	{
+		const struct jmraid_sata_info_item *item = &snapshot->sata_info.item[i];
+		EXPECT(is_same_text(item->model_name, "WDC WD20EFRX-68EUZN0"));
+		EXPECT(item->port_type == 0x02);
+		EXPECT(item->page_0_raid_index == 0);
+		EXPECT(item->page_0_raid_member_index == i);
+		EXPECT(snapshot->is_sata_port_info_valid[i]);
+		EXPECT(snapshot->sata_port_info[i].port_type == 0x02);
+	}
+	EXPECT(is_same_text(snapshot->sata_info.item[0].serial_number, "WD-WCC4M3NFRNP6"));
+	EXPECT(is_same_text(snapshot->sata_info.item[1].serial_number, "WD-WCC4M0JTYKN6"));
+	EXPECT(snapshot->sata_info.item[2].port_type == 0x06);
+	EXPECT(snapshot->sata_info.item[3].port_type == 0x07);
+
+	EXPECT(snapshot->is_raid_port_info_valid[0]);
+	EXPECT(is_same_text(raid->model_name, "H/W RAID1"));
+	EXPECT(is_same_text(raid->serial_number, "EDB1BFFDF37MG3M1G15C"));
+	EXPECT(raid->port_state == 1);
+	EXPECT(raid->level == 1);
+	EXPECT(raid->state == 3);
+	EXPECT(raid->member_count == 2);
+	EXPECT(raid->rebuild_priority == 4096);
+	EXPECT(raid->standby_timer == 900);
+
+	// attribute 3 (spin-up time) differs between the two disks
+	for (i = 0; i < 2; i++)
+	{
+		const struct jmraid_disk_smart_info_attribute *attribute = &snapshot->disk_smart_info[i].attribute[1];
+		EXPECT(snapshot->is_disk_smart_info_valid[i]);
+		EXPECT(snapshot->disk_smart_info[i].attribute[0].id == 1);
+		EXPECT(attribute->id == 3);
+		EXPECT(attribute->threshold == 21);
+		EXPECT(attribute->raw_value == (i ? 0x1081 : 0x0FFB));
+	}
+	EXPECT(!snapshot->is_disk_smart_info_valid[2]);
+
+	return true;
+}
+
+bool test_emu_snapshot(void)
+{
+	static struct emu emu;
+	static struct jmraid jmraid;
+	static struct jmraid_snapshot snapshot;
+
+	if (!open_emu(&emu, &jmraid))
+	{
+		return false;
+	}
+	EXPECT(jmraid_get_snapshot(&jmraid, &snapshot));
+	EXPECT(check_hotway_snapshot(&snapshot));
+	// the one of jmraid_session_open() only
+	EXPECT(jmraid.handshake_count == 1);
+	EXPECT(jmraid_session_close(&jmraid));
+
+	return true;
+}
+
+// every other command fails the way fail_result fakes it: CRC errors and
+// lost responses are retried after a new handshake and go through, the
+// others fail that command only
+bool test_emu_errors(void)
+{
+	static const struct
+	{
+		int result;
+		bool is_retried;
+	} cases[] = {
+		{ JMRAID_RESULT_CRC, true },
+		{ JMRAID_RESULT_NO_RESPONSE, true },
+		{ JMRAID_RESULT_SEQ, false },
+		{ JMRAID_RESULT_COMMAND, false },
+		{ JMRAID_RESULT_IO, false },
+		{ EMU_STATUS_INVALID, false },
+	};
+	static struct emu emu;
+	static struct jmraid jmraid;
+	static struct jmraid_snapshot snapshot;
+	struct jmraid_chip_info info;
+	size_t i;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		bool is_ok;
+
+		if (!open_emu(&emu, &jmraid))
+		{
+			return false;
+		}
+		emu.config.fail_every = 2;
+		emu.config.fail_result = cases[i].result;
+
+		// the handshake was the first, this is the second
+		is_ok = jmraid_get_chip_info(&jmraid, &info);
+		EXPECT(is_ok == cases[i].is_retried);
+		EXPECT(jmraid.handshake_count == (cases[i].is_retried ? 2u : 1u));
+		EXPECT(jmraid_get_last_result(&jmraid) == (cases[i].is_retried ? JMRAID_RESULT_OK : cases[i].result));
+
+		// a failed snapshot says which parts are missing, the next one is
+		// whole again
+		emu.config.fail_every = 3;
+		EXPECT(cases[i].is_retried == jmraid_get_snapshot(&jmraid, &snapshot));
+		emu.config.fail_every = 0;
+		EXPECT(jmraid_get_snapshot(&jmraid, &snapshot));
+		EXPECT(check_hotway_snapshot(&snapshot));
+
+		EXPECT(jmraid_session_close(&jmraid));
+	}
+
+	// the bridge forgets the command mode (reset, USB reconnect)
+	if (!open_emu(&emu, &jmraid))
+	{
+		return false;
+	}
+	emu_reset(&emu);
+	EXPECT(jmraid_get_chip_info(&jmraid, &info));
+	EXPECT(jmraid.handshake_count == 2);
+	EXPECT(jmraid_session_close(&jmraid));
+
+	return true;
+}
+
+static const struct test_case TABLE_TEST_CASE[] =
+{
+	{ "scramble", NULL, test_scramble },
+	{ "crc_slice8", NULL, test_crc_slice8 },
+	{ "crc_clmul", crc_has_clmul, test_crc_clmul },
+	{ "crc", NULL, test_crc },
+	{ "emu_snapshot", NULL, test_emu_snapshot },
+	{ "emu_errors", NULL, test_emu_errors },
+};
+
+void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [case]\n", name);
+	fprintf(stderr, "  runs every case, or only the named one\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = (argc > 1) ? argv[1] : NULL;
+	int result = 0;
+	int count = 0;
+	size_t i;
+
+	if (argc > 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(TABLE_TEST_CASE) / sizeof(TABLE_TEST_CASE[0]); i++)
+	{
+		const struct test_case *test_case = &TABLE_TEST_CASE[i];
+
+		if (name && (strcmp(test_case->name, name) != 0)) {
+			continue;
+		}
+		count++;
+		if (test_case->supported && !test_case->supported()) {
+			printf("%-30s skipped\n", test_case->name);
+			if (name) {
+				return TEST_SKIPPED;
+			}
+			continue;
+		}
+		if (test_case->run()) {
+			printf("%-30s ok\n", test_case->name);
+		}
+		else {
+			printf("%-30s FAILED\n", test_case->name);
+			result = 1;
+		}
+	}
+
+	if (count == 0) {
+		fprintf(stderr, "unknown case \"%s\"\n", name);
+		usage(argv[0]);
+		return 1;
+	}
+
+	return result;
+}